@@ -0,0 +1,114 @@
+#include "Scene.h"
+#include "TextureMaterial.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+// Compares the BVH traversal of Scene::intersects against the linear scan over the
+// objects, on random sphere clouds of increasing size.
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedSeconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void fillScene(Scene& scene, int count, const std::shared_ptr<TextureMaterial>& material, Sampler& sampler)
+{
+    // Keep the density constant so that each ray meets a similar number of spheres.
+    double extent = 10.0 * std::cbrt(static_cast<double>(count));
+    double radius = 0.5;
+    for (int i = 0; i < count; i++)
+    {
+        Point3 center = Vector3::random(sampler, -extent, extent);
+        scene.addObject(std::make_shared<Sphere>(center, radius, material));
+    }
+}
+
+static std::vector<Ray> makeRays(int count, double extent, Sampler& sampler)
+{
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        Point3 origin = Vector3::random(sampler, -extent, extent);
+        rays.emplace_back(origin, RandomInUnitSphereVector(sampler));
+    }
+    return rays;
+}
+
+template<typename Intersect>
+static double traceRays(const std::vector<Ray>& rays, Intersect&& intersect, int& hits)
+{
+    hits = 0;
+    auto start = Clock::now();
+    for (const auto& ray : rays)
+    {
+        hit_record record;
+        if (intersect(ray, record)) hits++;
+    }
+    return elapsedSeconds(start);
+}
+
+int main()
+{
+    auto material = std::make_shared<UniformTexture>(Color3(0.5, 0.5, 0.5), 0.5, 0.5);
+    const int sizes[] = { 10, 1000, 100000, 1000000 };
+    Sampler sampler(42);
+
+    std::cout << std::setw(10) << "spheres" << std::setw(12) << "build (ms)"
+              << std::setw(18) << "linear (Mray/s)" << std::setw(16) << "bvh (Mray/s)"
+              << std::setw(10) << "speedup" << std::endl;
+
+    for (int size : sizes)
+    {
+        std::vector<std::shared_ptr<Object>> objects;
+        std::vector<std::shared_ptr<Light>> lights;
+        Scene scene(objects, lights);
+        fillScene(scene, size, material, sampler);
+
+        double extent = 10.0 * std::cbrt(static_cast<double>(size));
+
+        // The linear scan costs O(n) per ray, so shrink its ray budget on large scenes.
+        int linearRayCount = std::max(16, std::min(100000, 100000000 / size));
+        int bvhRayCount = 100000;
+        std::vector<Ray> rays = makeRays(std::max(linearRayCount, bvhRayCount), extent, sampler);
+        std::vector<Ray> linearRays(rays.begin(), rays.begin() + linearRayCount);
+
+        int linearHits = 0;
+        double linearTime = traceRays(linearRays, [&](const Ray& ray, hit_record& record)
+        {
+            return scene.intersectsLinear(ray, RayEpsilon, infinity, record);
+        }, linearHits);
+
+        auto buildStart = Clock::now();
+        scene.build();
+        double buildTime = elapsedSeconds(buildStart);
+
+        int bvhHits = 0;
+        double bvhTime = traceRays(rays, [&](const Ray& ray, hit_record& record)
+        {
+            return scene.intersects(ray, RayEpsilon, infinity, record);
+        }, bvhHits);
+
+        int checkHits = 0;
+        traceRays(linearRays, [&](const Ray& ray, hit_record& record)
+        {
+            return scene.intersects(ray, RayEpsilon, infinity, record);
+        }, checkHits);
+        if (checkHits != linearHits)
+            std::cerr << "Warning: BVH found " << checkHits << " hits, linear scan found " << linearHits << std::endl;
+
+        double linearRate = linearRayCount / linearTime / 1e6;
+        double bvhRate = rays.size() / bvhTime / 1e6;
+
+        std::cout << std::setw(10) << size << std::setw(12) << std::fixed << std::setprecision(2) << buildTime * 1e3
+                  << std::defaultfloat << std::setprecision(4) << std::setw(18) << linearRate << std::setw(16) << bvhRate
+                  << std::fixed << std::setprecision(1) << std::setw(9) << bvhRate / linearRate << "x" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include "Blob.h"
+#include "ImplicitBlob.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+// Traces the same rays through 2000 metaballs polygonized by marching cubes and through
+// ImplicitBlob, without and with its coarse grid. Reports the setup time paid before the
+// first ray (meshing and BVH, or the coarse grid), the tracing speed and how far the hits
+// are from those on the mesh.
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedSeconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main()
+{
+    auto material = std::make_shared<UniformTexture>(Color3(0.5, 0.5, 0.5), 0.5, 0.5);
+    auto field = std::make_shared<MetaballField>();
+    Sampler sampler(42);
+    for (int i = 0; i < 2000; i++)
+    {
+        Point3 center(RandomDouble(sampler, -5, 5), RandomDouble(sampler, -5, 5), RandomDouble(sampler, -5, 5));
+        field->addBall(center, RandomDouble(sampler, 0.2, 0.6));
+    }
+    field->build();
+    const Real threshold = 0.5;
+
+    // Rays from a sphere around the field towards random points inside it.
+    std::vector<Ray> rays;
+    for (int i = 0; i < 100000; i++)
+    {
+        Point3 origin = Point3(0, 0, 0) + 9 * RandomInUnitSphereVector(sampler);
+        Point3 target(RandomDouble(sampler, -4, 4), RandomDouble(sampler, -4, 4), RandomDouble(sampler, -4, 4));
+        rays.emplace_back(origin, Normalize(target - origin));
+    }
+
+    auto start = Clock::now();
+    Mesh mesh = Blob(field, threshold, Real(0.04), material).marchCubes();
+    mesh.build();
+    double meshSetup = elapsedSeconds(start);
+
+    std::vector<Real> meshDistances(rays.size(), -1);
+    start = Clock::now();
+    for (size_t r = 0; r < rays.size(); r++)
+    {
+        hit_record record;
+        if (mesh.intersects(rays[r], RayEpsilon, infinity, record)) meshDistances[r] = record.t;
+    }
+    double meshTrace = elapsedSeconds(start);
+
+    std::cout << field->size() << " metaballs, " << rays.size() << " rays, mesh of " << mesh.getTriangleCount() << " triangles" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(16) << "method" << std::setw(12) << "setup s" << std::setw(12) << "trace s" << std::setw(12) << "Mrays/s"
+              << std::setw(10) << "hits" << std::setw(14) << "hit/miss diff" << std::setw(14) << "mean |dt|" << std::endl;
+
+    auto report = [&](const std::string& method, double setup, double trace, const std::vector<Real>& distances)
+    {
+        int hits = 0;
+        int differing = 0;
+        double sum = 0;
+        int common = 0;
+        for (size_t r = 0; r < rays.size(); r++)
+        {
+            if (distances[r] >= 0) hits++;
+            if ((distances[r] >= 0) != (meshDistances[r] >= 0)) differing++;
+            if (distances[r] >= 0 && meshDistances[r] >= 0)
+            {
+                sum += std::abs(distances[r] - meshDistances[r]);
+                common++;
+            }
+        }
+        std::cout << std::setw(16) << method << std::setw(12) << setup << std::setw(12) << trace << std::setw(12) << rays.size() / trace / 1e6
+                  << std::setw(10) << hits << std::setw(14) << differing << std::setw(14) << (common > 0 ? sum / common : 0.0) << std::endl;
+    };
+
+    report("mesh d=0.04", meshSetup, meshTrace, meshDistances);
+
+    for (int gridResolution : { 0, 16, 64 })
+    {
+        ImplicitBlob blob(field, threshold, material, gridResolution);
+        start = Clock::now();
+        blob.build();
+        double setup = elapsedSeconds(start);
+
+        std::vector<Real> distances(rays.size(), -1);
+        start = Clock::now();
+        for (size_t r = 0; r < rays.size(); r++)
+        {
+            hit_record record;
+            if (blob.intersects(rays[r], RayEpsilon, infinity, record)) distances[r] = record.t;
+        }
+        double trace = elapsedSeconds(start);
+
+        report(gridResolution == 0 ? "implicit" : "implicit " + std::to_string(gridResolution) + "^3", setup, trace, distances);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#include "Blob.h"
+#include "Scene.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Plants a forest of side x side trees, each the same marching-cubes blob rotated, scaled
+// and moved, once as instances of the blob and once as transformed copies of its mesh.
+// Reports the memory held by the geometry and the BVHs, the build time and the tracing
+// speed, and how the hits of the two forests compare.
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedSeconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static size_t memorySize(const Mesh& mesh)
+{
+    return mesh.getMemorySize() + mesh.getBVH().getNodes().size() * sizeof(BVHNode) + mesh.getBVH().getIndices().size() * sizeof(uint32_t);
+}
+
+// Mesh of the vertices and normals of mesh moved by toWorld.
+static std::shared_ptr<Mesh> transformedCopy(const Mesh& mesh, const Transform& toWorld, const std::shared_ptr<TextureMaterial>& material)
+{
+    std::vector<Point3> vertices;
+    std::vector<Vector3> normals;
+    vertices.reserve(mesh.getVertexCount());
+    normals.reserve(mesh.getNormals().size());
+    for (const Point3& vertex : mesh.getVertices())
+        vertices.push_back(toWorld.applyPoint(vertex));
+    for (const Vector3& normal : mesh.getNormals())
+        normals.push_back(Normalize(toWorld.applyNormal(normal)));
+    std::vector<uint32_t> indices = mesh.getIndices();
+
+    auto copy = std::make_shared<Mesh>();
+    copy->setGeometry(std::move(vertices), std::move(normals), std::move(indices), material);
+    return copy;
+}
+
+int main(int argc, char** argv)
+{
+    int side = argc > 1 ? std::atoi(argv[1]) : 8;
+    if (side <= 0)
+    {
+        std::cerr << "Error: The forest side must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto material = std::make_shared<UniformTexture>(Color3(0.3, 0.6, 0.2), 0.5, 0.5);
+    auto field = std::make_shared<MetaballField>();
+    Sampler sampler(42);
+    for (int i = 0; i < 60; i++)
+    {
+        Point3 center(RandomDouble(sampler, -0.8, 0.8), RandomDouble(sampler, 0, 3), RandomDouble(sampler, -0.8, 0.8));
+        field->addBall(center, RandomDouble(sampler, 0.3, 0.6));
+    }
+    field->build();
+
+    auto start = Clock::now();
+    auto tree = std::make_shared<Mesh>(Blob(field, Real(0.5), Real(0.04), material).marchCubes());
+    tree->build();
+    double treeSetup = elapsedSeconds(start);
+
+    // Trees 3 units apart, with a random turn, size and offset each.
+    std::vector<Transform> placements;
+    for (int i = 0; i < side; i++)
+    {
+        for (int j = 0; j < side; j++)
+        {
+            Vector3 offset(3 * (i - side / Real(2)) + RandomDouble(sampler, -0.5, 0.5), 0, 3 * (j - side / Real(2)) + RandomDouble(sampler, -0.5, 0.5));
+            placements.push_back(Transform::translation(offset) * Transform::rotation(Vector3(0, 1, 0), RandomDouble(sampler, 0, 360))
+                * Transform::scaling(Vector3(1, 1, 1) * RandomDouble(sampler, 0.6, 1.2)));
+        }
+    }
+
+    // Rays from above the forest towards random points of its ground.
+    std::vector<Ray> rays;
+    Real extent = Real(1.5) * side;
+    for (int i = 0; i < 200000; i++)
+    {
+        Point3 origin(RandomDouble(sampler, -extent, extent), 10, RandomDouble(sampler, -extent, extent));
+        Point3 target(RandomDouble(sampler, -extent, extent), 0, RandomDouble(sampler, -extent, extent));
+        rays.emplace_back(origin, Normalize(target - origin));
+    }
+
+    std::cout << side * side << " trees of " << tree->getTriangleCount() << " triangles, meshed and built in " << treeSetup << " s, "
+              << rays.size() << " rays" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(12) << "forest" << std::setw(14) << "triangles" << std::setw(12) << "memory MB" << std::setw(12) << "build s"
+              << std::setw(12) << "trace s" << std::setw(12) << "Mrays/s" << std::setw(10) << "hits" << std::endl;
+
+    auto trace = [&](const std::string& name, Scene& scene, size_t triangles, size_t bytes, double build, std::vector<Real>& distances)
+    {
+        distances.assign(rays.size(), -1);
+        auto start = Clock::now();
+        int hits = 0;
+        for (size_t r = 0; r < rays.size(); r++)
+        {
+            hit_record record;
+            if (scene.intersects(rays[r], RayEpsilon, infinity, record))
+            {
+                distances[r] = record.t;
+                hits++;
+            }
+        }
+        double seconds = elapsedSeconds(start);
+        std::cout << std::setw(12) << name << std::setw(14) << triangles << std::setw(12) << bytes / double(1 << 20) << std::setw(12) << build
+                  << std::setw(12) << seconds << std::setw(12) << rays.size() / seconds / 1e6 << std::setw(10) << hits << std::endl;
+    };
+
+    std::vector<Real> instanceDistances, copyDistances;
+    {
+        Scene forest({}, {});
+        start = Clock::now();
+        for (const Transform& placement : placements)
+            forest.addInstance(tree, placement);
+        forest.build();
+        double build = elapsedSeconds(start);
+        size_t bytes = memorySize(*tree) + placements.size() * sizeof(Instance);
+        trace("instances", forest, tree->getTriangleCount(), bytes, build, instanceDistances);
+    }
+    {
+        Scene forest({}, {});
+        std::vector<std::shared_ptr<Mesh>> copies;
+        start = Clock::now();
+        for (const Transform& placement : placements)
+        {
+            copies.push_back(transformedCopy(*tree, placement, material));
+            forest.addObject(copies.back());
+        }
+        forest.build();
+        double build = elapsedSeconds(start);
+        size_t bytes = 0;
+        for (const auto& copy : copies)
+            bytes += memorySize(*copy);
+        trace("copies", forest, copies.size() * tree->getTriangleCount(), bytes, build, copyDistances);
+    }
+
+    // The instances hit the same surfaces as the copies, up to the rounding of the transforms.
+    int differing = 0;
+    double sum = 0;
+    int common = 0;
+    for (size_t r = 0; r < rays.size(); r++)
+    {
+        if ((instanceDistances[r] >= 0) != (copyDistances[r] >= 0)) differing++;
+        else if (instanceDistances[r] >= 0)
+        {
+            sum += std::abs(instanceDistances[r] - copyDistances[r]);
+            common++;
+        }
+    }
+    std::cout << "hit/miss differences " << differing << ", mean |dt| " << std::scientific << (common > 0 ? sum / common : 0.0) << std::endl;
+    return differing <= static_cast<int>(rays.size() / 1000) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#include "Blob.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+// Polygonizes a sphere blob on grids of 128^3 cubes (fewer if the maximum is smaller) up to
+// the resolution given as first argument (512 by default), with 1, 2, 4... threads up to all
+// the cores but at least 2, and checks that the mesh does not depend on the thread count. Then polygonizes 2000 metaballs at the
+// same resolutions, where skipping the empty space makes the time grow with the area of
+// the surface (4x per doubling of the resolution) rather than with the volume (8x).
+//     ./MarchingCubesBenchmark [max resolution]
+
+using Clock = std::chrono::high_resolution_clock;
+
+int main(int argc, char** argv)
+{
+    int maxResolution = argc > 1 ? std::atoi(argv[1]) : 512;
+    const int minResolution = std::min(128, maxResolution);
+    // At least two threads, so that the meshes are compared even on a single core.
+    int maxThreads = std::max(2, tbb::this_task_arena::max_concurrency());
+    tbb::global_control parallelism(tbb::global_control::max_allowed_parallelism, maxThreads);
+    auto material = std::make_shared<UniformTexture>(Color3(0.5, 0.5, 0.5), 0.5, 0.5);
+
+    int mismatches = 0;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(12) << "grid" << std::setw(10) << "threads" << std::setw(12) << "seconds" << std::setw(14) << "Mcubes/s"
+              << std::setw(10) << "speedup" << std::setw(12) << "triangles" << std::setw(12) << "vertices" << std::endl;
+
+    for (int resolution = minResolution; resolution <= maxResolution; resolution *= 2)
+    {
+        // Blob of radius 2 centered in a box of edge 4.
+        Blob blob(Point3(0, 0, 0), 4, Real(4.0) / resolution, 1.0, material);
+        double cubes = static_cast<double>(resolution) * resolution * resolution;
+
+        double singleThread = 0.0;
+        std::vector<uint32_t> reference;
+        for (int threads = 1;; threads = std::min(2 * threads, maxThreads))
+        {
+            tbb::task_arena arena(threads);
+            Mesh mesh;
+            auto start = Clock::now();
+            arena.execute([&]() { mesh = blob.marchCubes(); });
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            if (threads == 1)
+            {
+                singleThread = seconds;
+                reference = mesh.getIndices();
+            }
+            else if (mesh.getIndices() != reference)
+            {
+                mismatches++;
+            }
+
+            std::string grid = std::to_string(resolution) + "^3";
+            std::cout << std::setw(12) << grid << std::setw(10) << threads << std::setw(12) << seconds << std::setw(14) << cubes / seconds / 1e6
+                      << std::setw(10) << singleThread / seconds << std::setw(12) << mesh.getTriangleCount() << std::setw(12) << mesh.getVertexCount() << std::endl;
+
+            if (threads == maxThreads) break;
+        }
+    }
+
+    auto field = std::make_shared<MetaballField>();
+    Sampler sampler(42);
+    for (int i = 0; i < 2000; i++)
+    {
+        Point3 center(RandomDouble(sampler, -5, 5), RandomDouble(sampler, -5, 5), RandomDouble(sampler, -5, 5));
+        field->addBall(center, RandomDouble(sampler, 0.2, 0.6));
+    }
+    field->build();
+
+    std::cout << std::endl << field->size() << " metaballs" << std::endl;
+    std::cout << std::setw(12) << "grid" << std::setw(12) << "seconds" << std::setw(12) << "triangles" << std::setw(16) << "ns/triangle" << std::endl;
+    for (int resolution = minResolution; resolution <= maxResolution; resolution *= 2)
+    {
+        Blob blob(field, 0.5, Real(11.2) / resolution, material);
+        auto start = Clock::now();
+        Mesh mesh = blob.marchCubes();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::string grid = std::to_string(resolution) + "^3";
+        std::cout << std::setw(12) << grid << std::setw(12) << seconds << std::setw(12) << mesh.getTriangleCount()
+                  << std::setw(16) << seconds * 1e9 / mesh.getTriangleCount() << std::endl;
+    }
+
+    std::cout << std::endl << mismatches << " meshes differing from the single-threaded one" << std::endl;
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,162 @@
+#include "MeshLoader.h"
+
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// Loads meshes given on the command line or, without arguments, a torus of 2M triangles
+// written as OBJ (with vertex normals) and as binary PLY, and reports the load throughput.
+// The two loaded tori are compared.
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedSeconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Torus of segments x segments quads, two triangles each.
+static void makeTorus(int segments, std::vector<float>& vertices, std::vector<float>& normals, std::vector<uint32_t>& indices)
+{
+    const double major = 1, minor = 0.3;
+    for (int i = 0; i < segments; i++)
+    {
+        double u = 2 * M_PI * i / segments;
+        for (int j = 0; j < segments; j++)
+        {
+            double v = 2 * M_PI * j / segments;
+            double nx = std::cos(u) * std::cos(v), ny = std::sin(u) * std::cos(v), nz = std::sin(v);
+            double ring = major + minor * std::cos(v);
+            float position[3] = { float(ring * std::cos(u)), float(ring * std::sin(u)), float(minor * nz) };
+            float normal[3] = { float(nx), float(ny), float(nz) };
+            vertices.insert(vertices.end(), position, position + 3);
+            normals.insert(normals.end(), normal, normal + 3);
+
+            uint32_t a = i * segments + j, b = i * segments + (j + 1) % segments;
+            uint32_t c = ((i + 1) % segments) * segments + j, d = ((i + 1) % segments) * segments + (j + 1) % segments;
+            uint32_t quad[6] = { a, c, d, a, d, b };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static bool writeObj(const std::string& path, const std::vector<float>& vertices, const std::vector<float>& normals, const std::vector<uint32_t>& indices)
+{
+    std::string text;
+    char buffer[64];
+    auto append = [&](const char* prefix, const std::vector<float>& values)
+    {
+        for (size_t i = 0; i < values.size(); i += 3)
+        {
+            text += prefix;
+            for (int k = 0; k < 3; k++)
+            {
+                buffer[0] = ' ';
+                char* end = std::to_chars(buffer + 1, buffer + sizeof(buffer), values[i + k]).ptr;
+                text.append(buffer, end);
+            }
+            text += '\n';
+        }
+    };
+    append("v", vertices);
+    append("vn", normals);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        text += 'f';
+        for (int k = 0; k < 3; k++)
+        {
+            std::string index = std::to_string(indices[i + k] + 1);
+            text += ' ' + index + "//" + index;
+        }
+        text += '\n';
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(text.data(), text.size());
+    return file.good();
+}
+
+static bool writePly(const std::string& path, const std::vector<float>& vertices, const std::vector<float>& normals, const std::vector<uint32_t>& indices)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << "ply\nformat binary_little_endian 1.0\nelement vertex " << vertices.size() / 3
+         << "\nproperty float x\nproperty float y\nproperty float z\nproperty float nx\nproperty float ny\nproperty float nz\n"
+         << "element face " << indices.size() / 3 << "\nproperty list uchar int vertex_indices\nend_header\n";
+    for (size_t i = 0; i < vertices.size(); i += 3)
+    {
+        file.write(reinterpret_cast<const char*>(&vertices[i]), 3 * sizeof(float));
+        file.write(reinterpret_cast<const char*>(&normals[i]), 3 * sizeof(float));
+    }
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        file.put(3);
+        file.write(reinterpret_cast<const char*>(&indices[i]), 3 * sizeof(uint32_t));
+    }
+    return file.good();
+}
+
+static bool benchmark(const std::string& path, Mesh& mesh)
+{
+    auto material = std::make_shared<UniformTexture>(Color3(0.5, 0.5, 0.5), 0.5, 0.5);
+    std::ifstream size(path, std::ios::binary | std::ios::ate);
+    double megabytes = static_cast<double>(size.tellg()) / (1 << 20);
+
+    auto start = Clock::now();
+    if (!loadMesh(path, mesh, material)) return false;
+    double seconds = elapsedSeconds(start);
+
+    std::cout << std::setw(28) << path << std::setw(10) << megabytes << std::setw(12) << mesh.getVertexCount() << std::setw(12)
+              << mesh.getTriangleCount() << std::setw(10) << (mesh.getNormals().empty() ? "no" : "yes") << std::setw(10) << seconds
+              << std::setw(10) << megabytes / seconds << std::setw(12) << mesh.getTriangleCount() / seconds / 1e6 << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(28) << "file" << std::setw(10) << "MB" << std::setw(12) << "vertices" << std::setw(12) << "triangles"
+              << std::setw(10) << "normals" << std::setw(10) << "load s" << std::setw(10) << "MB/s" << std::setw(12) << "Mtris/s" << std::endl;
+
+    if (argc > 1)
+    {
+        for (int a = 1; a < argc; a++)
+        {
+            Mesh mesh;
+            if (!benchmark(argv[a], mesh)) return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<float> vertices, normals;
+    std::vector<uint32_t> indices;
+    makeTorus(1024, vertices, normals, indices);
+    const std::string obj = "MeshLoaderBenchmark.obj", ply = "MeshLoaderBenchmark.ply";
+    if (!writeObj(obj, vertices, normals, indices) || !writePly(ply, vertices, normals, indices))
+    {
+        std::cerr << "Error: Could not write the benchmark meshes" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Mesh objMesh, plyMesh;
+    bool loaded = benchmark(obj, objMesh) && benchmark(ply, plyMesh);
+    std::remove(obj.c_str());
+    std::remove(ply.c_str());
+    if (!loaded) return EXIT_FAILURE;
+
+    // The OBJ text holds the shortest decimals reading back to the floats of the PLY file.
+    bool same = objMesh.getIndices() == indices && plyMesh.getIndices() == indices && objMesh.getVertexCount() == plyMesh.getVertexCount()
+        && objMesh.getNormals().size() == plyMesh.getNormals().size();
+    double difference = 0;
+    for (size_t i = 0; same && i < objMesh.getVertexCount(); i++)
+    {
+        difference = std::max(difference, static_cast<double>((objMesh.getVertices()[i] - plyMesh.getVertices()[i]).Length()));
+        difference = std::max(difference, static_cast<double>((objMesh.getNormals()[i] - plyMesh.getNormals()[i]).Length()));
+    }
+    same = same && difference < 1e-6;
+    std::cout << "OBJ and PLY meshes " << (same ? "match" : "differ") << ", largest difference " << std::scientific << difference << std::endl;
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+#include "Scene.h"
+#include "Mesh.h"
+#include "Light.h"
+#include "TextureMaterial.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+// Compares single rays against SIMD ray packets (Scene::intersectsRays and
+// Scene::occludedRays) on coherent camera rays and on the shadow rays of their hits,
+// for a scene of spheres and a triangle mesh, and checks that both give the same results.
+//     ./PacketBenchmark [image side]
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedSeconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Wavy height field of 2 * resolution^2 triangles over [-4, 2] x [-4, 2].
+static std::shared_ptr<Mesh> makeTerrain(int resolution, const std::shared_ptr<TextureMaterial>& material)
+{
+    auto height = [](double x, double z) { return -0.5 + 0.1 * std::sin(3.0 * x) * std::cos(2.0 * z); };
+    auto vertex = [&](int i, int j)
+    {
+        double x = -4.0 + 6.0 * i / resolution;
+        double z = -4.0 + 6.0 * j / resolution;
+        return Point3(x, height(x, z), z);
+    };
+
+    auto mesh = std::make_shared<Mesh>();
+    for (int j = 0; j < resolution; j++)
+    {
+        for (int i = 0; i < resolution; i++)
+        {
+            mesh->addTriangle(Triangle(vertex(i, j), vertex(i, j + 1), vertex(i + 1, j + 1), material));
+            mesh->addTriangle(Triangle(vertex(i, j), vertex(i + 1, j + 1), vertex(i + 1, j), material));
+        }
+    }
+    return mesh;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::shared_ptr<Object>> objects;
+    std::vector<std::shared_ptr<Light>> lights;
+    Scene world(objects, lights);
+
+    auto material = std::make_shared<UniformTexture>(Color3(0.5, 0.5, 0.5), 0.5, 0.5);
+    Sampler sampler(42);
+    for (int i = 0; i < 500; i++)
+    {
+        Point3 center(RandomDouble(sampler, -3, 1), RandomDouble(sampler, -0.4, 0.6), RandomDouble(sampler, -3, 1));
+        world.addObject(std::make_shared<Sphere>(center, RandomDouble(sampler, 0.05, 0.2), material));
+    }
+    world.addObject(makeTerrain(200, material));
+    world.build();
+
+    PointLight light(Point3(1, 4, 10), Color3(1, 1, 1), 1.0);
+
+    // Camera rays through the pixel centers, in scanline order.
+    const int width = argc > 1 ? std::max(1, std::atoi(argv[1])) : 512;
+    const int height = width;
+    std::vector<Ray> rays;
+    rays.reserve(static_cast<size_t>(width) * height);
+    for (int j = 0; j < height; j++)
+    {
+        for (int i = 0; i < width; i++)
+            rays.push_back(world.getCamera().getRay((i + 0.5) / width, (j + 0.5) / height));
+    }
+
+    size_t count = rays.size();
+    std::vector<hit_record> scalarRecords(count);
+    std::vector<hit_record> packetRecords(count);
+    std::unique_ptr<bool[]> scalarHits = std::make_unique<bool[]>(count);
+    std::unique_ptr<bool[]> packetHits = std::make_unique<bool[]>(count);
+
+    auto start = Clock::now();
+    for (size_t r = 0; r < count; r++)
+        scalarHits[r] = world.intersects(rays[r], RayEpsilon, infinity, scalarRecords[r]);
+    double scalarPrimary = elapsedSeconds(start);
+
+    start = Clock::now();
+    world.intersectsRays(rays.data(), count, RayEpsilon, infinity, packetRecords.data(), packetHits.get());
+    double packetPrimary = elapsedSeconds(start);
+
+    int mismatches = 0;
+    std::vector<Ray> shadowRays;
+    std::vector<Real> distances;
+    for (size_t r = 0; r < count; r++)
+    {
+        const hit_record& a = scalarRecords[r];
+        const hit_record& b = packetRecords[r];
+        if (scalarHits[r] != packetHits[r]) mismatches++;
+        if (!scalarHits[r] || !packetHits[r]) continue;
+
+        if (a.t != b.t || a.normal.getX() != b.normal.getX() || a.normal.getY() != b.normal.getY() || a.normal.getZ() != b.normal.getZ())
+            mismatches++;
+
+        shadowRays.emplace_back(a.p, light.getDirection(a.p));
+        distances.push_back(light.getDistance(a.p));
+    }
+
+    size_t shadowCount = shadowRays.size();
+    std::unique_ptr<bool[]> scalarOccluded = std::make_unique<bool[]>(shadowCount);
+    std::unique_ptr<bool[]> packetOccluded = std::make_unique<bool[]>(shadowCount);
+
+    start = Clock::now();
+    for (size_t r = 0; r < shadowCount; r++)
+        scalarOccluded[r] = world.occluded(shadowRays[r], RayEpsilon, distances[r]);
+    double scalarShadow = elapsedSeconds(start);
+
+    start = Clock::now();
+    world.occludedRays(shadowRays.data(), distances.data(), shadowCount, RayEpsilon, packetOccluded.get());
+    double packetShadow = elapsedSeconds(start);
+
+    int shadowed = 0;
+    for (size_t r = 0; r < shadowCount; r++)
+    {
+        if (scalarOccluded[r] != packetOccluded[r]) mismatches++;
+        if (scalarOccluded[r]) shadowed++;
+    }
+
+    std::cout << PacketWidth << "-wide packets, " << count << " camera rays, " << shadowCount << " shadow rays ("
+              << shadowed << " occluded), " << mismatches << " mismatches" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(10) << "rays" << std::setw(16) << "scalar Mrays/s" << std::setw(16) << "packet Mrays/s" << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::setw(10) << "camera" << std::setw(16) << count / scalarPrimary / 1e6 << std::setw(16) << count / packetPrimary / 1e6
+              << std::setw(10) << scalarPrimary / packetPrimary << std::endl;
+    std::cout << std::setw(10) << "shadow" << std::setw(16) << shadowCount / scalarShadow / 1e6 << std::setw(16) << shadowCount / packetShadow / 1e6
+              << std::setw(10) << scalarShadow / packetShadow << std::endl;
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,124 @@
+#include "Renderer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <tbb/global_control.h>
+
+// Renders the same scene with the same seed serially and in parallel: with the sequential
+// and parallel execution policies, and on the tile scheduler with one thread and with many,
+// in both render modes. Checks that every run accumulates the same samples as the serial
+// one, bit for bit in every pixel, and reports the total energy and the time of each run.
+//     ./ParallelBenchmark [image side]
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double totalEnergy(const Image& image)
+{
+    double energy = 0;
+    for (int y = 0; y < image.getHeight(); y++)
+    {
+        for (int x = 0; x < image.getWidth(); x++)
+        {
+            Color3 radiance = image.getRadiance(x, y);
+            energy += static_cast<double>(radiance.getX() + radiance.getY() + radiance.getZ()) * image.getSampleCount(x, y);
+        }
+    }
+    return energy;
+}
+
+// Number of pixels whose sample count or accumulated radiance differ between a and b.
+static int countMismatches(const Image& a, const Image& b)
+{
+    int mismatches = 0;
+    for (int y = 0; y < a.getHeight(); y++)
+    {
+        for (int x = 0; x < a.getWidth(); x++)
+        {
+            Color3 ra = a.getRadiance(x, y), rb = b.getRadiance(x, y);
+            if (a.getSampleCount(x, y) != b.getSampleCount(x, y) || std::memcmp(&ra, &rb, sizeof(Color3)) != 0) mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    // Enough threads for the parallel runs to interleave even on a single core.
+    const int Threads = 4;
+    tbb::global_control parallelism(tbb::global_control::max_allowed_parallelism, Threads);
+
+    std::vector<std::shared_ptr<Object>> objects;
+    std::vector<std::shared_ptr<Light>> lights;
+    Scene world(objects, lights);
+
+    std::vector<std::shared_ptr<TextureMaterial>> materials = {
+        std::make_shared<UniformTexture>(Color3(0.8, 0.3, 0.3), 0.5, 0.5),
+        std::make_shared<UniformTexture>(Color3(0.3, 0.8, 0.3), 0.7, 0.2),
+        std::make_shared<MetalTexture>(Color3(0.8, 0.8, 0.8), 0.3),
+        std::make_shared<MirrorTexture>(Color3(0.9, 0.9, 0.9))
+    };
+
+    Sampler sampler(42);
+    for (int i = 0; i < 200; i++)
+    {
+        Point3 center(RandomDouble(sampler, -3, 1), RandomDouble(sampler, -0.4, 0.6), RandomDouble(sampler, -3, 1));
+        world.addObject(std::make_shared<Sphere>(center, RandomDouble(sampler, 0.05, 0.2), materials[i % materials.size()]));
+    }
+    world.addObject(std::make_shared<Sphere>(Point3(0, -100.5, -1), 100, materials[0]));
+    world.addLight(std::make_shared<PointLight>(Point3(1, 4, 10), Color3(1, 1, 1), 1.2));
+    world.build();
+
+    RenderSettings settings;
+    settings.samples_per_pixel = 8;
+    settings.seed = 7;
+    const int width = argc > 1 ? std::max(1, std::atoi(argv[1])) : 128;
+    const int height = width;
+
+    std::cout << width << "x" << height << " at " << settings.samples_per_pixel << " spp, seed " << settings.seed << std::endl;
+    std::cout << std::fixed;
+    std::cout << std::setw(14) << "mode" << std::setw(16) << "run" << std::setw(12) << "seconds" << std::setw(18) << "energy"
+              << std::setw(12) << "mismatches" << std::endl;
+
+    int failures = 0;
+    for (RenderMode mode : { RenderMode::DepthFirst, RenderMode::Wavefront })
+    {
+        settings.mode = mode;
+        Renderer renderer(world, settings);
+        const char* modeName = mode == RenderMode::DepthFirst ? "depth-first" : "wavefront";
+
+        Image serial(width, height);
+        auto report = [&](const std::string& run, Image& image, auto&& render)
+        {
+            auto start = Clock::now();
+            render(image);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            int mismatches = countMismatches(serial, image);
+            if (mismatches > 0) failures++;
+            std::cout << std::setw(14) << modeName << std::setw(16) << run << std::setw(12) << std::setprecision(3) << seconds
+                      << std::setw(18) << std::setprecision(6) << totalEnergy(image) << std::setw(12) << mismatches << std::endl;
+        };
+
+        // The serial reference, compared with itself.
+        report("seq", serial, [&](Image& image) { renderer.render(std::execution::seq, image); });
+
+        Image parallel(width, height);
+        report("par", parallel, [&](Image& image) { renderer.render(std::execution::par, image); });
+
+        for (int threads : { 1, Threads })
+        {
+            SchedulerSettings schedulerSettings;
+            schedulerSettings.threads = threads;
+            TileScheduler scheduler(schedulerSettings);
+            Image scheduled(width, height);
+            report("scheduler x" + std::to_string(threads), scheduled, [&](Image& image) { renderer.render(scheduler, image); });
+        }
+    }
+
+    std::cout << (failures == 0 ? "All runs match the serial render" : "Some runs differ from the serial render") << std::endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+#include "Renderer.h"
+#include "Mesh.h"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+// Renders a fixed scene in the precision the program is built with (see Real.h). CMake
+// builds it twice, as PrecisionBenchmarkDouble and PrecisionBenchmarkFloat, and the two
+// images can be compared with ImageDiff:
+//     ./PrecisionBenchmarkDouble double.ppm
+//     ./PrecisionBenchmarkFloat float.ppm
+//     ./ImageDiff double.ppm float.ppm diff.ppm
+
+using Clock = std::chrono::high_resolution_clock;
+
+// Wavy height field of 2 * resolution^2 triangles over [-4, 2] x [-4, 2].
+static std::shared_ptr<Mesh> makeTerrain(int resolution, const std::shared_ptr<TextureMaterial>& material)
+{
+    auto height = [](double x, double z) { return -0.45 + 0.05 * std::sin(3.0 * x) * std::cos(2.0 * z); };
+    auto vertex = [&](int i, int j)
+    {
+        double x = -4.0 + 6.0 * i / resolution;
+        double z = -4.0 + 6.0 * j / resolution;
+        return Point3(x, height(x, z), z);
+    };
+
+    auto mesh = std::make_shared<Mesh>();
+    for (int j = 0; j < resolution; j++)
+    {
+        for (int i = 0; i < resolution; i++)
+        {
+            mesh->addTriangle(Triangle(vertex(i, j), vertex(i, j + 1), vertex(i + 1, j + 1), material));
+            mesh->addTriangle(Triangle(vertex(i, j), vertex(i + 1, j + 1), vertex(i + 1, j), material));
+        }
+    }
+    return mesh;
+}
+
+int main(int argc, char** argv)
+{
+    const char* precision = sizeof(Real) == sizeof(float) ? "float" : "double";
+    std::string output = argc > 1 ? argv[1] : std::string(precision) + ".ppm";
+
+    std::vector<std::shared_ptr<Object>> objects;
+    std::vector<std::shared_ptr<Light>> lights;
+    Scene world(objects, lights);
+
+    std::vector<std::shared_ptr<TextureMaterial>> materials = {
+        std::make_shared<UniformTexture>(Color3(0.8, 0.3, 0.3), 0.5, 0.5),
+        std::make_shared<UniformTexture>(Color3(0.3, 0.8, 0.3), 0.7, 0.2),
+        std::make_shared<MetalTexture>(Color3(0.8, 0.8, 0.8), 0.3),
+        std::make_shared<MirrorTexture>(Color3(0.9, 0.9, 0.9))
+    };
+
+    Sampler sampler(42);
+    for (int i = 0; i < 100; i++)
+    {
+        Point3 center(RandomDouble(sampler, -3, 1), RandomDouble(sampler, -0.3, 0.6), RandomDouble(sampler, -3, 1));
+        world.addObject(std::make_shared<Sphere>(center, RandomDouble(sampler, 0.05, 0.2), materials[i % materials.size()]));
+    }
+    auto terrain = makeTerrain(100, materials[1]);
+    world.addObject(terrain);
+    // Large sphere under the scene, the classic source of float self-intersection.
+    world.addObject(std::make_shared<Sphere>(Point3(0, -100.5, -1), 100, materials[0]));
+    world.addLight(std::make_shared<PointLight>(Point3(1, 4, 10), Color3(1, 1, 1), 1.2));
+    world.build();
+
+    RenderSettings settings;
+    settings.samples_per_pixel = 32;
+    int width = 256;
+    int height = 256;
+    Image image(width, height);
+
+    Renderer renderer(world, settings);
+    auto start = Clock::now();
+    renderer.render(std::execution::seq, image);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (!writeImage(image, output)) return EXIT_FAILURE;
+
+    double samples = static_cast<double>(width) * height * settings.samples_per_pixel;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "precision       " << precision << " (" << SimdReal::Width << "-wide packets)" << std::endl;
+    std::cout << "render          " << seconds << " s, " << samples / seconds / 1e6 << " Msamples/s" << std::endl;
+    std::cout << "sizeof          Vector3 " << sizeof(Vector3) << ", Ray " << sizeof(Ray) << ", hit_record " << sizeof(hit_record)
+              << ", Triangle " << sizeof(Triangle) << ", BVHNode " << sizeof(BVHNode) << " bytes" << std::endl;
+    std::cout << "terrain mesh    " << terrain->getTriangleCount() << " triangles, " << terrain->getVertexCount() << " vertices, "
+              << terrain->getMemorySize() / 1024 << " KiB" << std::endl;
+    std::cout << "image           " << output << std::endl;
+
+    return EXIT_SUCCESS;
+}
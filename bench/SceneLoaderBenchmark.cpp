@@ -0,0 +1,64 @@
+#include "SceneLoader.h"
+#include "Sampler.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// Writes a scene file of random spheres and triangles, 1M primitives by default, then loads
+// it and reports the parse and build times.
+
+int main(int argc, char** argv)
+{
+    const int primitives = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1000000;
+    const std::string path = argc > 2 ? argv[2] : "SceneLoaderBenchmark.scene";
+
+    {
+        std::ofstream file(path);
+        if (!file.is_open())
+        {
+            std::cerr << "Error: Could not open file " << path << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        file << std::fixed << std::setprecision(5);
+        file << "image 512 512\ncamera 0 0 60  0 0 0  0 1 0  60\n";
+        file << "material grey uniform 0.5 0.5 0.5  0.5 0.5\nmaterial steel metal 0.8 0.8 0.9  0.1\n";
+        file << "light 10 40 60  1 1 1  1.2\n";
+
+        // Three quarters spheres, one quarter triangles.
+        Sampler sampler(42);
+        int triangles = primitives / 4;
+        for (int i = 0; i < primitives - triangles; i++)
+        {
+            file << "sphere " << RandomDouble(sampler, -20, 20) << " " << RandomDouble(sampler, -20, 20) << " " << RandomDouble(sampler, -20, 20)
+                 << " " << RandomDouble(sampler, 0.01, 0.1) << (i % 2 ? " grey\n" : " steel\n");
+        }
+        for (int i = 0; i < triangles; i++)
+        {
+            Point3 center(RandomDouble(sampler, -20, 20), RandomDouble(sampler, -20, 20), RandomDouble(sampler, -20, 20));
+            for (int k = 0; k < 3; k++)
+            {
+                Point3 p = center + 0.1 * RandomInUnitSphereVector(sampler);
+                file << "vertex " << p.getX() << " " << p.getY() << " " << p.getZ() << "\n";
+            }
+            file << "face " << 3 * i << " " << 3 * i + 1 << " " << 3 * i + 2 << " grey\n";
+        }
+    }
+
+    std::vector<std::shared_ptr<Object>> objects;
+    std::vector<std::shared_ptr<Light>> lights;
+    Scene scene(objects, lights);
+    SceneSettings settings;
+    SceneLoader loader;
+    bool loaded = loader.load(path, scene, settings);
+    std::remove(path.c_str());
+    if (!loaded) return EXIT_FAILURE;
+
+    loader.report(std::cout);
+    const auto& statistics = loader.getStatistics();
+    std::cout << "Total " << (statistics.parse_seconds + statistics.build_seconds) * 1000 << " ms for "
+              << statistics.spheres + statistics.triangles << " primitives, " << statistics.bytes / double(1 << 20) << " MB" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include "Object.h"
+#include "TextureMaterial.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC 1
+#endif
+
+// Measures the cost of one ray/triangle test with the precomputed Moller-Trumbore kernel
+// of Triangle against the previous geometric (plane + inside-outside) test.
+
+using Clock = std::chrono::high_resolution_clock;
+
+// The former Triangle::intersects, recomputing the edges and the plane on every call.
+static bool intersectsGeometric(const Point3& p0, const Point3& p1, const Point3& p2, const Ray& ray, Real t_min, Real t_max, Real& t_hit)
+{
+    Vector3 N = Cross(p1 - p0, p2 - p0);
+    Real NsRD = Dot(N, ray.direction());
+    if (NsRD == 0) return false;
+
+    Real D = -Dot(N, p0);
+    Real t = -(Dot(N, ray.origin()) + D) / NsRD;
+    if (t < t_min || t > t_max) return false;
+
+    Point3 P = ray.at(t);
+    if (Dot(N, Cross(p1 - p0, P - p0)) < 0) return false;
+    if (Dot(N, Cross(p2 - p1, P - p1)) < 0) return false;
+    if (Dot(N, Cross(p0 - p2, P - p2)) < 0) return false;
+
+    t_hit = t;
+    return true;
+}
+
+struct Timing
+{
+    double nanoseconds;
+    double cycles;
+};
+
+template<typename Test>
+static Timing measure(size_t tests, Test&& test)
+{
+#ifdef HAS_RDTSC
+    unsigned long long startCycles = __rdtsc();
+#endif
+    auto start = Clock::now();
+    test();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    Timing timing{ seconds * 1e9 / tests, 0.0 };
+#ifdef HAS_RDTSC
+    timing.cycles = static_cast<double>(__rdtsc() - startCycles) / tests;
+#endif
+    return timing;
+}
+
+int main()
+{
+    const int triangleCount = 1024;
+    const int rayCount = 4096;
+    const size_t tests = static_cast<size_t>(triangleCount) * rayCount;
+
+    auto material = std::make_shared<UniformTexture>(Color3(0.5, 0.5, 0.5), 0.5, 0.5);
+    Sampler sampler(42);
+
+    std::vector<Triangle> triangles;
+    triangles.reserve(triangleCount);
+    for (int i = 0; i < triangleCount; i++)
+    {
+        Point3 center = Vector3::random(sampler, -1, 1);
+        triangles.emplace_back(center + 0.3 * Vector3::random(sampler, -1, 1), center + 0.3 * Vector3::random(sampler, -1, 1), center + 0.3 * Vector3::random(sampler, -1, 1), material);
+    }
+
+    std::vector<Ray> rays;
+    rays.reserve(rayCount);
+    for (int i = 0; i < rayCount; i++)
+    {
+        Point3 origin = 3.0 * RandomInUnitSphereVector(sampler);
+        rays.emplace_back(origin, Vector3::random(sampler, -0.5, 0.5) - origin);
+    }
+
+    size_t geometricHits = 0;
+    Timing geometric = measure(tests, [&]()
+    {
+        for (const auto& ray : rays)
+        {
+            for (const auto& triangle : triangles)
+            {
+                Real t;
+                if (intersectsGeometric(triangle.getP0(), triangle.getP1(), triangle.getP2(), ray, RayEpsilon, infinity, t)) geometricHits++;
+            }
+        }
+    });
+
+    size_t mollerHits = 0;
+    Timing moller = measure(tests, [&]()
+    {
+        for (const auto& ray : rays)
+        {
+            for (const auto& triangle : triangles)
+            {
+                Real t, u, v;
+                if (triangle.intersectsBarycentric(ray, RayEpsilon, infinity, t, u, v)) mollerHits++;
+            }
+        }
+    });
+
+    std::cout << tests << " ray/triangle tests, " << geometricHits << " / " << mollerHits << " hits" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(20) << "kernel" << std::setw(12) << "ns/test" << std::setw(16) << "cycles/test" << std::endl;
+    std::cout << std::setw(20) << "geometric" << std::setw(12) << geometric.nanoseconds << std::setw(16) << geometric.cycles << std::endl;
+    std::cout << std::setw(20) << "moller-trumbore" << std::setw(12) << moller.nanoseconds << std::setw(16) << moller.cycles << std::endl;
+
+    return EXIT_SUCCESS;
+}
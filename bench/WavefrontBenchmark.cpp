@@ -0,0 +1,77 @@
+#include "Renderer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+// Renders the same scene with the depth-first ray_cast and with the wavefront integrator
+// on a single thread, and checks that both produce the same image.
+//     ./WavefrontBenchmark [image side]
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double renderSeconds(const Scene& world, const RenderSettings& settings, Image& image)
+{
+    Renderer renderer(world, settings);
+    auto start = Clock::now();
+    renderer.render(std::execution::seq, image);
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::shared_ptr<Object>> objects;
+    std::vector<std::shared_ptr<Light>> lights;
+    Scene world(objects, lights);
+
+    std::vector<std::shared_ptr<TextureMaterial>> materials = {
+        std::make_shared<UniformTexture>(Color3(0.8, 0.3, 0.3), 0.5, 0.5),
+        std::make_shared<UniformTexture>(Color3(0.3, 0.8, 0.3), 0.7, 0.2),
+        std::make_shared<MetalTexture>(Color3(0.8, 0.8, 0.8), 0.3),
+        std::make_shared<MirrorTexture>(Color3(0.9, 0.9, 0.9))
+    };
+
+    Sampler sampler(42);
+    for (int i = 0; i < 200; i++)
+    {
+        Point3 center(RandomDouble(sampler, -3, 1), RandomDouble(sampler, -0.4, 0.6), RandomDouble(sampler, -3, 1));
+        world.addObject(std::make_shared<Sphere>(center, RandomDouble(sampler, 0.05, 0.2), materials[i % materials.size()]));
+    }
+    world.addObject(std::make_shared<Sphere>(Point3(0, -100.5, -1), 100, materials[0]));
+    world.addLight(std::make_shared<PointLight>(Point3(1, 4, 10), Color3(1, 1, 1), 1.2));
+    world.build();
+
+    RenderSettings settings;
+    settings.samples_per_pixel = 16;
+    int width = argc > 1 ? std::max(1, std::atoi(argv[1])) : 160;
+    int height = width;
+
+    Image depthFirstImage(width, height);
+    settings.mode = RenderMode::DepthFirst;
+    double depthFirstTime = renderSeconds(world, settings, depthFirstImage);
+
+    Image wavefrontImage(width, height);
+    settings.mode = RenderMode::Wavefront;
+    double wavefrontTime = renderSeconds(world, settings, wavefrontImage);
+
+    int mismatches = 0;
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            Pixel a = depthFirstImage.getPixel(x, y);
+            Pixel b = wavefrontImage.getPixel(x, y);
+            if (a.r != b.r || a.g != b.g || a.b != b.b) mismatches++;
+        }
+    }
+
+    double samples = static_cast<double>(width) * height * settings.samples_per_pixel;
+    std::cout << width << "x" << height << " at " << settings.samples_per_pixel << " spp, " << mismatches << " mismatching pixels" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(14) << "mode" << std::setw(12) << "seconds" << std::setw(16) << "Msamples/s" << std::endl;
+    std::cout << std::setw(14) << "depth-first" << std::setw(12) << depthFirstTime << std::setw(16) << samples / depthFirstTime / 1e6 << std::endl;
+    std::cout << std::setw(14) << "wavefront" << std::setw(12) << wavefrontTime << std::setw(16) << samples / wavefrontTime / 1e6 << std::endl;
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Vector.h"
+#include "Ray.h"
+#include "Utils.h"
+
+// Axis-aligned bounding box, empty by default (min = +inf, max = -inf).
+class AABB
+{
+public:
+    AABB() : m_min(infinity, infinity, infinity), m_max(-infinity, -infinity, -infinity) {}
+    AABB(const Point3& min, const Point3& max) : m_min(min), m_max(max) {}
+
+    inline const Point3& getMin() const { return m_min; }
+    inline const Point3& getMax() const { return m_max; }
+
+    inline bool isEmpty() const
+    {
+        return m_min.getX() > m_max.getX() || m_min.getY() > m_max.getY() || m_min.getZ() > m_max.getZ();
+    }
+
+    void grow(const Point3& point)
+    {
+        m_min = Min(m_min, point);
+        m_max = Max(m_max, point);
+    }
+
+    void grow(const AABB& other)
+    {
+        m_min = Min(m_min, other.m_min);
+        m_max = Max(m_max, other.m_max);
+    }
+
+    inline Point3 centroid() const { return 0.5 * (m_min + m_max); }
+
+    inline Vector3 extent() const { return m_max - m_min; }
+
+    // Returns the axis (0, 1 or 2) along which the box is the widest.
+    int largestAxis() const
+    {
+        Vector3 e = extent();
+        if (e.getX() > e.getY() && e.getX() > e.getZ()) return 0;
+        return e.getY() > e.getZ() ? 1 : 2;
+    }
+
+    Real surfaceArea() const
+    {
+        if (isEmpty()) return 0.0;
+        Vector3 e = extent();
+        return 2.0 * (e.getX() * e.getY() + e.getY() * e.getZ() + e.getZ() * e.getX());
+    }
+
+    // Squared distance from point to the nearest point of the box, 0 inside.
+    Real distanceSquared(const Point3& point) const
+    {
+        Real d = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Real v = std::max(m_min[axis] - point[axis], std::max(Real(0), point[axis] - m_max[axis]));
+            d += v * v;
+        }
+        return d;
+    }
+
+    // Squared distance from point to the farthest corner of the box.
+    Real farthestDistanceSquared(const Point3& point) const
+    {
+        Real d = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Real v = std::max(point[axis] - m_min[axis], m_max[axis] - point[axis]);
+            d += v * v;
+        }
+        return d;
+    }
+
+    // Slab test against a ray given by its origin and precomputed inverse direction.
+    // On success t_enter holds the distance at which the ray enters the box.
+    inline bool intersects(const Point3& origin, const Vector3& invDir, Real t_min, Real t_max, Real& t_enter) const
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Real t0 = (m_min[axis] - origin[axis]) * invDir[axis];
+            Real t1 = (m_max[axis] - origin[axis]) * invDir[axis];
+            if (invDir[axis] < 0.0) std::swap(t0, t1);
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min) return false;
+        }
+
+        t_enter = t_min;
+        return true;
+    }
+
+    bool intersects(const Ray& ray, Real t_min, Real t_max) const
+    {
+        Vector3 d = ray.direction();
+        Vector3 invDir(1.0 / d.getX(), 1.0 / d.getY(), 1.0 / d.getZ());
+        Real t_enter;
+        return intersects(ray.origin(), invDir, t_min, t_max, t_enter);
+    }
+
+    // Narrows [t_min, t_max] to the part of the ray within the box, false if it misses.
+    bool clip(const Ray& ray, Real& t_min, Real& t_max) const
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Real invDir = 1.0 / ray.direction()[axis];
+            Real t0 = (m_min[axis] - ray.origin()[axis]) * invDir;
+            Real t1 = (m_max[axis] - ray.origin()[axis]) * invDir;
+            if (invDir < 0.0) std::swap(t0, t1);
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min) return false;
+        }
+        return true;
+    }
+
+private:
+    Point3 m_min;
+    Point3 m_max;
+};
+
+inline AABB Union(const AABB& left, const AABB& right)
+{
+    AABB box = left;
+    box.grow(right);
+    return box;
+}
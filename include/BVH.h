@@ -0,0 +1,510 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_invoke.h>
+
+#include "AABB.h"
+#include "Ray.h"
+#include "RayPacket.h"
+
+struct BVHNode
+{
+    AABB bounds;
+    uint32_t first; // Leaf: first entry in the index list. Interior: index of the left child (right child is first + 1).
+    uint32_t count; // Number of primitives in a leaf, 0 for interior nodes.
+
+    inline bool isLeaf() const { return count > 0; }
+};
+
+// Bounding volume hierarchy over an abstract list of primitives identified by their index.
+// The tree is built with a binned surface area heuristic and stored flattened, the two
+// children of a node being adjacent in memory.
+class BVH
+{
+public:
+    static const int MaxDepth = 64;
+    static const int BinCount = 16;
+    static const uint32_t MaxLeafSize = 4;
+    // Subtrees of fewer primitives are built by a single task.
+    static const uint32_t ParallelBuildSize = 1 << 16;
+
+    BVH() = default;
+
+    void build(const std::vector<AABB>& primitiveBounds)
+    {
+        clear();
+        if (primitiveBounds.empty()) return;
+
+        uint32_t count = static_cast<uint32_t>(primitiveBounds.size());
+        std::vector<Reference> references(count);
+        AABB bounds;
+        AABB centroidBounds;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            references[i] = Reference{ primitiveBounds[i], i };
+            bounds.grow(primitiveBounds[i]);
+            centroidBounds.grow(primitiveBounds[i].centroid());
+        }
+
+        m_nodes = buildSubtree(BVHNode{ bounds, 0, count }, references, centroidBounds, 0);
+
+        m_indices.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            m_indices[i] = references[i].index;
+    }
+
+    // Recomputes the node bounds for primitives that moved without changing the tree
+    // topology. Cheaper than a rebuild but the tree quality degrades with large motions.
+    void refit(const std::vector<AABB>& primitiveBounds)
+    {
+        // Children are always stored after their parent, so a reverse sweep is bottom-up.
+        for (size_t i = m_nodes.size(); i-- > 0;)
+        {
+            BVHNode& node = m_nodes[i];
+            AABB bounds;
+            if (node.isLeaf())
+            {
+                for (uint32_t j = node.first; j < node.first + node.count; j++)
+                    bounds.grow(primitiveBounds[m_indices[j]]);
+            }
+            else
+            {
+                bounds = Union(m_nodes[node.first].bounds, m_nodes[node.first + 1].bounds);
+            }
+            node.bounds = bounds;
+        }
+    }
+
+    // Renumbers the primitives in the order the leaves reference them and returns the
+    // permutation: the new primitive i is the old primitive order[i]. The caller reorders
+    // its primitive arrays accordingly, after which every leaf covers a contiguous range.
+    std::vector<uint32_t> linearize()
+    {
+        std::vector<uint32_t> order = m_indices;
+        for (uint32_t i = 0; i < m_indices.size(); i++)
+            m_indices[i] = i;
+        return order;
+    }
+
+    // Replaces the tree with one built earlier, e.g. read back from a cache.
+    void assign(std::vector<BVHNode>&& nodes, std::vector<uint32_t>&& indices)
+    {
+        m_nodes = std::move(nodes);
+        m_indices = std::move(indices);
+    }
+
+    // Checks a tree that build did not make, e.g. read back from a cache, before traversal
+    // trusts it: every child stored after its parent and reached once, no deeper than
+    // MaxDepth, and every leaf range and primitive index within primitiveCount.
+    bool isValid(uint32_t primitiveCount) const
+    {
+        if (m_indices.size() != primitiveCount) return false;
+        if (m_nodes.empty()) return primitiveCount == 0;
+
+        std::vector<uint8_t> depth(m_nodes.size(), 0);
+        std::vector<bool> reached(m_nodes.size(), false);
+        reached[0] = true;
+        for (size_t i = 0; i < m_nodes.size(); i++)
+        {
+            const BVHNode& node = m_nodes[i];
+            if (!reached[i]) return false;
+            if (node.isLeaf())
+            {
+                if (node.first > primitiveCount || node.count > primitiveCount - node.first) return false;
+                continue;
+            }
+
+            uint32_t left = node.first;
+            if (left <= i || left >= m_nodes.size() - 1 || reached[left] || reached[left + 1] || depth[i] + 1 >= MaxDepth) return false;
+            reached[left] = reached[left + 1] = true;
+            depth[left] = depth[left + 1] = depth[i] + 1;
+        }
+
+        for (uint32_t index : m_indices)
+        {
+            if (index >= primitiveCount) return false;
+        }
+        return true;
+    }
+
+    void clear()
+    {
+        m_nodes.clear();
+        m_indices.clear();
+    }
+
+    inline bool isBuilt() const { return !m_nodes.empty(); }
+
+    inline const std::vector<BVHNode>& getNodes() const { return m_nodes; }
+    inline const std::vector<uint32_t>& getIndices() const { return m_indices; }
+
+    AABB getBounds() const { return m_nodes.empty() ? AABB() : m_nodes[0].bounds; }
+
+    // Closest-hit traversal. Children are visited front-to-back and any node entered
+    // beyond closest_so_far is skipped. The intersector is called as
+    // intersector(primitiveIndex, t_min, closest_so_far) and must return true and
+    // shrink closest_so_far when it finds a closer hit.
+    template<typename Intersector>
+    bool traverse(const Ray& ray, Real t_min, Real& closest_so_far, Intersector&& intersector) const
+    {
+        if (m_nodes.empty()) return false;
+
+        Point3 origin = ray.origin();
+        Vector3 d = ray.direction();
+        Vector3 invDir(1.0 / d.getX(), 1.0 / d.getY(), 1.0 / d.getZ());
+
+        struct StackEntry { uint32_t node; Real t_enter; };
+        StackEntry stack[MaxDepth + 1];
+        int top = 0;
+
+        Real t_enter;
+        if (!m_nodes[0].bounds.intersects(origin, invDir, t_min, closest_so_far, t_enter)) return false;
+        stack[top++] = StackEntry{ 0, t_enter };
+
+        bool hit = false;
+        while (top > 0)
+        {
+            StackEntry entry = stack[--top];
+            if (entry.t_enter > closest_so_far) continue;
+
+            const BVHNode& node = m_nodes[entry.node];
+            if (node.isLeaf())
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    if (intersector(m_indices[i], t_min, closest_so_far)) hit = true;
+                }
+                continue;
+            }
+
+            Real t_left, t_right;
+            bool hitLeft = m_nodes[node.first].bounds.intersects(origin, invDir, t_min, closest_so_far, t_left);
+            bool hitRight = m_nodes[node.first + 1].bounds.intersects(origin, invDir, t_min, closest_so_far, t_right);
+
+            if (hitLeft && hitRight)
+            {
+                // Push the far child first so that the near one is popped next.
+                if (t_left <= t_right)
+                {
+                    stack[top++] = StackEntry{ node.first + 1, t_right };
+                    stack[top++] = StackEntry{ node.first, t_left };
+                }
+                else
+                {
+                    stack[top++] = StackEntry{ node.first, t_left };
+                    stack[top++] = StackEntry{ node.first + 1, t_right };
+                }
+            }
+            else if (hitLeft) stack[top++] = StackEntry{ node.first, t_left };
+            else if (hitRight) stack[top++] = StackEntry{ node.first + 1, t_right };
+        }
+
+        return hit;
+    }
+
+    // Any-hit traversal for occlusion queries: returns as soon as the predicate, called as
+    // predicate(primitiveIndex, t_min, t_max), reports a hit. Visiting order is irrelevant.
+    template<typename Predicate>
+    bool traverseAny(const Ray& ray, Real t_min, Real t_max, Predicate&& predicate) const
+    {
+        if (m_nodes.empty()) return false;
+
+        Point3 origin = ray.origin();
+        Vector3 d = ray.direction();
+        Vector3 invDir(1.0 / d.getX(), 1.0 / d.getY(), 1.0 / d.getZ());
+
+        uint32_t stack[MaxDepth + 1];
+        int top = 0;
+        stack[top++] = 0;
+
+        Real t_enter;
+        while (top > 0)
+        {
+            const BVHNode& node = m_nodes[stack[--top]];
+            if (!node.bounds.intersects(origin, invDir, t_min, t_max, t_enter)) continue;
+
+            if (node.isLeaf())
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    if (predicate(m_indices[i], t_min, t_max)) return true;
+                }
+                continue;
+            }
+
+            stack[top++] = node.first + 1;
+            stack[top++] = node.first;
+        }
+
+        return false;
+    }
+
+    // Closest-hit traversal of a packet of coherent rays. A node is visited when any active
+    // lane enters it before its closest hit, which closest holds and the intersector,
+    // called as intersector(primitiveIndex, mask), shrinks for the lanes it hits.
+    template<typename PacketIntersector>
+    void traversePacket(const RayPacket& packet, SimdReal active, Real t_min, const SimdReal& closest, PacketIntersector&& intersector) const
+    {
+        if (m_nodes.empty() || !Any(active)) return;
+
+        SimdReal tMin(t_min);
+        SimdReal infinite(infinity);
+
+        struct StackEntry { uint32_t node; int lanes; Real t_enter; };
+        StackEntry stack[MaxDepth + 1];
+        int top = 0;
+
+        SimdReal t_enter;
+        SimdReal mask = active & intersectsPacket(m_nodes[0].bounds, packet, tMin, closest, t_enter);
+        if (!Any(mask)) return;
+        stack[top++] = StackEntry{ 0, mask.bits(), HorizontalMin(Select(mask, t_enter, infinite)) };
+
+        while (top > 0)
+        {
+            StackEntry entry = stack[--top];
+            SimdReal lanes = MaskFromBits<SimdReal>(entry.lanes);
+            if (entry.t_enter > HorizontalMax(Select(lanes, closest, -infinite))) continue;
+
+            const BVHNode& node = m_nodes[entry.node];
+            if (node.isLeaf())
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    intersector(m_indices[i], lanes);
+                continue;
+            }
+
+            SimdReal t_left, t_right;
+            SimdReal maskLeft = lanes & intersectsPacket(m_nodes[node.first].bounds, packet, tMin, closest, t_left);
+            SimdReal maskRight = lanes & intersectsPacket(m_nodes[node.first + 1].bounds, packet, tMin, closest, t_right);
+            bool hitLeft = Any(maskLeft);
+            bool hitRight = Any(maskRight);
+            Real nearLeft = hitLeft ? HorizontalMin(Select(maskLeft, t_left, infinite)) : infinity;
+            Real nearRight = hitRight ? HorizontalMin(Select(maskRight, t_right, infinite)) : infinity;
+
+            // Push the far child first so that the near one is popped next.
+            if (nearLeft <= nearRight)
+            {
+                if (hitRight) stack[top++] = StackEntry{ node.first + 1, maskRight.bits(), nearRight };
+                if (hitLeft) stack[top++] = StackEntry{ node.first, maskLeft.bits(), nearLeft };
+            }
+            else
+            {
+                if (hitLeft) stack[top++] = StackEntry{ node.first, maskLeft.bits(), nearLeft };
+                if (hitRight) stack[top++] = StackEntry{ node.first + 1, maskRight.bits(), nearRight };
+            }
+        }
+    }
+
+    // Any-hit traversal of a packet. The predicate, called as predicate(primitiveIndex, mask),
+    // returns the mask of the lanes it found occluded; those lanes stop traversing and the
+    // traversal ends once every active lane is occluded. Returns the occluded lanes.
+    template<typename PacketPredicate>
+    SimdReal traverseAnyPacket(const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max, PacketPredicate&& predicate) const
+    {
+        SimdReal occluded;
+        if (m_nodes.empty() || !Any(active)) return occluded;
+
+        SimdReal tMin(t_min);
+        uint32_t stack[MaxDepth + 1];
+        int top = 0;
+        stack[top++] = 0;
+
+        SimdReal t_enter;
+        while (top > 0)
+        {
+            const BVHNode& node = m_nodes[stack[--top]];
+            SimdReal lanes = AndNot(occluded, active) & intersectsPacket(node.bounds, packet, tMin, t_max, t_enter);
+            if (!Any(lanes)) continue;
+
+            if (node.isLeaf())
+            {
+                for (uint32_t i = node.first; i < node.first + node.count && Any(lanes); i++)
+                {
+                    occluded = occluded | predicate(m_indices[i], lanes);
+                    lanes = AndNot(occluded, lanes);
+                }
+
+                if (!Any(AndNot(occluded, active))) return occluded;
+                continue;
+            }
+
+            stack[top++] = node.first + 1;
+            stack[top++] = node.first;
+        }
+
+        return occluded;
+    }
+
+private:
+    std::vector<BVHNode> m_nodes;
+    std::vector<uint32_t> m_indices;
+
+    // Primitive being sorted into the tree. The references are partitioned themselves, rather
+    // than indices into the primitive bounds, so that every level reads them sequentially.
+    struct Reference
+    {
+        AABB bounds;
+        uint32_t index;
+    };
+
+    struct Bin
+    {
+        AABB bounds;
+        AABB centroidBounds;
+        uint32_t count = 0;
+    };
+
+    // Builds the subtree of root, returned in the order a sequential build would store it: the
+    // root, its two children, then the descendants of the left child and of the right one.
+    // Large subtrees are built in parallel, their node indices shifted when they are spliced.
+    std::vector<BVHNode> buildSubtree(const BVHNode& root, std::vector<Reference>& references, const AABB& centroidBounds, int depth)
+    {
+        std::vector<BVHNode> nodes;
+        if (root.count < ParallelBuildSize)
+        {
+            nodes.reserve(2 * root.count);
+            nodes.push_back(root);
+            subdivide(nodes, 0, references, centroidBounds, depth);
+            return nodes;
+        }
+
+        Bin left, right;
+        uint32_t leftSize;
+        if (!split(root, references, centroidBounds, depth, left, right, leftSize)) return { root };
+
+        std::vector<BVHNode> leftNodes, rightNodes;
+        tbb::parallel_invoke(
+            [&] { leftNodes = buildSubtree(BVHNode{ left.bounds, root.first, leftSize }, references, left.centroidBounds, depth + 1); },
+            [&] { rightNodes = buildSubtree(BVHNode{ right.bounds, root.first + leftSize, root.count - leftSize }, references, right.centroidBounds, depth + 1); });
+
+        // Local index k > 0 of the left subtree moves to k + 2, of the right one to k + 1 + left size.
+        uint32_t leftShift = 2;
+        uint32_t rightShift = static_cast<uint32_t>(leftNodes.size()) + 1;
+        nodes.reserve(1 + leftNodes.size() + rightNodes.size());
+        nodes.push_back(BVHNode{ root.bounds, 1, 0 });
+        nodes.push_back(leftNodes[0]);
+        nodes.push_back(rightNodes[0]);
+        auto append = [&](const std::vector<BVHNode>& subtree, uint32_t shift, size_t position)
+        {
+            if (!nodes[position].isLeaf()) nodes[position].first += shift;
+            for (size_t k = 1; k < subtree.size(); k++)
+            {
+                nodes.push_back(subtree[k]);
+                if (!subtree[k].isLeaf()) nodes.back().first += shift;
+            }
+        };
+        append(leftNodes, leftShift, 1);
+        append(rightNodes, rightShift, 2);
+        return nodes;
+    }
+
+    // Splits the node nodeIndex of nodes if worth it, appending its children, then their subtrees.
+    void subdivide(std::vector<BVHNode>& nodes, uint32_t nodeIndex, std::vector<Reference>& references, const AABB& centroidBounds, int depth)
+    {
+        Bin left, right;
+        uint32_t leftSize;
+        if (!split(nodes[nodeIndex], references, centroidBounds, depth, left, right, leftSize)) return;
+
+        uint32_t first = nodes[nodeIndex].first;
+        uint32_t count = nodes[nodeIndex].count;
+        uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(BVHNode{ left.bounds, first, leftSize });
+        nodes.push_back(BVHNode{ right.bounds, first + leftSize, count - leftSize });
+        nodes[nodeIndex].first = leftChild;
+        nodes[nodeIndex].count = 0;
+
+        subdivide(nodes, leftChild, references, left.centroidBounds, depth + 1);
+        subdivide(nodes, leftChild + 1, references, right.centroidBounds, depth + 1);
+    }
+
+    // Chooses the split of node with the best SAH cost and partitions its references
+    // accordingly. Returns false if the node should stay a leaf, otherwise the bounds and the
+    // centroid bounds of the two sides, and the size of the left one.
+    bool split(const BVHNode& node, std::vector<Reference>& references, const AABB& centroidBounds, int depth, Bin& left, Bin& right, uint32_t& leftSize)
+    {
+        const AABB& bounds = node.bounds;
+        uint32_t first = node.first;
+        uint32_t count = node.count;
+
+        if (count <= 1 || depth >= MaxDepth - 1) return false;
+
+        int axis = centroidBounds.largestAxis();
+        Real axisMin = centroidBounds.getMin()[axis];
+        Real axisExtent = centroidBounds.getMax()[axis] - axisMin;
+        if (axisExtent <= 0.0) return false; // All centroids coincide, nothing left to split.
+
+        Bin bins[BinCount];
+        Real scale = BinCount / axisExtent;
+        auto binOf = [&](Real centroid)
+        {
+            int bin = static_cast<int>((centroid - axisMin) * scale);
+            return std::min(bin, BinCount - 1);
+        };
+
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            Point3 centroid = references[i].bounds.centroid();
+            Bin& bin = bins[binOf(centroid[axis])];
+            bin.bounds.grow(references[i].bounds);
+            bin.centroidBounds.grow(centroid);
+            bin.count++;
+        }
+
+        // Sweep the bins from both sides to evaluate the SAH cost of every split plane.
+        Real leftArea[BinCount - 1];
+        uint32_t leftCount[BinCount - 1];
+        AABB sweep;
+        uint32_t sweepCount = 0;
+        for (int i = 0; i < BinCount - 1; i++)
+        {
+            sweep.grow(bins[i].bounds);
+            sweepCount += bins[i].count;
+            leftArea[i] = sweep.surfaceArea();
+            leftCount[i] = sweepCount;
+        }
+
+        int bestSplit = -1;
+        Real bestCost = infinity;
+        sweep = AABB();
+        sweepCount = 0;
+        for (int i = BinCount - 1; i > 0; i--)
+        {
+            sweep.grow(bins[i].bounds);
+            sweepCount += bins[i].count;
+            if (leftCount[i - 1] == 0 || sweepCount == 0) continue;
+
+            Real cost = leftArea[i - 1] * leftCount[i - 1] + sweep.surfaceArea() * sweepCount;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        if (bestSplit < 0) return false;
+
+        // Compare against the cost of intersecting every primitive of a leaf (traversal cost of 1).
+        Real leafCost = static_cast<Real>(count);
+        Real splitCost = 1.0 + bestCost / bounds.surfaceArea();
+        if (splitCost >= leafCost && count <= MaxLeafSize) return false;
+
+        auto middle = std::partition(references.begin() + first, references.begin() + first + count,
+            [&](const Reference& reference)
+            {
+                return binOf((reference.bounds.getMin()[axis] + reference.bounds.getMax()[axis]) * 0.5) < bestSplit;
+            });
+        leftSize = static_cast<uint32_t>(middle - (references.begin() + first));
+
+        for (int i = 0; i < BinCount; i++)
+        {
+            Bin& side = i < bestSplit ? left : right;
+            side.bounds.grow(bins[i].bounds);
+            side.centroidBounds.grow(bins[i].centroidBounds);
+        }
+        return true;
+    }
+};
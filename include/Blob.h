@@ -1,58 +1,169 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 #include "Object.h"
 #include "Mesh.h"
+#include "Metaballs.h"
 #include "Utils.h"
 
 class Blob
 {
 public:
-    Blob(Point3 position, double e, double d, double threshold, std::shared_ptr<TextureMaterial> TextureMaterial)
+    // Sphere of radius 2 * threshold centered in the box from position to (e, e, e).
+    Blob(Point3 position, Real e, Real d, Real threshold, std::shared_ptr<TextureMaterial> TextureMaterial)
         : m_position(position), m_e(e), m_d(d), m_threshold(threshold), m_TextureMaterial(TextureMaterial)
-    {}
-
-    Mesh marchCubes()
     {
-        Mesh mesh;
+        for (int axis = 0; axis < 3; axis++)
+            m_counts[axis] = std::max(0, static_cast<int>(std::ceil((m_e - m_position[axis]) / m_d)));
+    }
 
-        for (double x = m_position.getX(); x < m_e; x += m_d)
+    // Surface where the density of the built field equals threshold, over a grid of cubes
+    // of edge d covering the field.
+    Blob(std::shared_ptr<const MetaballField> field, Real threshold, Real d, std::shared_ptr<TextureMaterial> TextureMaterial)
+        : m_e(0), m_d(d), m_threshold(threshold), m_TextureMaterial(TextureMaterial), m_field(field)
+    {
+        const AABB& bounds = m_field->boundingBox();
+        if (bounds.isEmpty())
         {
-            for (double y = m_position.getY(); y < m_e; y += m_d)
-            {
-                for (double z = m_position.getZ(); z < m_e; z += m_d)
-                {
-                    Point3 p(x, y, z);
-                    processMarchCube(p, mesh);
-
-                    std::cout << "Marching cube: " << x << ", " << y << ", " << z << std::endl;
-                }
-            }
+            m_counts[0] = m_counts[1] = m_counts[2] = 0;
+            return;
         }
 
-        return mesh;   
+        // One more cube on each side, so that the surface is closed even for a threshold of 0.
+        m_position = bounds.getMin() - Vector3(d, d, d);
+        for (int axis = 0; axis < 3; axis++)
+            m_counts[axis] = static_cast<int>(std::ceil(bounds.extent()[axis] / m_d)) + 2;
     }
 
-    void processMarchCube(Point3& p, Mesh& mesh)
+    // Number of y layers of cubes per slab. The slabs are polygonized in parallel, and as
+    // the split does not depend on the thread count neither does the mesh.
+    static const int SlabLayers = 8;
+    // Edge, in cubes, of the blocks that are skipped when the surface cannot cross them.
+    // Blocks that might be crossed are split down to bricks of BrickSize cubes.
+    static const int BlockSize = 8;
+    static const int BrickSize = 2;
+
+    // Polygonizes the surface where the potential crosses the threshold. The mesh is
+    // indexed: every grid edge crossed by the surface gives one vertex, shared by all the
+    // triangles of the cubes around it, with the normalized field gradient as its normal.
+    // Only the cubes of the bricks the surface may cross are visited, so the time is
+    // proportional to the area of the surface rather than to the volume of the grid.
+    Mesh marchCubes() const
     {
-        getCorners(p);
-        int index = getIndex();
-        getVertices(index);
-        addTriangles(mesh);
+        int slabCount = (m_counts[1] + SlabLayers - 1) / SlabLayers;
+        std::vector<Slab> slabs(slabCount);
+        tbb::parallel_for(tbb::blocked_range<int>(0, slabCount, 1), [&](const tbb::blocked_range<int>& range)
+        {
+            for (int s = range.begin(); s != range.end(); s++)
+                polygonizeSlab(s * SlabLayers, std::min(m_counts[1], (s + 1) * SlabLayers), slabs[s]);
+        });
 
-        m_corners.clear();
-        m_vertices.clear();
+        Mesh mesh;
+        mergeSlabs(slabs, mesh);
+        return mesh;
     }
 
 private:
     Point3 m_position;
-    double m_e;
-    double m_d;
-    double m_threshold;
+    Real m_e;
+    Real m_d;
+    Real m_threshold;
     std::shared_ptr<TextureMaterial> m_TextureMaterial;
+    std::shared_ptr<const MetaballField> m_field; // Null for the centered sphere.
+    int m_counts[3];                              // Cubes along each axis.
+
+    static constexpr uint32_t NoVertex = UINT32_MAX;
+
+    // Mesh vertex of each grid edge around the current layer of cubes. The x and z edges
+    // lie in the bottom (y = j) and top (y = j + 1) planes of the layer, the y edges go
+    // from one plane to the other. Potentials of the grid points of both planes are kept
+    // alongside, so that every grid point is evaluated once.
+    // Only the cubes of a few bricks are visited per layer, so the buffers are never
+    // cleared: a potential is valid if its stamp is the y of its plane, and a vertex if it
+    // was created since the plane came into use (see isValid).
+    struct LayerCache
+    {
+        int rowSize;
+        std::vector<uint32_t> planes[2]; // Per grid point of the plane: x edge, z edge.
+        std::vector<uint32_t> vertical;  // Per grid point of the bottom plane: y edge.
+        std::vector<Real> potentials[2];
+        std::vector<int> stamps[2];
+        uint32_t firstVertex[2] = { 0, 0 }; // First vertex created by the previous and the current layer.
+
+        LayerCache(int nx, int nz) : rowSize(nx + 1)
+        {
+            size_t points = static_cast<size_t>(nx + 1) * (nz + 1);
+            for (int plane = 0; plane < 2; plane++)
+            {
+                planes[plane].assign(2 * points, NoVertex);
+                potentials[plane].resize(points);
+                stamps[plane].assign(points, -1);
+            }
+            vertical.assign(points, NoVertex);
+        }
+
+        inline size_t point(int i, int k) const { return static_cast<size_t>(k) * rowSize + i; }
+
+        // Edge axis is 0 for x, 1 for y and 2 for z, plane is 0 (bottom) or 1 (top).
+        uint32_t& edge(int i, int k, int plane, int axis)
+        {
+            if (axis == 1) return vertical[point(i, k)];
+            return planes[plane][2 * point(i, k) + (axis == 2 ? 1 : 0)];
+        }
+
+        // The edges of the bottom plane were created by the previous layer or this one, all
+        // the others by this one.
+        inline bool isValid(uint32_t vertex, int plane, int axis) const
+        {
+            return vertex != NoVertex && vertex >= firstVertex[axis != 1 && plane == 0 ? 0 : 1];
+        }
+
+        // The top plane becomes the bottom plane of the next layer.
+        void nextLayer(uint32_t vertexCount)
+        {
+            planes[0].swap(planes[1]);
+            potentials[0].swap(potentials[1]);
+            stamps[0].swap(stamps[1]);
+            firstVertex[0] = firstVertex[1];
+            firstVertex[1] = vertexCount;
+        }
+    };
+
+    // Polygonization of the layers [j0, j1) of the grid, with vertex indices local to the
+    // slab. The vertices of the x and z edges of its first and last planes are listed too,
+    // to weld the slab to its neighbours.
+    struct Slab
+    {
+        std::vector<Point3> vertices;
+        std::vector<Vector3> normals;
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> bottom;
+        std::vector<uint32_t> top;
+    };
+
+    // Box of cubes, from cube (i, j, k) and of size cubes along each axis.
+    struct Brick
+    {
+        int i, j, k;
+        int size[3];
+    };
 
-    double m_pointsPotential[8];
-    std::vector<Point3> m_corners;
-    std::vector<Point3> m_vertices;
+    // Where an edge of the cube lies in the grid, relative to the cube's lowest corner.
+    struct EdgeLocation
+    {
+        int di;
+        int dk;
+        int plane;
+        int axis;
+    };
 
     struct Edge
     {
@@ -60,115 +171,249 @@ private:
         int vp2;
     };
 
-    void getCorners(Point3 p)
+    // Corner c of the cube is at grid point (i, j, k) + CornerOffsets[c].
+    static constexpr int CornerOffsets[8][3] = {
+        { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 },
+        { 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 0, 1, 1 }
+    };
+
+    static constexpr Edge Edges[12] = {
+        { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+        { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+        { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+    };
+
+    static constexpr EdgeLocation EdgeLocations[12] = {
+        { 0, 0, 0, 0 }, { 1, 0, 0, 2 }, { 0, 1, 0, 0 }, { 0, 0, 0, 2 },
+        { 0, 0, 1, 0 }, { 1, 0, 1, 2 }, { 0, 1, 1, 0 }, { 0, 0, 1, 2 },
+        { 0, 0, 0, 1 }, { 1, 0, 0, 1 }, { 1, 1, 0, 1 }, { 0, 1, 0, 1 }
+    };
+
+    Point3 gridPoint(int i, int j, int k) const
     {
-        m_corners.push_back(p + Point3(0, 0, 0));
-        m_corners.push_back(p + Point3(m_d, 0, 0));
-        m_corners.push_back(p + Point3(m_d, 0, m_d));
-        m_corners.push_back(p + Point3(0, 0, m_d));
-        m_corners.push_back(p + Point3(0, m_d, 0));
-        m_corners.push_back(p + Point3(m_d, m_d, 0));
-        m_corners.push_back(p + Point3(m_d, m_d, m_d));
-        m_corners.push_back(p + Point3(0, m_d, m_d));
+        return m_position + Vector3(i * m_d, j * m_d, k * m_d);
     }
 
-    double getPotential(Point3 p)
+    void polygonizeSlab(int j0, int j1, Slab& slab) const
     {
-        Point3 center = Point3(m_e / 2, m_e / 2, m_e / 2);
-        double r = (p - center).Length();
-        double d = r - m_threshold;
-        return d;
+        int nx = m_counts[0];
+        int nz = m_counts[2];
+
+        std::vector<Brick> bricks;
+        for (int k = 0; k < nz; k += BlockSize)
+        {
+            for (int i = 0; i < nx; i += BlockSize)
+                findBricks(Brick{ i, j0, k, { std::min(BlockSize, nx - i), j1 - j0, std::min(BlockSize, nz - k) } }, bricks);
+        }
+        if (bricks.empty()) return;
+
+        LayerCache cache(nx, nz);
+        for (int j = j0; j < j1; j++)
+        {
+            for (const auto& brick : bricks)
+            {
+                if (j < brick.j || j >= brick.j + brick.size[1]) continue;
+
+                for (int k = brick.k; k < brick.k + brick.size[2]; k++)
+                {
+                    for (int i = brick.i; i < brick.i + brick.size[0]; i++)
+                        processMarchCube(i, j, k, cache, slab);
+                }
+            }
+
+            if (j == j0) slab.bottom = cache.planes[0];
+            if (j == j1 - 1)
+            {
+                slab.top = cache.planes[1];
+                for (auto& vertex : slab.top)
+                {
+                    if (!cache.isValid(vertex, 1, 0)) vertex = NoVertex;
+                }
+            }
+            cache.nextLayer(static_cast<uint32_t>(slab.vertices.size()));
+        }
     }
 
-    int getIndex()
+    // Appends to bricks the bricks of block the surface may cross, by recursive halving.
+    void findBricks(const Brick& block, std::vector<Brick>& bricks) const
     {
-        int index = 0;
-        
-        m_pointsPotential[0] = getPotential(m_corners[0]);
-        m_pointsPotential[1] = getPotential(m_corners[1]);
-        m_pointsPotential[2] = getPotential(m_corners[2]);
-        m_pointsPotential[3] = getPotential(m_corners[3]);
-        m_pointsPotential[4] = getPotential(m_corners[4]);
-        m_pointsPotential[5] = getPotential(m_corners[5]);
-        m_pointsPotential[6] = getPotential(m_corners[6]);
-        m_pointsPotential[7] = getPotential(m_corners[7]);
-
-        if (m_pointsPotential[0] < m_threshold) index |= 1;
-        if (m_pointsPotential[1] < m_threshold) index |= 2;
-        if (m_pointsPotential[2] < m_threshold) index |= 4;
-        if (m_pointsPotential[3] < m_threshold) index |= 8;
-        if (m_pointsPotential[4] < m_threshold) index |= 16;
-        if (m_pointsPotential[5] < m_threshold) index |= 32;
-        if (m_pointsPotential[6] < m_threshold) index |= 64;
-        if (m_pointsPotential[7] < m_threshold) index |= 128;
-
-        return index;
+        AABB box(gridPoint(block.i, block.j, block.k), gridPoint(block.i + block.size[0], block.j + block.size[1], block.k + block.size[2]));
+        if (!mayCross(box)) return;
+
+        if (block.size[0] <= BrickSize && block.size[1] <= BrickSize && block.size[2] <= BrickSize)
+        {
+            bricks.push_back(block);
+            return;
+        }
+
+        int halves[3][2][2]; // Per axis and half: offset and size, a size of 0 for no half.
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int size = block.size[axis];
+            int first = size > BrickSize ? (size + 1) / 2 : size;
+            halves[axis][0][0] = 0;
+            halves[axis][0][1] = first;
+            halves[axis][1][0] = first;
+            halves[axis][1][1] = size - first;
+        }
+
+        for (int z = 0; z < 2; z++)
+        {
+            for (int y = 0; y < 2; y++)
+            {
+                for (int x = 0; x < 2; x++)
+                {
+                    if (halves[0][x][1] == 0 || halves[1][y][1] == 0 || halves[2][z][1] == 0) continue;
+
+                    findBricks(Brick{ block.i + halves[0][x][0], block.j + halves[1][y][0], block.k + halves[2][z][0],
+                        { halves[0][x][1], halves[1][y][1], halves[2][z][1] } }, bricks);
+                }
+            }
+        }
     }
 
-    void getVertices(int index)
+    inline Real cornerPotential(int i, int j, int k, int plane, LayerCache& cache) const
     {
-        for (int i = 0; i < lookUpTableCols; i++)
+        size_t point = cache.point(i, k);
+        if (cache.stamps[plane][point] != j + plane)
         {
-            int edgeIndex = lookUpTable[index][i];
+            cache.potentials[plane][point] = getPotential(gridPoint(i, j + plane, k));
+            cache.stamps[plane][point] = j + plane;
+        }
+        return cache.potentials[plane][point];
+    }
 
+    void processMarchCube(int i, int j, int k, LayerCache& cache, Slab& slab) const
+    {
+        Real potentials[8];
+        int index = 0;
+        for (int c = 0; c < 8; c++)
+        {
+            potentials[c] = cornerPotential(i + CornerOffsets[c][0], j, k + CornerOffsets[c][2], CornerOffsets[c][1], cache);
+            if (potentials[c] < m_threshold) index |= 1 << c;
+        }
+
+        for (int n = 0; n < lookUpTableCols; n++)
+        {
+            int edgeIndex = lookUpTable[index][n];
             if (edgeIndex == -1) break;
 
-            Edge edge = getVerticeIndex(edgeIndex);
-            if (edge.vp1 == -1 || edge.vp2 == -1)
+            const EdgeLocation& location = EdgeLocations[edgeIndex];
+            uint32_t& vertex = cache.edge(i + location.di, k + location.dk, location.plane, location.axis);
+            if (!cache.isValid(vertex, location.plane, location.axis))
             {
-                std::cout << "Error: Invalid edge index" << std::endl;
-                return;
-            }
+                const Edge& edge = Edges[edgeIndex];
+                const int* o1 = CornerOffsets[edge.vp1];
+                const int* o2 = CornerOffsets[edge.vp2];
+                Point3 p = interpolate(gridPoint(i + o1[0], j + o1[1], k + o1[2]), gridPoint(i + o2[0], j + o2[1], k + o2[2]),
+                    potentials[edge.vp1], potentials[edge.vp2]);
 
-            Point3 middleEdge = (m_corners[edge.vp1] + m_corners[edge.vp2]) / 2;
+                vertex = static_cast<uint32_t>(slab.vertices.size());
+                slab.vertices.push_back(p);
+                slab.normals.push_back(getNormal(p));
+            }
 
-            m_vertices.push_back(middleEdge);
+            slab.indices.push_back(vertex);
         }
     }
-    
-    Edge getVerticeIndex(int edgeIndex)
-    {
-        switch (edgeIndex)
-        {
-        case 0:
-            return Edge{ 0, 1 };
-        case 1:
-            return Edge{ 1, 2 };
-        case 2:
-            return Edge{ 2, 3 };
-        case 3:
-            return Edge{ 3, 0 };
-        case 4:
-            return Edge{ 4, 5 };
-        case 5:
-            return Edge{ 5, 6 };
-        case 6:
-            return Edge{ 6, 7 };
-        case 7:
-            return Edge{ 7, 4 };
-        case 8:
-            return Edge{ 0, 4 };
-        case 9:
-            return Edge{ 1, 5 };
-        case 10:
-            return Edge{ 2, 6 };
-        case 11:
-            return Edge{ 3, 7 };
-        default:
-            return Edge{ -1, -1 };
+
+    // Appends the slabs to mesh in order. The vertices on the plane between two slabs were
+    // computed by both, identically, and only the copy of the lower slab is kept.
+    void mergeSlabs(const std::vector<Slab>& slabs, Mesh& mesh) const
+    {
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        for (const auto& slab : slabs)
+        {
+            vertexCount += slab.vertices.size();
+            indexCount += slab.indices.size();
+        }
+        mesh.reserve(vertexCount, indexCount / 3);
+
+        uint32_t material = mesh.addMaterial(m_TextureMaterial);
+        std::vector<uint32_t> remap;
+        std::vector<uint32_t> previousTop; // Mesh vertices of the top plane of the previous slab.
+        for (const auto& slab : slabs)
+        {
+            remap.assign(slab.vertices.size(), NoVertex);
+            for (size_t e = 0; e < std::min(previousTop.size(), slab.bottom.size()); e++)
+            {
+                if (slab.bottom[e] != NoVertex) remap[slab.bottom[e]] = previousTop[e];
+            }
+
+            for (size_t v = 0; v < slab.vertices.size(); v++)
+            {
+                if (remap[v] == NoVertex) remap[v] = mesh.addVertex(slab.vertices[v], slab.normals[v]);
+            }
+
+            for (size_t n = 0; n < slab.indices.size(); n += 3)
+                mesh.addFace(remap[slab.indices[n]], remap[slab.indices[n + 1]], remap[slab.indices[n + 2]], material);
+
+            previousTop.assign(slab.top.size(), NoVertex);
+            for (size_t e = 0; e < slab.top.size(); e++)
+            {
+                if (slab.top[e] != NoVertex) previousTop[e] = remap[slab.top[e]];
+            }
         }
     }
 
-    void addTriangles(Mesh& mesh)
+    // Point of the edge from p1 to p2 where the potential, linear along the edge, reaches
+    // the threshold.
+    Point3 interpolate(const Point3& p1, const Point3& p2, Real potential1, Real potential2) const
     {
-        for (int i = 0; i < m_vertices.size(); i += 3)
-        {
-            Point3 p1 = m_vertices[i];
-            Point3 p2 = m_vertices[i + 1];
-            Point3 p3 = m_vertices[i + 2];
+        Real difference = potential2 - potential1;
+        if (std::abs(difference) < Epsilon<Real>::NearZero) return (p1 + p2) / 2;
+
+        Real t = Clamp((m_threshold - potential1) / difference, 0.0, 1.0);
+        return p1 + t * (p2 - p1);
+    }
 
-            Triangle triangle(p1, p2, p3, m_TextureMaterial);
-            mesh.addTriangle(triangle);
+    // The blob is where the potential is below the threshold. For metaballs the potential
+    // is 2 * threshold - density, which crosses the threshold where the density does.
+    Real getPotential(Point3 p) const
+    {
+        if (m_field) return 2 * m_threshold - m_field->density(p);
+
+        Point3 center = Point3(m_e / 2, m_e / 2, m_e / 2);
+        Real r = (p - center).Length();
+        Real d = r - m_threshold;
+        return d;
+    }
+
+    // Whether the potential may cross the threshold within box, from bounds of the
+    // potential over the box. The bounds are widened a little against rounding errors.
+    bool mayCross(const AABB& box) const
+    {
+        Real min, max;
+        if (m_field)
+        {
+            Real densityMin, densityMax;
+            m_field->densityRange(box, densityMin, densityMax);
+            min = 2 * m_threshold - densityMax;
+            max = 2 * m_threshold - densityMin;
         }
+        else
+        {
+            Point3 center = Point3(m_e / 2, m_e / 2, m_e / 2);
+            min = std::sqrt(box.distanceSquared(center)) - m_threshold;
+            max = std::sqrt(box.farthestDistanceSquared(center)) - m_threshold;
+        }
+
+        Real tolerance = Real(1e-4) * (std::abs(m_threshold) + 1);
+        return min < m_threshold + tolerance && max >= m_threshold - tolerance;
+    }
+
+    // Direction in which the potential grows, i.e. out of the blob.
+    Vector3 getNormal(const Point3& p) const
+    {
+        if (m_field) return Normalize(-m_field->gradient(p));
+
+        // Central differences.
+        Real h = m_d / 2;
+        Vector3 gradient(
+            getPotential(p + Vector3(h, 0, 0)) - getPotential(p - Vector3(h, 0, 0)),
+            getPotential(p + Vector3(0, h, 0)) - getPotential(p - Vector3(0, h, 0)),
+            getPotential(p + Vector3(0, 0, h)) - getPotential(p - Vector3(0, 0, h)));
+        return Normalize(gradient);
     }
-};
\ No newline at end of file
+};
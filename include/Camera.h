@@ -8,12 +8,12 @@ class Camera
 public:
     Camera() = default;
 
-    Camera(Point3 lookFrom, Point3 lookAt, Vector3 up, double vfov, double aspectRatio)
+    Camera(Point3 lookFrom, Point3 lookAt, Vector3 up, Real vfov, Real aspectRatio)
     {
         auto theta = vfov * M_PI / 180.0;
         auto h = tan(theta / 2);
         auto viewportHeight = 2.0 * h;
-        auto viewportWidth = viewportHeight;
+        auto viewportWidth = aspectRatio * viewportHeight;
 
         auto w = Normalize(lookFrom - lookAt);
         auto u = Normalize(Cross(up, w));
@@ -25,7 +25,7 @@ public:
         m_BottomLeftCorner = m_origin - m_horizontal / 2 - m_vertical / 2 - w;
     }
 
-    Ray getRay(double s, double t) const
+    Ray getRay(Real s, Real t) const
     {
         return Ray(m_origin, m_BottomLeftCorner + s * m_horizontal + t * m_vertical - m_origin);
     }
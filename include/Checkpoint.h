@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "Image.h"
+#include "Renderer.h"
+
+// Accumulation state of a render, saved between progressive passes so that the render can
+// be resumed after a crash or a preemption, or continued later to more samples. The file
+// holds a header, then the raw accumulation buffers of the image (see
+// Image::writeAccumulation), in the byte order of the machine that wrote it. The header
+// identifies the scene and the settings that decide which samples are taken, so that a
+// resumed render only adds samples of the same render.
+struct CheckpointHeader
+{
+    static const uint32_t Magic = 0x4B435452; // "RTCK" on little-endian machines.
+    static const uint32_t Version = 3;
+
+    uint32_t magic = Magic;
+    uint32_t version = Version;
+    int32_t width = 0;
+    int32_t height = 0;
+    uint64_t seed = 0;
+    int32_t max_depth = 0;
+    uint32_t samples = 0; // Fewest samples accumulated by a pixel.
+    int32_t mode = 0;     // RenderMode.
+    uint64_t scene_hash = 0;
+    double noise_threshold = 0;
+};
+
+// Writes the checkpoint next to path then renames it, so that an interrupted write never
+// replaces the previous checkpoint with a truncated one. sceneHash identifies the scene,
+// e.g. SceneSettings::content_hash.
+inline bool saveCheckpoint(const Image& image, const RenderSettings& settings, uint64_t sceneHash, const std::string& path)
+{
+    CheckpointHeader header;
+    header.width = image.getWidth();
+    header.height = image.getHeight();
+    header.seed = settings.seed;
+    header.max_depth = settings.max_depth;
+    header.samples = image.getMinSampleCount();
+    header.mode = static_cast<int32_t>(settings.mode);
+    header.scene_hash = sceneHash;
+    header.noise_threshold = settings.noise_threshold;
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Error: Could not open file " << temporary << std::endl;
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        image.writeAccumulation(file);
+        file.close();
+        if (file.fail())
+        {
+            std::cerr << "Error: Could not write the checkpoint " << temporary << std::endl;
+            return false;
+        }
+    }
+
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Error: Could not rename " << temporary << " to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Loads a checkpoint into image, which must have its size. The scene must be the one of
+// sceneHash, and the seed, the depth, the mode and the noise threshold those of settings,
+// otherwise the new samples would not continue the saved ones.
+inline bool loadCheckpoint(Image& image, const RenderSettings& settings, uint64_t sceneHash, const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return false;
+    }
+
+    CheckpointHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != CheckpointHeader::Magic || header.version != CheckpointHeader::Version)
+    {
+        std::cerr << "Error: " << path << " is not a checkpoint of this version" << std::endl;
+        return false;
+    }
+
+    if (header.width != image.getWidth() || header.height != image.getHeight() || header.seed != settings.seed || header.max_depth != settings.max_depth)
+    {
+        std::cerr << "Error: " << path << " is a checkpoint of a " << header.width << "x" << header.height << " render with seed "
+                  << header.seed << " and depth " << header.max_depth << ", which does not match this one" << std::endl;
+        return false;
+    }
+
+    if (header.scene_hash != sceneHash)
+    {
+        std::cerr << "Error: " << path << " is a checkpoint of another scene" << std::endl;
+        return false;
+    }
+
+    if (header.mode != static_cast<int32_t>(settings.mode) || header.noise_threshold != static_cast<double>(settings.noise_threshold))
+    {
+        std::cerr << "Error: " << path << " is a checkpoint of a " << (header.mode == static_cast<int32_t>(RenderMode::Wavefront) ? "wavefront" : "depth-first")
+                  << " render with noise threshold " << header.noise_threshold << ", which does not match this one" << std::endl;
+        return false;
+    }
+
+    if (!image.readAccumulation(file))
+    {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
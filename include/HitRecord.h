@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Vector.h"
+#include "Ray.h"
+
+class Object;
+class TextureMaterial;
+
+// Intersection queries only record t (and u, v) and the primitive hit in object; p,
+// normal and the material are filled by object->completeHit once the closest hit is known.
+// The material is not owned: the objects keep their material alive for the whole render.
+struct hit_record
+{
+    Point3 p;
+    Vector3 normal;
+    Real t;
+    Real u; // Barycentric coordinates of the hit on triangles,
+    Real v; // the hit point being (1 - u - v) * P0 + u * P1 + v * P2.
+    bool front_face;
+
+    inline void set_face_normal(const Ray& ray, const Vector3& outward_normal)
+    {
+        front_face = Dot(ray.direction(), outward_normal) < 0;
+        normal = front_face ? outward_normal : -outward_normal;
+    }
+
+    // Ray leaving the hit point, with its origin moved off the surface on the side of
+    // direction so that it does not hit the surface again through rounding errors.
+    inline Ray spawn_ray(const Vector3& direction) const
+    {
+        return Ray(OffsetRayOrigin(p, Dot(direction, normal) < 0 ? -normal : normal), direction);
+    }
+
+    const Object* object = nullptr;
+    uint32_t primitive = 0; // Index of the primitive hit within object, for objects made of many.
+    const TextureMaterial* textureMaterial = nullptr;
+};
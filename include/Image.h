@@ -1,94 +1,229 @@
 #pragma once
 
-#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <ostream>
 #include <vector>
-#include <fstream>
 
+#include "Simd.h"
+#include "Vector.h"
+
+// 8-bit tone-mapped color, as packed in the output buffer of Image.
 class Pixel
 {
 public:
-    Pixel() : r(0), g(0), b(0) {}
-    Pixel(int red, int green, int blue) : r(red), g(green), b(blue) {}
+    Pixel() : r(0), g(0), b(0), a(255) {}
+    Pixel(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha = 255) : r(red), g(green), b(blue), a(alpha) {}
 
-    int r;
-    int g;
-    int b;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
 };
 
+// Relative luminance of a linear color, Rec. 709 weights.
+inline Real Luminance(const Color3& color)
+{
+    return Real(0.2126) * color.getX() + Real(0.7152) * color.getY() + Real(0.0722) * color.getZ();
+}
+
+// Framebuffer. The samples of every pixel are summed in a float RGB accumulation buffer,
+// one plane per channel, along with their count, so more samples can be added to a render
+// at any time. resolve() tone maps the accumulated means into the output buffer of packed
+// 8-bit RGBA pixels. The sum of the squared luminances of the samples gives the variance
+// of every pixel, see getError.
 class Image
 {
 public:
-    Image(int w, int h, int samples_per_pixel) 
-        : m_width(w), m_height(h), m_samples_per_pixel(samples_per_pixel), pixels(w * h)
-    {
-        initIterators();
-    }
+    Image(int w, int h)
+        : m_width(w), m_height(h)
+        , m_red(static_cast<size_t>(w) * h), m_green(static_cast<size_t>(w) * h), m_blue(static_cast<size_t>(w) * h)
+        , m_luminanceSquares(static_cast<size_t>(w) * h), m_sampleCounts(static_cast<size_t>(w) * h)
+        , m_output(static_cast<size_t>(w) * h, 0xFF000000u)
+    {}
 
     inline int getWidth() const { return m_width; }
 
     inline int getHeight() const { return m_height; }
 
-    Pixel getPixel(int x, int y) const { return pixels[y * m_width + x]; }
+    // Adds count samples of pixel (x, y), of radiance summing to sum and of squared
+    // luminance summing to luminanceSquares.
+    void addSamples(int x, int y, const Color3& sum, Real luminanceSquares, uint32_t count)
+    {
+        size_t index = static_cast<size_t>(y) * m_width + x;
+        m_red[index] += static_cast<float>(sum.getX());
+        m_green[index] += static_cast<float>(sum.getY());
+        m_blue[index] += static_cast<float>(sum.getZ());
+        m_luminanceSquares[index] += static_cast<float>(luminanceSquares);
+        m_sampleCounts[index] += count;
+    }
+
+    inline uint32_t getSampleCount(int x, int y) const { return m_sampleCounts[static_cast<size_t>(y) * m_width + x]; }
 
-    void setPixel(int x, int y, const Pixel& pixel)
+    inline uint32_t getMinSampleCount() const
     {
-        pixels[y * m_width + x] = pixel;
+        return m_sampleCounts.empty() ? 0 : *std::min_element(m_sampleCounts.begin(), m_sampleCounts.end());
     }
 
-    void toPPM(const std::string& path) const
+    inline uint32_t getMaxSampleCount() const
     {
-        std::ofstream file;
-        file.open(path);
-        if (!file.is_open())
-        {
-            std::cerr << "Error: Could not open file " << path << std::endl;
-            exit(EXIT_FAILURE);
-        }
+        return m_sampleCounts.empty() ? 0 : *std::max_element(m_sampleCounts.begin(), m_sampleCounts.end());
+    }
 
-        file << "P3" << std::endl;
-        file << m_width << " " << m_height << std::endl;
-        file << "255" << std::endl;
+    uint64_t getTotalSampleCount() const
+    {
+        uint64_t total = 0;
+        for (uint32_t count : m_sampleCounts) total += count;
+        return total;
+    }
 
-        for (int y = m_height - 1; y >= 0; y--)
+    // Estimated standard error of the pixel after tone mapping, in output units (1 is the
+    // full range): the standard error of the mean luminance, scaled by the slope of the
+    // gamma curve at the mean. Infinite with less than two samples.
+    Real getError(int x, int y) const
+    {
+        size_t index = static_cast<size_t>(y) * m_width + x;
+        uint32_t count = m_sampleCounts[index];
+        if (count < 2) return infinity;
+
+        Real mean = Luminance(Color3(m_red[index], m_green[index], m_blue[index])) / count;
+        Real variance = std::max(Real(0), (m_luminanceSquares[index] / count - mean * mean) * count / (count - 1));
+        return std::sqrt(variance / count) / (2 * std::sqrt(std::max(mean, Real(1e-4))));
+    }
+
+    // Linear radiance of the pixel, the mean of its samples, before tone mapping and clamping.
+    Color3 getRadiance(int x, int y) const
+    {
+        size_t index = static_cast<size_t>(y) * m_width + x;
+        float scale = 1.0f / std::max(m_sampleCounts[index], 1u);
+        return Color3(m_red[index] * scale, m_green[index] * scale, m_blue[index] * scale);
+    }
+
+    // Tone mapped pixel, as of the last resolve.
+    Pixel getPixel(int x, int y) const
+    {
+        uint32_t packed = m_output[static_cast<size_t>(y) * m_width + x];
+        return Pixel(packed & 0xFF, (packed >> 8) & 0xFF, (packed >> 16) & 0xFF, packed >> 24);
+    }
+
+    // Drops all the samples.
+    void clear()
+    {
+        std::fill(m_red.begin(), m_red.end(), 0.0f);
+        std::fill(m_green.begin(), m_green.end(), 0.0f);
+        std::fill(m_blue.begin(), m_blue.end(), 0.0f);
+        std::fill(m_luminanceSquares.begin(), m_luminanceSquares.end(), 0.0f);
+        std::fill(m_sampleCounts.begin(), m_sampleCounts.end(), 0u);
+    }
+
+    // Tone maps the pixels of [x0, x1) x [y0, y1) into the output buffer: the mean of the
+    // samples, gamma corrected (gamma 2) and clamped. Rows are processed SIMD-wide, the
+    // pixels past the last full vector one lane at a time.
+    void resolve(int x0, int y0, int x1, int y1)
+    {
+        const int Width = SimdFloat::Width;
+        const SimdFloat one(1.0f), zero(0.0f), top(0.999f), scale(256.0f);
+        int32_t red[Width], green[Width], blue[Width];
+
+        for (int y = y0; y < y1; y++)
         {
-            for (int x = 0; x < m_width; x++)
+            size_t row = static_cast<size_t>(y) * m_width;
+            for (int x = x0; x < x1; x += Width)
             {
-                Pixel pixel = getPixel(x, y);
-                file << pixel.r << " " << pixel.g << " " << pixel.b << std::endl;
+                size_t index = row + x;
+                int count = std::min(Width, x1 - x);
+                if (count == Width)
+                {
+                    SimdFloat inverse = one / Max(SimdFloat::loadInts(reinterpret_cast<const int32_t*>(&m_sampleCounts[index])), one);
+                    (Min(Max(Sqrt(SimdFloat::load(&m_red[index]) * inverse), zero), top) * scale).storeInts(red);
+                    (Min(Max(Sqrt(SimdFloat::load(&m_green[index]) * inverse), zero), top) * scale).storeInts(green);
+                    (Min(Max(Sqrt(SimdFloat::load(&m_blue[index]) * inverse), zero), top) * scale).storeInts(blue);
+                }
+                else
+                {
+                    for (int k = 0; k < count; k++)
+                    {
+                        float inverse = 1.0f / std::max(m_sampleCounts[index + k], 1u);
+                        red[k] = toByte(m_red[index + k] * inverse);
+                        green[k] = toByte(m_green[index + k] * inverse);
+                        blue[k] = toByte(m_blue[index + k] * inverse);
+                    }
+                }
+
+                for (int k = 0; k < count; k++)
+                    m_output[index + k] = static_cast<uint32_t>(red[k]) | (static_cast<uint32_t>(green[k]) << 8) | (static_cast<uint32_t>(blue[k]) << 16) | 0xFF000000u;
             }
         }
-
-        file.close();
     }
 
-    inline const std::vector<u_int32_t>& getHorizontalIter() const { return m_HorizontalIter; }
-    inline const std::vector<u_int32_t>& getVerticalIter() const { return m_VerticalIter; }
-    inline const std::vector<u_int32_t>& getSampleIter() const { return m_SampleIter; }
+    void resolve() { resolve(0, 0, m_width, m_height); }
 
-private:
-    int m_width;
-    int m_height;
-    int m_samples_per_pixel;
-    std::vector<Pixel> pixels;
-
-    std::vector<u_int32_t> m_HorizontalIter;
-    std::vector<u_int32_t> m_VerticalIter;
-    std::vector<u_int32_t> m_SampleIter;
+    // The accumulation buffers as raw bytes, for checkpoints: the red, green, blue and
+    // squared luminance sums then the sample counts, width * height values each.
+    void writeAccumulation(std::ostream& out) const
+    {
+        for (const auto* plane : { &m_red, &m_green, &m_blue, &m_luminanceSquares })
+            out.write(reinterpret_cast<const char*>(plane->data()), plane->size() * sizeof(float));
+        out.write(reinterpret_cast<const char*>(m_sampleCounts.data()), m_sampleCounts.size() * sizeof(uint32_t));
+    }
 
-    void initIterators()
+    // Reads back what writeAccumulation wrote, for an image of the same size, and resolves.
+    bool readAccumulation(std::istream& in)
     {
-        m_HorizontalIter.resize(m_width);
-        for (int i = 0; i < m_width; i++)
+        for (auto* plane : { &m_red, &m_green, &m_blue, &m_luminanceSquares })
+            in.read(reinterpret_cast<char*>(plane->data()), plane->size() * sizeof(float));
+        in.read(reinterpret_cast<char*>(m_sampleCounts.data()), m_sampleCounts.size() * sizeof(uint32_t));
+        if (!in)
         {
-            m_HorizontalIter.at(i) = i;
+            clear();
+            return false;
         }
 
-        m_VerticalIter.resize(m_height);
-        for (int i = m_height - 1; i >= 0; i--)
+        resolve();
+        return true;
+    }
+
+    // Debug image of the samples spent on every pixel, from black for none to white for the
+    // most of any pixel.
+    Image sampleCountImage() const
+    {
+        Image image(m_width, m_height);
+        float scale = 1.0f / std::max(getMaxSampleCount(), 1u);
+        for (size_t index = 0; index < m_sampleCounts.size(); index++)
         {
-            m_VerticalIter.at(m_height - 1 - i) = i;
+            // Squared, as resolve takes the square root.
+            float level = m_sampleCounts[index] * scale;
+            image.m_red[index] = image.m_green[index] = image.m_blue[index] = level * level;
+            image.m_sampleCounts[index] = 1;
         }
+        image.resolve();
+        return image;
+    }
 
-        m_SampleIter.resize(m_samples_per_pixel);
+    // Bytes taken by the accumulation and output buffers.
+    inline size_t getMemorySize() const
+    {
+        return m_red.size() * 4 * sizeof(float) + m_sampleCounts.size() * sizeof(uint32_t) + m_output.size() * sizeof(uint32_t);
+    }
+
+private:
+    int m_width;
+    int m_height;
+    std::vector<float> m_red;
+    std::vector<float> m_green;
+    std::vector<float> m_blue;
+    std::vector<float> m_luminanceSquares;
+    std::vector<uint32_t> m_sampleCounts;
+    std::vector<uint32_t> m_output; // Red in the low byte, alpha in the high byte.
+
+    // Same as the SIMD path of resolve, where Max(NaN, 0) is 0.
+    static inline int32_t toByte(float value)
+    {
+        float root = std::sqrt(value);
+        root = root > 0.0f ? root : 0.0f;
+        root = root < 0.999f ? root : 0.999f;
+        return static_cast<int32_t>(root * 256.0f);
     }
 };
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "TileScheduler.h"
+
+enum class ImageFormat
+{
+    PPM, // Binary P6, 8 bits per channel.
+    PNG, // 8-bit RGB, deflate stored blocks (no compression).
+    PFM  // Linear 32-bit float RGB, the unclamped radiance for compositing.
+};
+
+// Format from the extension of path: .ppm, .png or .pfm.
+inline bool parseImageFormat(const std::string& path, ImageFormat& format)
+{
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos) return false;
+
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == "ppm") format = ImageFormat::PPM;
+    else if (extension == "png") format = ImageFormat::PNG;
+    else if (extension == "pfm") format = ImageFormat::PFM;
+    else return false;
+    return true;
+}
+
+// CRC-32 of PNG chunks, continuing from crc.
+inline uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    static const std::array<uint32_t, 256> table = []()
+    {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Adler-32 checksum ending a zlib stream, continuing from adler.
+inline uint32_t adler32(const uint8_t* data, size_t size, uint32_t adler = 1)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0)
+    {
+        // 5552 bytes is the most that can be summed before b overflows 32 bits.
+        size_t count = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < count; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += count;
+        size -= count;
+    }
+    return (b << 16) | a;
+}
+
+// Writes an image to a file, rows at a time in file order: top to bottom for PPM and PNG,
+// bottom to top for PFM. Every call encodes its rows into one contiguous buffer written at
+// once, the header going with the first rows, so writing the whole image with finish() is
+// a single write.
+class ImageWriter
+{
+public:
+    ImageWriter(const Image& image, const std::string& path, ImageFormat format)
+        : m_image(image), m_format(format), m_file(path, std::ios::binary)
+    {
+        if (!m_file.is_open())
+        {
+            std::cerr << "Error: Could not open file " << path << std::endl;
+            return;
+        }
+        appendHeader();
+        m_headerSize = m_buffer.size();
+    }
+
+    inline bool isOpen() const { return m_file.is_open(); }
+    inline ImageFormat getFormat() const { return m_format; }
+
+    // Next row to write, in file order, and the image row of a file row.
+    inline int getNextRow() const { return m_nextRow; }
+    inline int imageRow(int fileRow) const { return m_format == ImageFormat::PFM ? fileRow : m_image.getHeight() - 1 - fileRow; }
+
+    // PPM and PFM rows have a fixed size, so they can also be written in any order, at
+    // their place in the file, with writeRowsAt.
+    inline bool hasFixedRows() const { return m_format != ImageFormat::PNG; }
+
+    // Encodes and writes the next count rows.
+    bool writeRows(int count)
+    {
+        if (!isOpen()) return false;
+        count = std::min(count, m_image.getHeight() - m_nextRow);
+        if (m_format == ImageFormat::PNG)
+            encodePNGRows(m_nextRow, count);
+        else
+            encodeFixedRows(m_nextRow, count);
+        m_nextRow += std::max(count, 0);
+        return flush();
+    }
+
+    // Encodes and writes count rows from fileRow, with fixed rows only.
+    bool writeRowsAt(int fileRow, int count)
+    {
+        if (!isOpen() || !hasFixedRows()) return false;
+        if (!flush()) return false; // The header, the first time.
+
+        m_file.seekp(static_cast<std::streamoff>(m_headerSize + fileRow * fixedRowSize()));
+        encodeFixedRows(fileRow, count);
+        return flush();
+    }
+
+    // Writes the rows left and ends the file.
+    bool finish()
+    {
+        if (!writeRows(m_image.getHeight() - m_nextRow)) return false;
+        if (m_format == ImageFormat::PNG)
+        {
+            appendStoredBlocks(nullptr, 0, true);
+            appendChunk("IEND", nullptr, 0);
+        }
+        return close();
+    }
+
+    // Ends the file, as it is, after writeRowsAt.
+    bool close()
+    {
+        if (!isOpen() || !flush()) return false;
+        m_file.close();
+        return !m_file.fail();
+    }
+
+private:
+    const Image& m_image;
+    ImageFormat m_format;
+    std::ofstream m_file;
+    int m_nextRow = 0;
+    std::vector<uint8_t> m_buffer; // Bytes of the next write.
+    std::vector<uint8_t> m_rows;   // Raw PNG rows, before deflate.
+    bool m_zlibStarted = false;
+    uint32_t m_adler = 1;
+    size_t m_chunkStart = 0;       // Start in m_buffer of the last chunk.
+    size_t m_headerSize = 0;
+
+    static inline void storeBigEndian(uint8_t* bytes, uint32_t value)
+    {
+        bytes[0] = static_cast<uint8_t>(value >> 24);
+        bytes[1] = static_cast<uint8_t>(value >> 16);
+        bytes[2] = static_cast<uint8_t>(value >> 8);
+        bytes[3] = static_cast<uint8_t>(value);
+    }
+
+    void encodeRow8(int y, uint8_t* bytes) const
+    {
+        for (int x = 0; x < m_image.getWidth(); x++)
+        {
+            Pixel pixel = m_image.getPixel(x, y);
+            bytes[3 * x] = static_cast<uint8_t>(pixel.r);
+            bytes[3 * x + 1] = static_cast<uint8_t>(pixel.g);
+            bytes[3 * x + 2] = static_cast<uint8_t>(pixel.b);
+        }
+    }
+
+    void encodeRowFloat(int y, uint8_t* bytes) const
+    {
+        for (int x = 0; x < m_image.getWidth(); x++)
+        {
+            Color3 radiance = m_image.getRadiance(x, y);
+            float rgb[3] = { static_cast<float>(radiance.getX()), static_cast<float>(radiance.getY()), static_cast<float>(radiance.getZ()) };
+            std::memcpy(bytes + x * sizeof(rgb), rgb, sizeof(rgb));
+        }
+    }
+
+    inline size_t fixedRowSize() const
+    {
+        return static_cast<size_t>(m_image.getWidth()) * (m_format == ImageFormat::PFM ? 3 * sizeof(float) : 3);
+    }
+
+    // Appends count rows from fileRow to the buffer, as PPM or PFM rows.
+    void encodeFixedRows(int fileRow, int count)
+    {
+        size_t rowSize = fixedRowSize();
+        size_t start = m_buffer.size();
+        m_buffer.resize(start + rowSize * std::max(count, 0));
+        for (int r = 0; r < count; r++)
+        {
+            uint8_t* row = &m_buffer[start + r * rowSize];
+            if (m_format == ImageFormat::PFM)
+                encodeRowFloat(imageRow(fileRow + r), row);
+            else
+                encodeRow8(imageRow(fileRow + r), row);
+        }
+    }
+
+    // Appends count rows from fileRow to the buffer, as an IDAT chunk.
+    void encodePNGRows(int fileRow, int count)
+    {
+        if (count <= 0) return;
+
+        // Every row starts with its filter type, 0 for none.
+        size_t rowSize = static_cast<size_t>(m_image.getWidth()) * 3 + 1;
+        m_rows.resize(rowSize * count);
+        for (int r = 0; r < count; r++)
+        {
+            m_rows[r * rowSize] = 0;
+            encodeRow8(imageRow(fileRow + r), &m_rows[r * rowSize + 1]);
+        }
+        m_adler = adler32(m_rows.data(), m_rows.size(), m_adler);
+        appendStoredBlocks(m_rows.data(), m_rows.size(), false);
+    }
+
+    void append(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+    }
+
+    void append(const std::string& text) { append(text.data(), text.size()); }
+
+    // PNG chunk: length, type, data and the CRC of type and data. Without close, the chunk
+    // is left open for more data, see closeChunk.
+    void appendChunk(const char* type, const uint8_t* data, size_t size, bool close = true)
+    {
+        m_chunkStart = m_buffer.size();
+        uint8_t length[4];
+        storeBigEndian(length, static_cast<uint32_t>(size));
+        append(length, 4);
+        append(type, 4);
+        if (size > 0) append(data, size);
+        if (close) closeChunk();
+    }
+
+    // Sets the length of the last chunk and appends its CRC.
+    void closeChunk()
+    {
+        size_t size = m_buffer.size() - m_chunkStart - 8;
+        storeBigEndian(&m_buffer[m_chunkStart], static_cast<uint32_t>(size));
+        uint8_t crc[4];
+        storeBigEndian(crc, crc32(&m_buffer[m_chunkStart + 4], size + 4));
+        append(crc, 4);
+    }
+
+    // One IDAT chunk holding the data as deflate blocks of type 0, which store it as is.
+    // The zlib stream spans all the IDAT chunks: its header opens the first one, and the
+    // final one ends with the checksum.
+    void appendStoredBlocks(const uint8_t* data, size_t size, bool final)
+    {
+        appendChunk("IDAT", nullptr, 0, false);
+        if (!m_zlibStarted)
+        {
+            const uint8_t header[2] = { 0x78, 0x01 };
+            append(header, 2);
+            m_zlibStarted = true;
+        }
+
+        do
+        {
+            uint16_t length = static_cast<uint16_t>(std::min<size_t>(size, 65535));
+            uint16_t complement = static_cast<uint16_t>(~length);
+            bool last = final && length == size;
+            uint8_t block[5] = { static_cast<uint8_t>(last ? 1 : 0),
+                static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+                static_cast<uint8_t>(complement), static_cast<uint8_t>(complement >> 8) };
+            append(block, 5);
+            if (length > 0) append(data, length);
+            data += length;
+            size -= length;
+        } while (size > 0);
+
+        if (final)
+        {
+            uint8_t adler[4];
+            storeBigEndian(adler, m_adler);
+            append(adler, 4);
+        }
+        closeChunk();
+    }
+
+    void appendHeader()
+    {
+        int width = m_image.getWidth();
+        int height = m_image.getHeight();
+        if (m_format == ImageFormat::PPM)
+        {
+            append("P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n");
+        }
+        else if (m_format == ImageFormat::PFM)
+        {
+            // The sign of the scale gives the byte order of the floats.
+            bool little = std::endian::native == std::endian::little;
+            append("PF\n" + std::to_string(width) + " " + std::to_string(height) + (little ? "\n-1.0\n" : "\n1.0\n"));
+        }
+        else
+        {
+            const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+            append(signature, 8);
+
+            // Size, 8 bits per channel, RGB, deflate, no filtering besides per row, not interlaced.
+            uint8_t header[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0 };
+            storeBigEndian(header, static_cast<uint32_t>(width));
+            storeBigEndian(header + 4, static_cast<uint32_t>(height));
+            appendChunk("IHDR", header, 13);
+        }
+    }
+
+    bool flush()
+    {
+        m_file.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size());
+        m_buffer.clear();
+        if (!m_file)
+        {
+            std::cerr << "Error: Could not write the image" << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Writes the whole image, in the format given by the extension of path.
+inline bool writeImage(const Image& image, const std::string& path)
+{
+    ImageFormat format;
+    if (!parseImageFormat(path, format))
+    {
+        std::cerr << "Error: Unknown image format " << path << ", expected .ppm, .png or .pfm" << std::endl;
+        return false;
+    }
+
+    ImageWriter writer(image, path, format);
+    return writer.isOpen() && writer.finish();
+}
+
+// Writes an image while it renders. The tiles report when they are done, and the rows are
+// written by the thread completing them: as soon as they are complete with fixed rows,
+// otherwise once all the rows before them in the file are complete too.
+class ImageStream
+{
+public:
+    ImageStream(const Image& image, const std::string& path, ImageFormat format)
+        : m_writer(image, path, format), m_remaining(image.getHeight(), image.getWidth())
+    {}
+
+    inline bool isOpen() const { return m_writer.isOpen(); }
+
+    void tileDone(const Tile& tile)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int completed = 0;
+        for (int y = tile.y0; y < tile.y1; y++)
+        {
+            m_remaining[y] -= tile.getWidth();
+            if (m_remaining[y] == 0) completed++;
+        }
+
+        if (m_writer.hasFixedRows())
+        {
+            // The tiles of a row of tiles complete their rows together.
+            if (completed == tile.getHeight())
+            {
+                int first = std::min(fileRow(tile.y0), fileRow(tile.y1 - 1));
+                m_ok = m_writer.writeRowsAt(first, tile.getHeight()) && m_ok;
+            }
+            else if (completed > 0)
+            {
+                for (int y = tile.y0; y < tile.y1; y++)
+                {
+                    if (m_remaining[y] == 0) m_ok = m_writer.writeRowsAt(fileRow(y), 1) && m_ok;
+                }
+            }
+            return;
+        }
+
+        int first = m_writer.getNextRow();
+        int count = 0;
+        while (first + count < static_cast<int>(m_remaining.size()) && m_remaining[m_writer.imageRow(first + count)] == 0)
+            count++;
+        if (count > 0) m_ok = m_writer.writeRows(count) && m_ok;
+    }
+
+    // Writes the rows of the tiles that were not reported and ends the file.
+    bool finish()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_writer.hasFixedRows()) return m_writer.finish() && m_ok;
+
+        for (int y = 0; y < static_cast<int>(m_remaining.size()); y++)
+        {
+            if (m_remaining[y] != 0) m_ok = m_writer.writeRowsAt(fileRow(y), 1) && m_ok;
+        }
+        return m_writer.close() && m_ok;
+    }
+
+private:
+    ImageWriter m_writer;
+    std::vector<int> m_remaining; // Pixels not rendered yet, per image row.
+    std::mutex m_mutex;
+    bool m_ok = true;
+
+    // imageRow maps file rows to image rows and back.
+    inline int fileRow(int y) const { return m_writer.imageRow(y); }
+};
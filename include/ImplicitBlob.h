@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Object.h"
+#include "Metaballs.h"
+#include "TextureMaterial.h"
+
+// Surface where the density of a metaball field equals threshold, intersected directly by
+// sphere tracing the field, without meshing it. Along a ray, f = threshold - density (negative
+// inside) changes by at most L per unit of distance, L being a Lipschitz constant of the
+// density, so there is no surface within |f| / L of a point and the ray can safely advance
+// by that much. The root is then refined by bisection once f changes sign.
+// The optional coarse grid lets the rays skip the cells the surface cannot cross and uses
+// the Lipschitz constant of each cell instead of the global one, which is much larger
+// where many balls overlap. Rebuilding it is cheap, see build().
+class ImplicitBlob : public Object
+{
+public:
+    // tolerance is the precision of the hit distances, and the minimum step: surfaces thinner
+    // than that may be missed. gridResolution is the number of cells of the coarse grid along
+    // the longest axis of the field, 0 for none.
+    ImplicitBlob(std::shared_ptr<const MetaballField> field, Real threshold, std::shared_ptr<TextureMaterial> material,
+        int gridResolution = 64, Real tolerance = 1e-4)
+        : m_field(field), m_threshold(threshold), m_textureMaterial(material), m_gridResolution(gridResolution), m_tolerance(tolerance)
+    {}
+
+    // Builds the coarse grid over the current state of the field. Call it again after the
+    // field changed; it costs a density range and a Lipschitz bound per cell.
+    virtual void build() override
+    {
+        m_cells.clear();
+        m_bounds = m_field->boundingBox();
+        if (m_gridResolution <= 0 || m_bounds.isEmpty()) return;
+
+        Vector3 extent = m_bounds.extent();
+        m_cellSize = std::max(extent[m_bounds.largestAxis()] / m_gridResolution, Epsilon<Real>::NearZero);
+        for (int axis = 0; axis < 3; axis++)
+            m_cellCounts[axis] = std::max(1, static_cast<int>(std::ceil(extent[axis] / m_cellSize)));
+
+        m_cells.resize(static_cast<size_t>(m_cellCounts[0]) * m_cellCounts[1] * m_cellCounts[2]);
+        for (int z = 0; z < m_cellCounts[2]; z++)
+        {
+            for (int y = 0; y < m_cellCounts[1]; y++)
+            {
+                for (int x = 0; x < m_cellCounts[0]; x++)
+                {
+                    AABB box = cellBounds(x, y, z);
+                    Real min, max;
+                    m_field->densityRange(box, min, max);
+
+                    Cell& cell = m_cells[cellIndex(x, y, z)];
+                    cell.empty = max < m_threshold - m_tolerance;
+                    cell.lipschitz = m_field->lipschitzBound(box);
+                }
+            }
+        }
+    }
+
+    virtual bool intersects(const Ray& ray, Real t_min, Real t_max, hit_record& record) const override
+    {
+        Real t;
+        if (!march(ray, t_min, t_max, t)) return false;
+
+        record.t = t;
+        record.object = this;
+        return true;
+    }
+
+    virtual bool occluded(const Ray& ray, Real t_min, Real t_max) const override
+    {
+        Real t;
+        return march(ray, t_min, t_max, t);
+    }
+
+    virtual void completeHit(const Ray& ray, hit_record& record) const override
+    {
+        record.p = ray.at(record.t);
+        record.set_face_normal(ray, normalAt(record.p, ray, record));
+        record.textureMaterial = m_textureMaterial.get();
+    }
+
+    // Outward normal, against the gradient of the density.
+    virtual Vector3 normalAt(const Point3& point, const Ray& ray, hit_record& /* record */) const override
+    {
+        Vector3 gradient = m_field->gradient(point);
+        if (gradient.LengthSquared() == 0) return -Normalize(ray.direction());
+        return Normalize(-gradient);
+    }
+
+    virtual AABB boundingBox() const override { return m_field->boundingBox(); }
+
+private:
+    struct Cell
+    {
+        Real lipschitz;
+        bool empty; // The density stays below the threshold in the whole cell.
+    };
+
+    // Last point evaluated along the ray.
+    struct Sample
+    {
+        Real t;
+        bool inside;
+        bool valid = false;
+    };
+
+    std::shared_ptr<const MetaballField> m_field;
+    Real m_threshold;
+    std::shared_ptr<TextureMaterial> m_textureMaterial;
+    int m_gridResolution;
+    Real m_tolerance;
+
+    AABB m_bounds;
+    std::vector<Cell> m_cells; // Empty without coarse grid.
+    Real m_cellSize = 1;
+    int m_cellCounts[3] = { 0, 0, 0 };
+
+    inline size_t cellIndex(int x, int y, int z) const
+    {
+        return (static_cast<size_t>(z) * m_cellCounts[1] + y) * m_cellCounts[0] + x;
+    }
+
+    AABB cellBounds(int x, int y, int z) const
+    {
+        Point3 min = m_bounds.getMin() + m_cellSize * Vector3(x, y, z);
+        return AABB(min, min + Vector3(m_cellSize, m_cellSize, m_cellSize));
+    }
+
+    inline Real value(const Point3& p) const { return m_threshold - m_field->density(p); }
+
+    // First crossing of the surface along the ray within [t_min, t_max], from the outside in
+    // or from the inside out.
+    bool march(const Ray& ray, Real t_min, Real t_max, Real& t) const
+    {
+        if (!m_field->boundingBox().clip(ray, t_min, t_max)) return false;
+
+        Sample previous;
+        Real speed = ray.direction().Length();
+        if (m_cells.empty())
+            return marchSegment(ray, speed, t_min, t_max, m_field->lipschitzBound(), previous, t);
+
+        // 3D DDA over the cells, after Amanatides and Woo.
+        Point3 entry = ray.at(t_min);
+        Vector3 direction = ray.direction();
+        int cell[3], step[3];
+        Real next[3], delta[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Real offset = (entry[axis] - m_bounds.getMin()[axis]) / m_cellSize;
+            cell[axis] = std::clamp(static_cast<int>(std::floor(offset)), 0, m_cellCounts[axis] - 1);
+
+            Real d = direction[axis];
+            if (d > 0)
+            {
+                step[axis] = 1;
+                delta[axis] = m_cellSize / d;
+                next[axis] = t_min + (m_bounds.getMin()[axis] + (cell[axis] + 1) * m_cellSize - entry[axis]) / d;
+            }
+            else if (d < 0)
+            {
+                step[axis] = -1;
+                delta[axis] = -m_cellSize / d;
+                next[axis] = t_min + (m_bounds.getMin()[axis] + cell[axis] * m_cellSize - entry[axis]) / d;
+            }
+            else
+            {
+                step[axis] = 0;
+                delta[axis] = infinity;
+                next[axis] = infinity;
+            }
+        }
+
+        Real t_enter = t_min;
+        while (true)
+        {
+            int axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+            Real t_exit = std::min(next[axis], t_max);
+
+            const Cell& current = m_cells[cellIndex(cell[0], cell[1], cell[2])];
+            if (current.empty)
+            {
+                // The surface is not in the cell, the ray is outside all along.
+                previous.t = t_exit;
+                previous.inside = false;
+                previous.valid = true;
+            }
+            else if (marchSegment(ray, speed, t_enter, t_exit, current.lipschitz, previous, t))
+            {
+                return true;
+            }
+
+            if (t_exit >= t_max) return false;
+
+            cell[axis] += step[axis];
+            if (cell[axis] < 0 || cell[axis] >= m_cellCounts[axis]) return false;
+            t_enter = t_exit;
+            next[axis] += delta[axis];
+        }
+    }
+
+    // Sphere traces [t_begin, t_end], where the Lipschitz constant of the density is
+    // lipschitz, continuing from the previous sample. Distances along the ray are divided
+    // by speed, the length of its direction, to get steps in t.
+    bool marchSegment(const Ray& ray, Real speed, Real t_begin, Real t_end, Real lipschitz, Sample& previous, Real& t) const
+    {
+        Real current = t_begin;
+        while (true)
+        {
+            Real f = value(ray.at(current));
+            bool inside = f < 0;
+            if (previous.valid && inside != previous.inside)
+            {
+                t = bisect(ray, m_tolerance / speed, previous.t, current, previous.inside);
+                return true;
+            }
+
+            previous.t = current;
+            previous.inside = inside;
+            previous.valid = true;
+            if (current >= t_end) return false;
+
+            // At least tolerance, so the loop ends.
+            Real distance = lipschitz > 0 ? std::abs(f) / lipschitz : infinity;
+            Real next = std::min(t_end, current + std::max(distance, m_tolerance) / speed);
+            current = next > current ? next : t_end;
+        }
+    }
+
+    // Crossing within [t0, t1], to precision, the ray being inside at t0 if inside0 and not
+    // at t1.
+    Real bisect(const Ray& ray, Real precision, Real t0, Real t1, bool inside0) const
+    {
+        while (t1 - t0 > precision)
+        {
+            Real middle = (t0 + t1) / 2;
+            if ((value(ray.at(middle)) < 0) == inside0)
+                t0 = middle;
+            else
+                t1 = middle;
+        }
+        return (t0 + t1) / 2;
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <memory>
+
+#include "Mesh.h"
+#include "Transform.h"
+
+// Mesh placed in the scene by an affine transform, sharing its triangles (and the BVH built
+// over them) with every other instance of it: a forest of N trees costs one tree and N
+// transforms. Rays are moved into the space of the mesh rather than the mesh into world
+// space, so Scene's BVH over its objects acts as the top level of a two-level structure
+// whose bottom levels are the BVHs of the shared meshes.
+//
+// Only meshes are instanced: a hit records the instance in place of the object hit, which
+// leaf geometry can afford but an aggregate such as Scene, whose completeHit needs the
+// object hit inside it, cannot.
+//
+// The direction of the transformed ray is not normalized, so t means the same distance in
+// both spaces and hits compare across instances and with the other objects.
+class Instance : public Object
+{
+public:
+    Instance(std::shared_ptr<Mesh> mesh, const Transform& toWorld)
+        : m_mesh(std::move(mesh))
+        , m_toWorld(toWorld)
+        , m_toObject(toWorld.inverse())
+    {}
+
+    // Builds the shared mesh unless another instance of it did.
+    virtual void build() override
+    {
+        if (!m_mesh->isBuilt()) m_mesh->build();
+    }
+
+    virtual bool intersects(const Ray& ray, Real t_min, Real t_max, hit_record& record) const override
+    {
+        if (!m_mesh->intersects(m_toObject.applyRay(ray), t_min, t_max, record)) return false;
+
+        record.object = this;
+        return true;
+    }
+
+    virtual bool occluded(const Ray& ray, Real t_min, Real t_max) const override
+    {
+        return m_mesh->occluded(m_toObject.applyRay(ray), t_min, t_max);
+    }
+
+    // The shared mesh completes the hit in its space, then p and the normal are brought
+    // back. Transforms keep the side of the surface the ray comes from, so front_face holds.
+    virtual void completeHit(const Ray& ray, hit_record& record) const override
+    {
+        m_mesh->completeHit(m_toObject.applyRay(ray), record);
+        record.p = ray.at(record.t);
+        record.normal = Normalize(m_toWorld.applyNormal(record.normal));
+    }
+
+    virtual Vector3 normalAt(const Point3& point, const Ray& ray, hit_record& record) const override
+    {
+        m_mesh->normalAt(m_toObject.applyPoint(point), m_toObject.applyRay(ray), record);
+        record.normal = Normalize(m_toWorld.applyNormal(record.normal));
+        return record.normal;
+    }
+
+    // The shared mesh records its hits in a PacketHit of its own, starting from the
+    // closest hits so far, which are then claimed for this instance.
+    virtual void intersectsPacket(const RayPacket& packet, SimdReal active, Real t_min, PacketHit& hit) const override
+    {
+        PacketHit local(0);
+        local.t = hit.t;
+        m_mesh->intersectsPacket(toObject(packet), active, t_min, local);
+
+        Real t[PacketWidth];
+        local.t.store(t);
+        int bits = 0;
+        for (int lane = 0; lane < PacketWidth; lane++)
+        {
+            if (!local.hit[lane]) continue;
+            bits |= 1 << lane;
+            hit.u[lane] = local.u[lane];
+            hit.v[lane] = local.v[lane];
+            hit.object[lane] = this;
+            hit.primitive[lane] = local.primitive[lane];
+            hit.hit[lane] = true;
+        }
+        if (bits) hit.t = Select(MaskFromBits<SimdReal>(bits), SimdReal::load(t), hit.t);
+    }
+
+    virtual SimdReal occludedPacket(const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max) const override
+    {
+        return m_mesh->occludedPacket(toObject(packet), active, t_min, t_max);
+    }
+
+    virtual AABB boundingBox() const override
+    {
+        return m_toWorld.applyBox(m_mesh->boundingBox());
+    }
+
+    inline const std::shared_ptr<Mesh>& getMesh() const { return m_mesh; }
+    inline const Transform& getTransform() const { return m_toWorld; }
+
+private:
+    std::shared_ptr<Mesh> m_mesh;
+    Transform m_toWorld;
+    Transform m_toObject;
+
+    RayPacket toObject(const RayPacket& packet) const
+    {
+        auto row = [&](int r, SimdReal x, SimdReal y, SimdReal z, Real w)
+        {
+            return SimdReal(m_toObject.get(r, 0)) * x + SimdReal(m_toObject.get(r, 1)) * y + SimdReal(m_toObject.get(r, 2)) * z + SimdReal(w);
+        };
+
+        RayPacket local = packet;
+        local.ox = row(0, packet.ox, packet.oy, packet.oz, m_toObject.get(0, 3));
+        local.oy = row(1, packet.ox, packet.oy, packet.oz, m_toObject.get(1, 3));
+        local.oz = row(2, packet.ox, packet.oy, packet.oz, m_toObject.get(2, 3));
+        local.dx = row(0, packet.dx, packet.dy, packet.dz, 0);
+        local.dy = row(1, packet.dx, packet.dy, packet.dz, 0);
+        local.dz = row(2, packet.dx, packet.dy, packet.dz, 0);
+        local.invDx = SimdReal(1.0) / local.dx;
+        local.invDy = SimdReal(1.0) / local.dy;
+        local.invDz = SimdReal(1.0) / local.dz;
+        return local;
+    }
+};
@@ -9,14 +9,14 @@ public:
 
     virtual Vector3 getDirection(const Point3& point) const = 0;
 
-    virtual double getDistance(const Point3& point) const = 0;
+    virtual Real getDistance(const Point3& point) const = 0;
 
     virtual Color3 getColor() const = 0;
 };
 
 class PointLight : public Light {
 public:
-    PointLight(const Point3& position, const Color3& color, double intensity)
+    PointLight(const Point3& position, const Color3& color, Real intensity)
         : position(position), color(color), intensity(intensity) {}
 
     virtual Vector3 getDirection(const Point3& point) const override
@@ -24,7 +24,7 @@ public:
         return Normalize(position - point);
     }
 
-    virtual double getDistance(const Point3& point) const override
+    virtual Real getDistance(const Point3& point) const override
     {
         return (position - point).Length();
     }
@@ -37,5 +37,5 @@ public:
 private:
     Point3 position;
     Color3 color;
-    double intensity;
+    Real intensity;
 };
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file. Opening costs no copy: the pages are read from
+// the page cache on demand, as the parser touches them.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) return;
+
+        struct stat status;
+        if (::fstat(descriptor, &status) == 0)
+        {
+            m_size = static_cast<size_t>(status.st_size);
+            if (m_size == 0)
+            {
+                m_open = true;
+            }
+            else
+            {
+                void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (data != MAP_FAILED)
+                {
+                    ::madvise(data, m_size, MADV_SEQUENTIAL);
+                    m_data = static_cast<const char*>(data);
+                    m_open = true;
+                }
+            }
+        }
+        ::close(descriptor);
+    }
+
+    ~MappedFile()
+    {
+        if (m_data) ::munmap(const_cast<char*>(m_data), m_size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    inline bool isOpen() const { return m_open; }
+    inline const char* data() const { return m_data; }
+    inline size_t size() const { return m_open ? m_size : 0; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_open = false;
+};
@@ -1,28 +1,148 @@
 #pragma once
 
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 #include "TextureMaterial.h"
 #include "Object.h"
+#include "BVH.h"
 
+// Indexed triangle mesh. Vertices are stored once and shared by the triangles using them,
+// a triangle being three vertex indices and an index in the mesh material table. Once
+// built, the triangles are stored in BVH leaf order so that a leaf reads contiguous memory.
+// Vertices may carry a normal, which is then interpolated over the triangles for shading.
 class Mesh : public Object
 {
 public:
     Mesh() = default;
 
-    void addTriangle(Triangle triangle)
+    uint32_t addVertex(const Point3& vertex)
+    {
+        m_vertices.push_back(vertex);
+        return static_cast<uint32_t>(m_vertices.size() - 1);
+    }
+
+    // Either every vertex has a normal or none has.
+    uint32_t addVertex(const Point3& vertex, const Vector3& normal)
+    {
+        m_normals.push_back(normal);
+        return addVertex(vertex);
+    }
+
+    // Returns the index of material in the mesh material table, adding it if needed.
+    uint32_t addMaterial(const std::shared_ptr<TextureMaterial>& material)
+    {
+        for (size_t i = m_materials.size(); i-- > 0;)
+        {
+            if (m_materials[i] == material) return static_cast<uint32_t>(i);
+        }
+
+        m_materials.push_back(material);
+        return static_cast<uint32_t>(m_materials.size() - 1);
+    }
+
+    // Adds the triangle of vertices i0, i1 and i2, with the material of index material.
+    void addFace(uint32_t i0, uint32_t i1, uint32_t i2, uint32_t material)
     {
-        m_mesh.emplace_back(triangle);
+        m_indices.push_back(i0);
+        m_indices.push_back(i1);
+        m_indices.push_back(i2);
+        m_faceMaterials.push_back(material);
+        m_bvh.clear();
+        m_bvhInstalled = false;
     }
 
+    void reserve(size_t vertexCount, size_t triangleCount)
+    {
+        m_vertices.reserve(vertexCount);
+        m_indices.reserve(3 * triangleCount);
+        m_faceMaterials.reserve(triangleCount);
+    }
+
+    // Replaces the geometry with the given buffers, moved rather than copied, all the faces
+    // having material. For the file loaders, which fill the buffers in parallel.
+    void setGeometry(std::vector<Point3>&& vertices, std::vector<Vector3>&& normals, std::vector<uint32_t>&& indices,
+        const std::shared_ptr<TextureMaterial>& material)
+    {
+        m_vertices = std::move(vertices);
+        m_normals = std::move(normals);
+        m_indices = std::move(indices);
+        m_materials.clear();
+        m_faceMaterials.assign(m_indices.size() / 3, addMaterial(material));
+        m_bvh.clear();
+        m_bvhInstalled = false;
+    }
+
+    // Adds a standalone triangle, with vertices of its own.
+    void addTriangle(const Triangle& triangle)
+    {
+        uint32_t first = addVertex(triangle.getP0());
+        addVertex(triangle.getP1());
+        addVertex(triangle.getP2());
+        addFace(first, first + 1, first + 2, addMaterial(triangle.getMaterial()));
+    }
+
+    // Moves the vertices and refits the BVH, which stays usable; build then rebuilds it.
     void translate(Vector3 v)
     {
-        for (auto& triangle : m_mesh)
+        for (auto& vertex : m_vertices)
+            vertex = vertex + v;
+
+        refit();
+        m_bvhInstalled = false;
+    }
+
+    // Builds the triangle BVH, replacing any previous one, and stores the triangles in
+    // leaf order. A BVH installed by setBVH, e.g. from the mesh cache, is kept instead.
+    virtual void build() override
+    {
+        if (m_bvhInstalled) return;
+
+        m_bvh.build(triangleBounds());
+
+        std::vector<uint32_t> order = m_bvh.linearize();
+        std::vector<uint32_t> indices(m_indices.size());
+        std::vector<uint32_t> faceMaterials(m_faceMaterials.size());
+        for (size_t i = 0; i < order.size(); i++)
         {
-            triangle.setP0(triangle.getP0() + v);
-            triangle.setP1(triangle.getP1() + v);
-            triangle.setP2(triangle.getP2() + v);
+            for (int k = 0; k < 3; k++)
+                indices[3 * i + k] = m_indices[3 * order[i] + k];
+            faceMaterials[i] = m_faceMaterials[order[i]];
         }
+        m_indices.swap(indices);
+        m_faceMaterials.swap(faceMaterials);
     }
 
+    // Updates the BVH bounds after the vertices moved (e.g. after translate) while
+    // keeping the tree topology. Does nothing if the BVH has not been built.
+    void refit()
+    {
+        if (m_bvh.isBuilt())
+            m_bvh.refit(triangleBounds());
+    }
+
+    inline bool isBuilt() const { return m_bvh.isBuilt(); }
+    inline const BVH& getBVH() const { return m_bvh; }
+
+    // Builds the BVH from scratch, even over one installed by setBVH.
+    void rebuild()
+    {
+        m_bvhInstalled = false;
+        build();
+    }
+
+    // Installs a BVH built earlier over the current triangles, which must be in its leaf
+    // order, as they are after build. build keeps it until the triangles change.
+    void setBVH(BVH&& bvh)
+    {
+        m_bvh = std::move(bvh);
+        m_bvhInstalled = m_bvh.isBuilt();
+    }
+
+    // Keeps the BVH that build made as if installed by setBVH, without copying it.
+    void keepBVH() { m_bvhInstalled = m_bvh.isBuilt(); }
+
     void addCube()
     {
         auto material_ground = std::make_shared<MirrorTexture>(Color3(0.0, 0.0, 0.8));
@@ -111,46 +231,212 @@ public:
             material_ground
         );
 
-        m_mesh.push_back(tri1South);
-        m_mesh.push_back(tri2South);
-        m_mesh.push_back(tri1East);
-        m_mesh.push_back(tri2East);
-        m_mesh.push_back(tri1North);
-        m_mesh.push_back(tri2North);
-        m_mesh.push_back(tri1West);
-        m_mesh.push_back(tri2West);
-        m_mesh.push_back(tri1Top);
-        m_mesh.push_back(tri2Top);
-        m_mesh.push_back(tri1Bottom);
-        m_mesh.push_back(tri2Bottom);
+        addTriangle(tri1South);
+        addTriangle(tri2South);
+        addTriangle(tri1East);
+        addTriangle(tri2East);
+        addTriangle(tri1North);
+        addTriangle(tri2North);
+        addTriangle(tri1West);
+        addTriangle(tri2West);
+        addTriangle(tri1Top);
+        addTriangle(tri2Top);
+        addTriangle(tri1Bottom);
+        addTriangle(tri2Bottom);
     }
 
-    virtual bool intersects(const Ray& ray, double t_min, double t_max, hit_record& record) const override
+    virtual bool intersects(const Ray& ray, Real t_min, Real t_max, hit_record& record) const override
+    {
+        if (!m_bvh.isBuilt())
+            return intersectsLinear(ray, t_min, t_max, record);
+
+        Real closest_so_far = t_max;
+        return m_bvh.traverse(ray, t_min, closest_so_far, [&](uint32_t index, Real t_near, Real& closest)
+        {
+            if (!intersectsFace(index, ray, t_near, closest, record)) return false;
+
+            closest = record.t;
+            return true;
+        });
+    }
+
+    virtual void completeHit(const Ray& ray, hit_record& record) const override
+    {
+        Point3 p0;
+        Vector3 e1, e2;
+        faceEdges(record.primitive, p0, e1, e2);
+
+        record.p = ray.at(record.t);
+        if (m_normals.empty())
+        {
+            record.set_face_normal(ray, Triangle::faceNormal(e1, e2));
+        }
+        else
+        {
+            const uint32_t* face = &m_indices[3 * record.primitive];
+            Vector3 normal = (1 - record.u - record.v) * m_normals[face[0]] + record.u * m_normals[face[1]] + record.v * m_normals[face[2]];
+            record.set_face_normal(ray, Normalize(normal));
+        }
+        record.textureMaterial = m_materials[m_faceMaterials[record.primitive]].get();
+    }
+
+    virtual bool occluded(const Ray& ray, Real t_min, Real t_max) const override
+    {
+        if (!m_bvh.isBuilt())
+        {
+            for (uint32_t face = 0; face < getTriangleCount(); face++)
+            {
+                if (occludedFace(face, ray, t_min, t_max)) return true;
+            }
+            return false;
+        }
+
+        return m_bvh.traverseAny(ray, t_min, t_max, [&](uint32_t index, Real t_near, Real t_far)
+        {
+            return occludedFace(index, ray, t_near, t_far);
+        });
+    }
+
+    virtual void intersectsPacket(const RayPacket& packet, SimdReal active, Real t_min, PacketHit& hit) const override
+    {
+        if (!m_bvh.isBuilt())
+        {
+            Object::intersectsPacket(packet, active, t_min, hit);
+            return;
+        }
+
+        m_bvh.traversePacket(packet, active, t_min, hit.t, [&](uint32_t index, SimdReal lanes)
+        {
+            Point3 p0;
+            Vector3 e1, e2;
+            faceEdges(index, p0, e1, e2);
+
+            SimdReal t, u, v;
+            SimdReal mask = Triangle::intersectsPacketBarycentric(p0, e1, e2, packet, lanes, SimdReal(t_min), hit.t, t, u, v);
+            if (Any(mask)) hit.update(mask, t, u, v, this, index);
+        });
+    }
+
+    virtual SimdReal occludedPacket(const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max) const override
+    {
+        if (!m_bvh.isBuilt())
+            return Object::occludedPacket(packet, active, t_min, t_max);
+
+        return m_bvh.traverseAnyPacket(packet, active, t_min, t_max, [&](uint32_t index, SimdReal lanes)
+        {
+            Point3 p0;
+            Vector3 e1, e2;
+            faceEdges(index, p0, e1, e2);
+
+            SimdReal t, u, v;
+            return Triangle::intersectsPacketBarycentric(p0, e1, e2, packet, lanes, SimdReal(t_min), t_max, t, u, v);
+        });
+    }
+
+    bool intersectsLinear(const Ray& ray, Real t_min, Real t_max, hit_record& record) const
     {
-        hit_record tmp_record;
         bool hit = false;
-        double closest_so_far = t_max;
+        Real closest_so_far = t_max;
 
-        for (const auto& object : m_mesh)
+        for (uint32_t face = 0; face < getTriangleCount(); face++)
         {
-            if (object.intersects(ray, t_min, closest_so_far, tmp_record))
+            if (intersectsFace(face, ray, t_min, closest_so_far, record))
             {
                 hit = true;
-                closest_so_far = tmp_record.t;
-                record = tmp_record;
+                closest_so_far = record.t;
             }
         }
 
         return hit;
     }
 
-    virtual Vector3 normalAt(const Point3& point, const Ray& ray, hit_record& record) const override
+    virtual Vector3 normalAt(const Point3& /* point */, const Ray& /* ray */, hit_record& record) const override
     {
         return record.normal;
     }
 
-    inline std::vector<Triangle> getMesh() const { return m_mesh; }
+    virtual AABB boundingBox() const override
+    {
+        if (m_bvh.isBuilt()) return m_bvh.getBounds();
+
+        AABB box;
+        for (const auto& vertex : m_vertices)
+            box.grow(vertex);
+        return box;
+    }
+
+    inline uint32_t getTriangleCount() const { return static_cast<uint32_t>(m_faceMaterials.size()); }
+    inline uint32_t getVertexCount() const { return static_cast<uint32_t>(m_vertices.size()); }
+    inline const std::vector<Point3>& getVertices() const { return m_vertices; }
+    inline const std::vector<Vector3>& getNormals() const { return m_normals; }
+    inline const std::vector<uint32_t>& getIndices() const { return m_indices; }
+
+    Triangle getTriangle(uint32_t face) const
+    {
+        return Triangle(m_vertices[m_indices[3 * face]], m_vertices[m_indices[3 * face + 1]], m_vertices[m_indices[3 * face + 2]],
+            m_materials[m_faceMaterials[face]]);
+    }
+
+    // Bytes used by the geometry, the BVH excluded.
+    size_t getMemorySize() const
+    {
+        return m_vertices.size() * sizeof(Point3) + m_normals.size() * sizeof(Vector3) + m_indices.size() * sizeof(uint32_t) + m_faceMaterials.size() * sizeof(uint32_t);
+    }
 
 private:
-    std::vector<Triangle> m_mesh;
-};
\ No newline at end of file
+    std::vector<Point3> m_vertices;
+    std::vector<Vector3> m_normals;        // Empty, or one per vertex.
+    std::vector<uint32_t> m_indices;       // Three vertex indices per triangle.
+    std::vector<uint32_t> m_faceMaterials; // Index in m_materials per triangle.
+    std::vector<std::shared_ptr<TextureMaterial>> m_materials;
+    BVH m_bvh;
+    bool m_bvhInstalled = false; // m_bvh was given by setBVH, so build keeps it.
+
+    inline void faceEdges(uint32_t face, Point3& p0, Vector3& e1, Vector3& e2) const
+    {
+        p0 = m_vertices[m_indices[3 * face]];
+        e1 = m_vertices[m_indices[3 * face + 1]] - p0;
+        e2 = m_vertices[m_indices[3 * face + 2]] - p0;
+    }
+
+    inline bool intersectsFace(uint32_t face, const Ray& ray, Real t_min, Real t_max, hit_record& record) const
+    {
+        Point3 p0;
+        Vector3 e1, e2;
+        faceEdges(face, p0, e1, e2);
+
+        Real t, u, v;
+        if (!Triangle::intersectsBarycentric(p0, e1, e2, ray, t_min, t_max, t, u, v)) return false;
+
+        record.t = t;
+        record.u = u;
+        record.v = v;
+        record.object = this;
+        record.primitive = face;
+        return true;
+    }
+
+    inline bool occludedFace(uint32_t face, const Ray& ray, Real t_min, Real t_max) const
+    {
+        Point3 p0;
+        Vector3 e1, e2;
+        faceEdges(face, p0, e1, e2);
+
+        Real t, u, v;
+        return Triangle::intersectsBarycentric(p0, e1, e2, ray, t_min, t_max, t, u, v);
+    }
+
+    std::vector<AABB> triangleBounds() const
+    {
+        std::vector<AABB> bounds;
+        bounds.reserve(getTriangleCount());
+        for (uint32_t face = 0; face < getTriangleCount(); face++)
+        {
+            AABB box;
+            for (int k = 0; k < 3; k++)
+                box.grow(m_vertices[m_indices[3 * face + k]]);
+            bounds.push_back(box);
+        }
+        return bounds;
+    }
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+
+#include "MappedFile.h"
+#include "MeshLoader.h"
+
+// 64-bit hash of a buffer, for cache keys: not cryptographic, but every bit of the input
+// reaches every bit of the output. The buffer is hashed in blocks, in parallel, and the
+// block hashes are combined in order, so the result does not depend on the thread count.
+inline uint64_t contentHash(const char* data, size_t size)
+{
+    const uint64_t Prime = 0x9E3779B97F4A7C15ull;
+    const size_t BlockSize = 1 << 22;
+    auto mix = [](uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        return h ^ (h >> 33);
+    };
+
+    size_t blockCount = (size + BlockSize - 1) / BlockSize;
+    std::vector<uint64_t> blocks(blockCount);
+    tbb::parallel_for(size_t(0), blockCount, [&](size_t b)
+    {
+        const char* begin = data + b * BlockSize;
+        size_t length = std::min(BlockSize, size - b * BlockSize);
+
+        // Four independent lanes of 8-byte words, then the tail byte by byte.
+        uint64_t lanes[4] = { b, b + 1, b + 2, b + 3 };
+        size_t words = length / 32 * 4;
+        for (size_t w = 0; w < words; w += 4)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                uint64_t word;
+                std::memcpy(&word, begin + 8 * (w + k), 8);
+                lanes[k] = (lanes[k] ^ word) * Prime;
+                lanes[k] ^= lanes[k] >> 29;
+            }
+        }
+        uint64_t h = mix(lanes[0]) ^ mix(lanes[1] + 1) * 3 ^ mix(lanes[2] + 2) * 5 ^ mix(lanes[3] + 3) * 7;
+        for (size_t i = 8 * words; i < length; i++)
+            h = (h ^ static_cast<uint8_t>(begin[i])) * Prime;
+        blocks[b] = mix(h);
+    });
+
+    uint64_t h = mix(size);
+    for (uint64_t block : blocks)
+        h = mix(h ^ block) * Prime;
+    return mix(h);
+}
+
+// Cache of the meshes loaded from files, built: the flattened vertex, normal and index
+// buffers in BVH leaf order, and the BVH. A cache file is named after a hash of the content
+// of the mesh file, and holds a header then the arrays, 64-byte aligned and in the byte order
+// and precision of the machine that wrote it. It is mapped and its arrays copied as they are,
+// so a hit costs the hash of the input and a copy instead of parsing and building.
+class MeshCache
+{
+public:
+    static const uint32_t Magic = 0x434D5452; // "RTMC" on little-endian machines.
+    static const uint32_t Version = 1;
+
+    explicit MeshCache(const std::string& directory) : m_directory(directory) {}
+
+    // Loads the mesh file at path into mesh, built, from the cache if it holds it, otherwise
+    // from the file, adding it to the cache. Failing to write the cache is not an error.
+    bool load(const std::string& path, Mesh& mesh, const std::shared_ptr<TextureMaterial>& material)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+
+        uint64_t hash;
+        {
+            MappedFile input(path);
+            if (!input.isOpen())
+            {
+                std::cerr << "Error: Could not open file " << path << std::endl;
+                return false;
+            }
+            hash = contentHash(input.data(), input.size());
+        }
+
+        std::string cachePath = getCachePath(hash);
+        if (read(cachePath, hash, mesh, material))
+        {
+            m_hits++;
+            m_hitSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+            return true;
+        }
+
+        if (!loadMesh(path, mesh, material)) return false;
+        mesh.build();
+        write(cachePath, hash, mesh);
+        // Kept like a cached BVH, so that Scene::build does not build it again.
+        mesh.keepBVH();
+        m_misses++;
+        m_missSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+        return true;
+    }
+
+    // Prints the hits and the misses so far and the time they took.
+    void report(std::ostream& out) const
+    {
+        out << "Mesh cache " << m_directory << ": " << m_hits << " hits in " << m_hitSeconds * 1000 << " ms, " << m_misses
+            << " misses in " << m_missSeconds * 1000 << " ms" << std::endl;
+    }
+
+    inline size_t getHits() const { return m_hits; }
+    inline size_t getMisses() const { return m_misses; }
+
+private:
+    struct Header
+    {
+        uint32_t magic = Magic;
+        uint32_t version = Version;
+        uint32_t realSize = sizeof(Real);
+        uint32_t normals = 0; // 1 if the vertices have normals.
+        uint64_t hash = 0;
+        uint64_t vertexCount = 0;
+        uint64_t triangleCount = 0;
+        uint64_t nodeCount = 0;
+    };
+
+    static const size_t Alignment = 64;
+
+    std::string m_directory;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+    double m_hitSeconds = 0;
+    double m_missSeconds = 0;
+
+    std::string getCachePath(uint64_t hash) const
+    {
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << hash << (sizeof(Real) == 4 ? "-f32" : "-f64") << ".meshcache";
+        return (std::filesystem::path(m_directory) / name.str()).string();
+    }
+
+    static inline size_t align(size_t offset) { return (offset + Alignment - 1) / Alignment * Alignment; }
+
+    // Offsets of the arrays in the file, in order: vertices, normals, indices, nodes, BVH indices.
+    static void layout(const Header& header, size_t offsets[6])
+    {
+        size_t sizes[5] = { header.vertexCount * sizeof(Point3), header.normals ? header.vertexCount * sizeof(Vector3) : 0,
+            3 * header.triangleCount * sizeof(uint32_t), header.nodeCount * sizeof(BVHNode), header.triangleCount * sizeof(uint32_t) };
+        offsets[0] = align(sizeof(Header));
+        for (int i = 0; i < 5; i++)
+            offsets[i + 1] = align(offsets[i] + sizes[i]);
+    }
+
+    template<typename T>
+    static std::vector<T> readArray(const MappedFile& file, size_t offset, size_t count)
+    {
+        const T* begin = reinterpret_cast<const T*>(file.data() + offset);
+        return std::vector<T>(begin, begin + count);
+    }
+
+    bool read(const std::string& cachePath, uint64_t hash, Mesh& mesh, const std::shared_ptr<TextureMaterial>& material) const
+    {
+        MappedFile file(cachePath);
+        if (!file.isOpen() || file.size() < sizeof(Header)) return false;
+
+        Header header;
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (header.magic != Magic || header.version != Version || header.realSize != sizeof(Real) || header.hash != hash) return false;
+
+        // Bounding every count by the file size first keeps the offsets of layout from
+        // overflowing on a corrupted header.
+        if (header.vertexCount > UINT32_MAX || header.triangleCount > UINT32_MAX / 3 || header.vertexCount > file.size() / sizeof(Point3)
+            || header.triangleCount > file.size() / (3 * sizeof(uint32_t)) || header.nodeCount > file.size() / sizeof(BVHNode))
+            return false;
+
+        size_t offsets[6];
+        layout(header, offsets);
+        if (file.size() < offsets[4] + header.triangleCount * sizeof(uint32_t)) return false;
+
+        std::vector<Point3> vertices = readArray<Point3>(file, offsets[0], header.vertexCount);
+        std::vector<Vector3> normals = readArray<Vector3>(file, offsets[1], header.normals ? header.vertexCount : 0);
+        std::vector<uint32_t> indices = readArray<uint32_t>(file, offsets[2], 3 * header.triangleCount);
+        BVH bvh;
+        bvh.assign(readArray<BVHNode>(file, offsets[3], header.nodeCount), readArray<uint32_t>(file, offsets[4], header.triangleCount));
+
+        // The render indexes with the arrays unchecked, so corrupted content is a miss
+        // rather than reads out of bounds.
+        uint32_t vertexCount = static_cast<uint32_t>(header.vertexCount);
+        for (uint32_t index : indices)
+        {
+            if (index >= vertexCount) return false;
+        }
+        if (!bvh.isValid(static_cast<uint32_t>(header.triangleCount))) return false;
+
+        mesh.setGeometry(std::move(vertices), std::move(normals), std::move(indices), material);
+        mesh.setBVH(std::move(bvh));
+        return true;
+    }
+
+    // Writes next to cachePath then renames, so that a concurrent render never maps a
+    // partial file.
+    void write(const std::string& cachePath, uint64_t hash, const Mesh& mesh) const
+    {
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+
+        Header header;
+        header.hash = hash;
+        header.normals = mesh.getNormals().empty() ? 0 : 1;
+        header.vertexCount = mesh.getVertexCount();
+        header.triangleCount = mesh.getTriangleCount();
+        header.nodeCount = mesh.getBVH().getNodes().size();
+        size_t offsets[6];
+        layout(header, offsets);
+
+        std::string temporary = cachePath + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            auto writeAt = [&](int index, const void* data, size_t size)
+            {
+                file.seekp(offsets[index]);
+                file.write(static_cast<const char*>(data), size);
+            };
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            writeAt(0, mesh.getVertices().data(), mesh.getVertices().size() * sizeof(Point3));
+            writeAt(1, mesh.getNormals().data(), mesh.getNormals().size() * sizeof(Vector3));
+            writeAt(2, mesh.getIndices().data(), mesh.getIndices().size() * sizeof(uint32_t));
+            writeAt(3, mesh.getBVH().getNodes().data(), mesh.getBVH().getNodes().size() * sizeof(BVHNode));
+            writeAt(4, mesh.getBVH().getIndices().data(), mesh.getBVH().getIndices().size() * sizeof(uint32_t));
+            file.close();
+            if (file.fail())
+            {
+                std::cerr << "Error: Could not write the mesh cache " << temporary << ", continuing without it" << std::endl;
+                std::remove(temporary.c_str());
+                return;
+            }
+        }
+        if (std::rename(temporary.c_str(), cachePath.c_str()) != 0) std::remove(temporary.c_str());
+    }
+};
@@ -0,0 +1,682 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+
+// Mesh file loaders. A file is mapped, then parsed in parallel straight into vertex and index
+// buffers of their final size, which are moved into the mesh: nothing is allocated per vertex
+// or per triangle, and the geometry is never copied. All the faces get the given material.
+
+// Wavefront OBJ: the v, vn and f statements, other statements being ignored. Polygons are
+// split into triangle fans, and negative indices are relative to the end of the vertex list.
+// Vertex normals are kept when every corner uses the normal of the same index as its
+// vertex, so that they belong to the vertices; otherwise the mesh is shaded flat.
+// The file is split into chunks at line boundaries. A first pass counts the lines and the
+// statements of every chunk, so that the second knows where each chunk writes its vertices
+// and triangles, and which vertex a relative index refers to.
+class ObjLoader
+{
+public:
+    // Chunks of about this many bytes are parsed by one task.
+    static const size_t ChunkSize = 1 << 20;
+
+    bool load(const std::string& path, Mesh& mesh, const std::shared_ptr<TextureMaterial>& material)
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+        {
+            std::cerr << "Error: Could not open file " << path << std::endl;
+            return false;
+        }
+
+        const char* data = file.data();
+        size_t size = file.size();
+        size_t chunkCount = std::max<size_t>(1, size / ChunkSize);
+        std::vector<Chunk> chunks(chunkCount);
+        for (size_t c = 1; c < chunkCount; c++)
+            chunks[c].begin = lineStart(data, size, c * size / chunkCount);
+        for (size_t c = 0; c < chunkCount; c++)
+            chunks[c].end = c + 1 < chunkCount ? chunks[c + 1].begin : size;
+
+        tbb::parallel_for(size_t(0), chunkCount, [&](size_t c) { count(data, chunks[c]); });
+
+        Chunk total;
+        for (Chunk& chunk : chunks)
+        {
+            chunk.lineBase = total.lines;
+            chunk.vertexBase = total.vertices;
+            chunk.normalBase = total.normals;
+            chunk.triangleBase = total.triangles;
+            total.lines += chunk.lines;
+            total.vertices += chunk.vertices;
+            total.normals += chunk.normals;
+            total.triangles += chunk.triangles;
+        }
+        if (total.vertices > UINT32_MAX || 3 * total.triangles > UINT32_MAX)
+        {
+            std::cerr << "Error: " << path << " has too many vertices or triangles" << std::endl;
+            return false;
+        }
+
+        Buffers buffers;
+        buffers.vertices.resize(total.vertices);
+        buffers.normals.resize(total.normals);
+        buffers.indices.resize(3 * total.triangles);
+        tbb::parallel_for(size_t(0), chunkCount, [&](size_t c) { parse(data, chunks[c], buffers); });
+
+        bool normalsMatch = total.normals == total.vertices;
+        for (const Chunk& chunk : chunks)
+        {
+            if (!chunk.error.empty())
+            {
+                std::cerr << "Error: " << path << ":" << chunk.errorLine << ": " << chunk.error << std::endl;
+                return false;
+            }
+            normalsMatch = normalsMatch && chunk.normalsMatch;
+        }
+        if (!normalsMatch) buffers.normals.clear();
+
+        mesh.setGeometry(std::move(buffers.vertices), std::move(buffers.normals), std::move(buffers.indices), material);
+        return true;
+    }
+
+private:
+    enum class Statement { Vertex, Normal, Face, Other };
+
+    struct Chunk
+    {
+        size_t begin = 0;
+        size_t end = 0;
+        size_t lines = 0;
+        size_t vertices = 0;
+        size_t normals = 0;
+        size_t triangles = 0;
+        size_t lineBase = 0;
+        size_t vertexBase = 0;
+        size_t normalBase = 0;
+        size_t triangleBase = 0;
+        bool normalsMatch = true;
+        std::string error; // First error of the chunk, at line errorLine of the file.
+        size_t errorLine = 0;
+    };
+
+    struct Buffers
+    {
+        std::vector<Point3> vertices;
+        std::vector<Vector3> normals;
+        std::vector<uint32_t> indices;
+    };
+
+    static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static inline void skipSpaces(const char*& cursor, const char* end)
+    {
+        while (cursor < end && isSpace(*cursor)) cursor++;
+    }
+
+    // Start of the first line beginning at or after position.
+    static size_t lineStart(const char* data, size_t size, size_t position)
+    {
+        const void* newline = std::memchr(data + position - 1, '\n', size - position + 1);
+        return newline ? static_cast<const char*>(newline) - data + 1 : size;
+    }
+
+    // Calls function(begin, end) on every line of the chunk.
+    template<typename Function>
+    static void forEachLine(const char* data, const Chunk& chunk, Function&& function)
+    {
+        const char* cursor = data + chunk.begin;
+        const char* end = data + chunk.end;
+        while (cursor < end)
+        {
+            const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+            if (!lineEnd) lineEnd = end;
+            if (!function(cursor, lineEnd)) return;
+            cursor = lineEnd + 1;
+        }
+    }
+
+    // Reads the keyword of a line, leaving cursor after it.
+    static Statement statement(const char*& cursor, const char* end)
+    {
+        skipSpaces(cursor, end);
+        const char* keyword = cursor;
+        while (cursor < end && !isSpace(*cursor)) cursor++;
+
+        size_t length = cursor - keyword;
+        if (length == 1 && keyword[0] == 'v') return Statement::Vertex;
+        if (length == 1 && keyword[0] == 'f') return Statement::Face;
+        if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n') return Statement::Normal;
+        return Statement::Other;
+    }
+
+    // Next token of the line, false at its end or at a comment.
+    static inline bool token(const char*& cursor, const char* end, std::string_view& value)
+    {
+        skipSpaces(cursor, end);
+        if (cursor == end || *cursor == '#') return false;
+
+        const char* start = cursor;
+        while (cursor < end && !isSpace(*cursor)) cursor++;
+        value = std::string_view(start, cursor - start);
+        return true;
+    }
+
+    static void count(const char* data, Chunk& chunk)
+    {
+        forEachLine(data, chunk, [&](const char* cursor, const char* end)
+        {
+            chunk.lines++;
+            switch (statement(cursor, end))
+            {
+            case Statement::Vertex: chunk.vertices++; break;
+            case Statement::Normal: chunk.normals++; break;
+            case Statement::Face:
+            {
+                size_t corners = 0;
+                std::string_view corner;
+                while (token(cursor, end, corner)) corners++;
+                if (corners > 2) chunk.triangles += corners - 2;
+                break;
+            }
+            default: break;
+            }
+            return true;
+        });
+    }
+
+    static bool parseVector(const char*& cursor, const char* end, Vector3& value)
+    {
+        Real coordinates[3];
+        for (Real& coordinate : coordinates)
+        {
+            std::string_view text;
+            if (!token(cursor, end, text)) return false;
+            if (text[0] == '+') text.remove_prefix(1);
+            auto result = std::from_chars(text.data(), text.data() + text.size(), coordinate);
+            if (result.ec != std::errc() || result.ptr != text.data() + text.size()) return false;
+        }
+        value = Vector3(coordinates[0], coordinates[1], coordinates[2]);
+        return true;
+    }
+
+    // Resolves a 1-based or negative index among count elements, the first defined so far.
+    static bool parseIndex(std::string_view text, size_t defined, size_t count, uint32_t& index)
+    {
+        int64_t value;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (result.ec != std::errc() || result.ptr != text.data() + text.size() || value == 0) return false;
+
+        int64_t resolved = value > 0 ? value - 1 : static_cast<int64_t>(defined) + value;
+        if (resolved < 0 || resolved >= static_cast<int64_t>(count)) return false;
+        index = static_cast<uint32_t>(resolved);
+        return true;
+    }
+
+    static void parse(const char* data, Chunk& chunk, Buffers& buffers)
+    {
+        size_t line = chunk.lineBase;
+        size_t vertex = chunk.vertexBase;
+        size_t normal = chunk.normalBase;
+        size_t triangle = chunk.triangleBase;
+        auto fail = [&](const char* message)
+        {
+            chunk.error = message;
+            chunk.errorLine = line;
+            return false;
+        };
+
+        forEachLine(data, chunk, [&](const char* cursor, const char* end)
+        {
+            line++;
+            switch (statement(cursor, end))
+            {
+            case Statement::Vertex:
+                if (!parseVector(cursor, end, buffers.vertices[vertex++])) return fail("expected v <x y z>");
+                break;
+            case Statement::Normal:
+                if (!parseVector(cursor, end, buffers.normals[normal++])) return fail("expected vn <x y z>");
+                break;
+            case Statement::Face:
+            {
+                // Corners are v, v/vt, v//vn or v/vt/vn.
+                uint32_t first = 0, previous = 0;
+                int corners = 0;
+                std::string_view corner;
+                while (token(cursor, end, corner))
+                {
+                    size_t slash = corner.find('/');
+                    uint32_t index;
+                    if (!parseIndex(corner.substr(0, slash), vertex, buffers.vertices.size(), index)) return fail("invalid vertex index");
+
+                    size_t normalSlash = slash == std::string_view::npos ? slash : corner.find('/', slash + 1);
+                    uint32_t normalIndex;
+                    if (normalSlash == std::string_view::npos)
+                        chunk.normalsMatch = false;
+                    else if (!parseIndex(corner.substr(normalSlash + 1), normal, buffers.normals.size(), normalIndex))
+                        return fail("invalid normal index");
+                    else if (normalIndex != index)
+                        chunk.normalsMatch = false;
+
+                    if (corners == 0) first = index;
+                    if (corners >= 2)
+                    {
+                        uint32_t* face = &buffers.indices[3 * triangle++];
+                        face[0] = first;
+                        face[1] = previous;
+                        face[2] = index;
+                    }
+                    previous = index;
+                    corners++;
+                }
+                if (corners < 3) return fail("a face needs at least 3 vertices");
+                break;
+            }
+            default: break;
+            }
+            return true;
+        });
+    }
+};
+
+// Binary PLY, little or big-endian: the x, y, z and optional nx, ny, nz properties of the
+// vertex element, and the vertex_indices (or vertex_index) list of the face element. Other
+// properties are skipped, and so are other elements as long as their records have a fixed
+// size. When all the faces are triangles, which is checked first, their records have a
+// fixed size too and are decoded in parallel like the vertices; otherwise the polygons are
+// found by a sequential walk over the records, then split into triangle fans.
+class PlyLoader
+{
+public:
+    bool load(const std::string& path, Mesh& mesh, const std::shared_ptr<TextureMaterial>& material)
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+        {
+            std::cerr << "Error: Could not open file " << path << std::endl;
+            return false;
+        }
+
+        m_path = path;
+        m_data = file.data();
+        m_size = file.size();
+        size_t offset;
+        if (!parseHeader(offset)) return false;
+
+        const Element* vertices = nullptr;
+        const Element* faces = nullptr;
+        size_t vertexOffset = 0, faceOffset = 0;
+        for (const Element& element : m_elements)
+        {
+            if (element.name == "vertex")
+            {
+                vertices = &element;
+                vertexOffset = offset;
+            }
+            else if (element.name == "face")
+            {
+                faces = &element;
+                faceOffset = offset;
+                break; // Face records may have a variable size, the rest is not needed.
+            }
+            if (element.recordSize == 0 && element.count > 0) return fail("element " + element.name + " has a variable size");
+            if (element.count > 0 && element.count > (m_size - offset) / element.recordSize) return fail("the file is truncated");
+            offset += element.count * element.recordSize;
+        }
+        if (!vertices || !faces) return fail("the file has no vertex or no face element");
+        if (vertices->count > UINT32_MAX) return fail("too many vertices");
+
+        std::vector<Point3> positions;
+        std::vector<Vector3> normals;
+        if (!readVertices(*vertices, vertexOffset, positions, normals)) return false;
+
+        std::vector<uint32_t> indices;
+        if (!readFaces(*faces, faceOffset, static_cast<uint32_t>(vertices->count), indices)) return false;
+
+        mesh.setGeometry(std::move(positions), std::move(normals), std::move(indices), material);
+        return true;
+    }
+
+private:
+    enum class Type { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+    struct Property
+    {
+        std::string name;
+        Type type;
+        bool list = false;
+        Type countType = Type::UInt8; // For lists, type is that of the items.
+        size_t offset = 0;            // In the record, for the scalars before any list.
+    };
+
+    struct Element
+    {
+        std::string name;
+        size_t count = 0;
+        std::vector<Property> properties;
+        size_t recordSize = 0; // 0 if the element has a list property.
+    };
+
+    std::string m_path;
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_swap = false; // The file byte order is not that of the machine.
+    std::vector<Element> m_elements;
+
+    bool fail(const std::string& message) const
+    {
+        std::cerr << "Error: " << m_path << ": " << message << std::endl;
+        return false;
+    }
+
+    static size_t typeSize(Type type)
+    {
+        switch (type)
+        {
+        case Type::Int8: case Type::UInt8: return 1;
+        case Type::Int16: case Type::UInt16: return 2;
+        case Type::Int32: case Type::UInt32: case Type::Float32: return 4;
+        default: return 8;
+        }
+    }
+
+    static bool parseType(std::string_view name, Type& type)
+    {
+        if (name == "char" || name == "int8") type = Type::Int8;
+        else if (name == "uchar" || name == "uint8") type = Type::UInt8;
+        else if (name == "short" || name == "int16") type = Type::Int16;
+        else if (name == "ushort" || name == "uint16") type = Type::UInt16;
+        else if (name == "int" || name == "int32") type = Type::Int32;
+        else if (name == "uint" || name == "uint32") type = Type::UInt32;
+        else if (name == "float" || name == "float32") type = Type::Float32;
+        else if (name == "double" || name == "float64") type = Type::Float64;
+        else return false;
+        return true;
+    }
+
+    template<typename T>
+    inline T read(const char* p) const
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, p, sizeof(T));
+        if (m_swap) std::reverse(bytes, bytes + sizeof(T));
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    inline T value(const char* p, Type type) const
+    {
+        switch (type)
+        {
+        case Type::Int8: return static_cast<T>(read<int8_t>(p));
+        case Type::UInt8: return static_cast<T>(read<uint8_t>(p));
+        case Type::Int16: return static_cast<T>(read<int16_t>(p));
+        case Type::UInt16: return static_cast<T>(read<uint16_t>(p));
+        case Type::Int32: return static_cast<T>(read<int32_t>(p));
+        case Type::UInt32: return static_cast<T>(read<uint32_t>(p));
+        case Type::Float32: return static_cast<T>(read<float>(p));
+        default: return static_cast<T>(read<double>(p));
+        }
+    }
+
+    bool parseHeader(size_t& dataOffset)
+    {
+        m_elements.clear();
+        size_t position = 0;
+        bool format = false;
+        for (int line = 0;; line++)
+        {
+            const void* newline = std::memchr(m_data + position, '\n', m_size - position);
+            if (!newline) return fail("the header is not terminated");
+            size_t lineEnd = static_cast<const char*>(newline) - m_data;
+
+            std::vector<std::string_view> tokens;
+            for (size_t p = position; p < lineEnd;)
+            {
+                while (p < lineEnd && (m_data[p] == ' ' || m_data[p] == '\t' || m_data[p] == '\r')) p++;
+                size_t start = p;
+                while (p < lineEnd && m_data[p] != ' ' && m_data[p] != '\t' && m_data[p] != '\r') p++;
+                if (p > start) tokens.emplace_back(m_data + start, p - start);
+            }
+            position = lineEnd + 1;
+
+            if (line == 0)
+            {
+                if (tokens.size() != 1 || tokens[0] != "ply") return fail("not a PLY file");
+                continue;
+            }
+            if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info") continue;
+
+            if (tokens[0] == "end_header")
+            {
+                if (!format) return fail("the header has no format");
+                dataOffset = position;
+                return true;
+            }
+            if (tokens[0] == "format" && tokens.size() == 3)
+            {
+                bool little;
+                if (tokens[1] == "binary_little_endian") little = true;
+                else if (tokens[1] == "binary_big_endian") little = false;
+                else return fail("only binary PLY files are supported, not " + std::string(tokens[1]));
+                m_swap = little != (std::endian::native == std::endian::little);
+                format = true;
+            }
+            else if (tokens[0] == "element" && tokens.size() == 3)
+            {
+                Element element;
+                element.name = tokens[1];
+                auto result = std::from_chars(tokens[2].data(), tokens[2].data() + tokens[2].size(), element.count);
+                if (result.ec != std::errc()) return fail("invalid element count " + std::string(tokens[2]));
+                m_elements.push_back(element);
+            }
+            else if (tokens[0] == "property" && !m_elements.empty())
+            {
+                Element& element = m_elements.back();
+                Property property;
+                if (tokens.size() == 5 && tokens[1] == "list")
+                {
+                    property.list = true;
+                    if (!parseType(tokens[2], property.countType) || !parseType(tokens[3], property.type))
+                        return fail("invalid property type");
+                    property.name = tokens[4];
+                }
+                else if (tokens.size() == 3)
+                {
+                    if (!parseType(tokens[1], property.type)) return fail("invalid property type " + std::string(tokens[1]));
+                    property.name = tokens[2];
+                }
+                else
+                {
+                    return fail("invalid property");
+                }
+
+                // Offsets, and the record size, are only known up to the first list.
+                bool fixed = std::none_of(element.properties.begin(), element.properties.end(), [](const Property& p) { return p.list; });
+                if (fixed && !property.list)
+                {
+                    property.offset = element.recordSize;
+                    element.recordSize += typeSize(property.type);
+                }
+                if (property.list) element.recordSize = 0;
+                element.properties.push_back(property);
+            }
+            else
+            {
+                return fail("invalid header line " + std::to_string(line + 1));
+            }
+        }
+    }
+
+    const Property* findProperty(const Element& element, std::string_view name) const
+    {
+        for (const Property& property : element.properties)
+        {
+            if (property.name == name) return &property;
+        }
+        return nullptr;
+    }
+
+    bool readVertices(const Element& element, size_t offset, std::vector<Point3>& positions, std::vector<Vector3>& normals) const
+    {
+        const Property* axes[3] = { findProperty(element, "x"), findProperty(element, "y"), findProperty(element, "z") };
+        const Property* normalAxes[3] = { findProperty(element, "nx"), findProperty(element, "ny"), findProperty(element, "nz") };
+        if (!axes[0] || !axes[1] || !axes[2] || element.recordSize == 0) return fail("the vertices need x, y and z and no list");
+        bool hasNormals = normalAxes[0] && normalAxes[1] && normalAxes[2];
+
+        positions.resize(element.count);
+        if (hasNormals) normals.resize(element.count);
+        const char* records = m_data + offset;
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, element.count, 1 << 14), [&](const tbb::blocked_range<size_t>& range)
+        {
+            for (size_t i = range.begin(); i < range.end(); i++)
+            {
+                const char* record = records + i * element.recordSize;
+                positions[i] = Point3(value<Real>(record + axes[0]->offset, axes[0]->type), value<Real>(record + axes[1]->offset, axes[1]->type),
+                    value<Real>(record + axes[2]->offset, axes[2]->type));
+                if (hasNormals)
+                {
+                    normals[i] = Vector3(value<Real>(record + normalAxes[0]->offset, normalAxes[0]->type),
+                        value<Real>(record + normalAxes[1]->offset, normalAxes[1]->type), value<Real>(record + normalAxes[2]->offset, normalAxes[2]->type));
+                }
+            }
+        });
+        return true;
+    }
+
+    bool readFaces(const Element& element, size_t offset, uint32_t vertexCount, std::vector<uint32_t>& indices) const
+    {
+        // Layout of a record: scalars before the list, the list, scalars after it.
+        size_t list = element.properties.size();
+        size_t before = 0, after = 0;
+        for (size_t p = 0; p < element.properties.size(); p++)
+        {
+            const Property& property = element.properties[p];
+            if (property.list)
+            {
+                if (list != element.properties.size()) return fail("the faces have more than one list");
+                if (property.name != "vertex_indices" && property.name != "vertex_index") return fail("the faces have no vertex_indices list");
+                list = p;
+            }
+            else
+            {
+                (list == element.properties.size() ? before : after) += typeSize(property.type);
+            }
+        }
+        if (list == element.properties.size()) return fail("the faces have no vertex_indices list");
+
+        const Property& property = element.properties[list];
+        size_t countSize = typeSize(property.countType);
+        size_t indexSize = typeSize(property.type);
+        const char* records = m_data + offset;
+        size_t available = m_size - offset;
+
+        // Fast path: all triangles, fixed records.
+        size_t triangleSize = before + countSize + 3 * indexSize + after;
+        std::atomic<bool> triangles = element.count <= available / triangleSize;
+        if (triangles)
+        {
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, element.count, 1 << 14), [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t f = range.begin(); f < range.end() && triangles.load(std::memory_order_relaxed); f++)
+                {
+                    if (value<int64_t>(records + f * triangleSize + before, property.countType) != 3) triangles = false;
+                }
+            });
+        }
+
+        std::atomic<bool> valid = true;
+        auto readIndex = [&](const char* p, uint32_t& index)
+        {
+            int64_t item = value<int64_t>(p, property.type);
+            if (item < 0 || item >= vertexCount) valid = false;
+            index = static_cast<uint32_t>(item);
+        };
+
+        if (triangles)
+        {
+            indices.resize(3 * element.count);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, element.count, 1 << 14), [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t f = range.begin(); f < range.end(); f++)
+                {
+                    const char* items = records + f * triangleSize + before + countSize;
+                    for (int k = 0; k < 3; k++)
+                        readIndex(items + k * indexSize, indices[3 * f + k]);
+                }
+            });
+        }
+        else
+        {
+            // Counts the triangles, checking that the records fit in the file, then splits
+            // the polygons.
+            size_t triangleCount = 0;
+            size_t position = 0;
+            for (size_t f = 0; f < element.count; f++)
+            {
+                if (available - position < before + countSize) return fail("the file is truncated");
+                int64_t corners = value<int64_t>(records + position + before, property.countType);
+                if (corners < 3) return fail("a face has less than 3 vertices");
+                position += before + countSize + corners * indexSize + after;
+                if (position > available) return fail("the file is truncated");
+                triangleCount += corners - 2;
+            }
+            if (3 * triangleCount > UINT32_MAX) return fail("too many triangles");
+
+            indices.resize(3 * triangleCount);
+            position = 0;
+            size_t triangle = 0;
+            for (size_t f = 0; f < element.count; f++)
+            {
+                int64_t corners = value<int64_t>(records + position + before, property.countType);
+                const char* items = records + position + before + countSize;
+                uint32_t first, previous, index;
+                readIndex(items, first);
+                readIndex(items + indexSize, previous);
+                for (int64_t k = 2; k < corners; k++)
+                {
+                    readIndex(items + k * indexSize, index);
+                    indices[3 * triangle] = first;
+                    indices[3 * triangle + 1] = previous;
+                    indices[3 * triangle + 2] = index;
+                    triangle++;
+                    previous = index;
+                }
+                position += before + countSize + corners * indexSize + after;
+            }
+        }
+
+        if (!valid) return fail("a face has a vertex index out of range");
+        return true;
+    }
+};
+
+// Loads an OBJ or a binary PLY file, by its extension, into mesh.
+inline bool loadMesh(const std::string& path, Mesh& mesh, const std::shared_ptr<TextureMaterial>& material)
+{
+    std::string extension = path.substr(std::min(path.size(), path.rfind('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == ".obj") return ObjLoader().load(path, mesh, material);
+    if (extension == ".ply") return PlyLoader().load(path, mesh, material);
+
+    std::cerr << "Error: Unknown mesh format " << path << ", expected .obj or .ply" << std::endl;
+    return false;
+}
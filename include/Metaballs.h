@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "AABB.h"
+
+// Sum of metaballs, a ball of center c, radius R and weight w having the density
+// w * (1 - |p - c|^2 / R^2)^3 inside its radius and 0 beyond. The kernel and its derivative
+// vanish at R, so the balls blend smoothly, and a ball only influences the points within R.
+// build() sorts the balls into a uniform grid of cells listing the balls that reach them,
+// so that the density at a point only visits the balls near it.
+class MetaballField
+{
+public:
+    MetaballField() = default;
+
+    void addBall(const Point3& center, Real radius, Real weight = 1)
+    {
+        m_balls.push_back(Ball{ center, radius, 1 / (radius * radius), weight, { 0, 0, 0 } });
+        m_cellStarts.clear();
+    }
+
+    // Builds the grid over the balls, with cells of edge cellSize or, by default, of the
+    // largest radius. Must be called after the last addBall and before any query.
+    void build(Real cellSize = 0)
+    {
+        m_bounds = AABB();
+        m_cellStarts.clear();
+        m_cellBalls.clear();
+        if (m_balls.empty()) return;
+
+        Real maxRadius = 0;
+        for (const auto& ball : m_balls)
+        {
+            m_bounds.grow(ballBounds(ball));
+            maxRadius = std::max(maxRadius, ball.radius);
+        }
+
+        m_cellSize = cellSize > 0 ? cellSize : maxRadius;
+        Vector3 extent = m_bounds.extent();
+        for (int axis = 0; axis < 3; axis++)
+            m_cellCounts[axis] = std::max(1, static_cast<int>(std::ceil(extent[axis] / m_cellSize)));
+
+        // Counting sort of the balls into the cells their bounds overlap.
+        size_t cellCount = static_cast<size_t>(m_cellCounts[0]) * m_cellCounts[1] * m_cellCounts[2];
+        m_cellStarts.assign(cellCount + 1, 0);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (uint32_t b = 0; b < m_balls.size(); b++)
+            {
+                int lo[3], hi[3];
+                cellRange(ballBounds(m_balls[b]), lo, hi);
+                if (pass == 0)
+                {
+                    for (int axis = 0; axis < 3; axis++)
+                        m_balls[b].cellMin[axis] = lo[axis];
+                }
+
+                for (int z = lo[2]; z <= hi[2]; z++)
+                {
+                    for (int y = lo[1]; y <= hi[1]; y++)
+                    {
+                        for (int x = lo[0]; x <= hi[0]; x++)
+                        {
+                            size_t cell = cellIndex(x, y, z);
+                            if (pass == 0)
+                                m_cellStarts[cell + 1]++;
+                            else
+                                m_cellBalls[m_cellStarts[cell]++] = b;
+                        }
+                    }
+                }
+            }
+
+            if (pass == 0)
+            {
+                for (size_t cell = 0; cell < cellCount; cell++)
+                    m_cellStarts[cell + 1] += m_cellStarts[cell];
+                m_cellBalls.resize(m_cellStarts[cellCount]);
+            }
+            else
+            {
+                // The second pass moved every start to the start of the next cell.
+                for (size_t cell = cellCount; cell > 0; cell--)
+                    m_cellStarts[cell] = m_cellStarts[cell - 1];
+                m_cellStarts[0] = 0;
+            }
+        }
+
+        m_lipschitz = 0;
+        for (size_t cell = 0; cell < cellCount; cell++)
+        {
+            Real bound = 0;
+            for (uint32_t k = m_cellStarts[cell]; k < m_cellStarts[cell + 1]; k++)
+                bound += ballLipschitz(m_balls[m_cellBalls[k]]);
+            m_lipschitz = std::max(m_lipschitz, bound);
+        }
+    }
+
+    Real density(const Point3& p) const
+    {
+        int cell[3];
+        if (!cellOf(p, cell)) return 0;
+
+        Real sum = 0;
+        size_t index = cellIndex(cell[0], cell[1], cell[2]);
+        for (uint32_t k = m_cellStarts[index]; k < m_cellStarts[index + 1]; k++)
+        {
+            const Ball& ball = m_balls[m_cellBalls[k]];
+            sum += ball.weight * kernel((p - ball.center).LengthSquared() * ball.invRadiusSquared);
+        }
+        return sum;
+    }
+
+    Vector3 gradient(const Point3& p) const
+    {
+        int cell[3];
+        if (!cellOf(p, cell)) return Vector3(0, 0, 0);
+
+        Vector3 sum(0, 0, 0);
+        size_t index = cellIndex(cell[0], cell[1], cell[2]);
+        for (uint32_t k = m_cellStarts[index]; k < m_cellStarts[index + 1]; k++)
+        {
+            const Ball& ball = m_balls[m_cellBalls[k]];
+            Vector3 offset = p - ball.center;
+            Real x = 1 - offset.LengthSquared() * ball.invRadiusSquared;
+            if (x > 0) sum += (-6 * ball.weight * x * x * ball.invRadiusSquared) * offset;
+        }
+        return sum;
+    }
+
+    // Bounds of the density over box: every ball contributes between its density at the
+    // nearest and at the farthest point of the box from its center.
+    void densityRange(const AABB& box, Real& min, Real& max) const
+    {
+        min = 0;
+        max = 0;
+        forEachBall(box, [&](const Ball& ball)
+        {
+            Real nearest = ball.weight * kernel(box.distanceSquared(ball.center) * ball.invRadiusSquared);
+            Real farthest = ball.weight * kernel(box.farthestDistanceSquared(ball.center) * ball.invRadiusSquared);
+            min += std::min(nearest, farthest);
+            max += std::max(nearest, farthest);
+        });
+    }
+
+    // Lipschitz constant of the density over box: |density(p) - density(q)| <= L * |p - q|
+    // for p and q in box. It is the sum of the bounds of the balls reaching the box.
+    Real lipschitzBound(const AABB& box) const
+    {
+        Real bound = 0;
+        forEachBall(box, [&](const Ball& ball)
+        {
+            if (box.distanceSquared(ball.center) < ball.radius * ball.radius)
+                bound += ballLipschitz(ball);
+        });
+        return bound;
+    }
+
+    // Lipschitz constant of the density over the whole space, see lipschitzBound.
+    inline Real lipschitzBound() const { return m_lipschitz; }
+
+    // The density is 0 outside of these bounds.
+    inline const AABB& boundingBox() const { return m_bounds; }
+    inline size_t size() const { return m_balls.size(); }
+
+private:
+    struct Ball
+    {
+        Point3 center;
+        Real radius;
+        Real invRadiusSquared;
+        Real weight;
+        int cellMin[3]; // First grid cell the ball overlaps.
+    };
+
+    std::vector<Ball> m_balls;
+    AABB m_bounds;
+    Real m_cellSize = 1;
+    int m_cellCounts[3] = { 0, 0, 0 };
+    std::vector<uint32_t> m_cellStarts; // Balls of cell c are m_cellBalls[m_cellStarts[c]...m_cellStarts[c + 1]).
+    std::vector<uint32_t> m_cellBalls;
+    Real m_lipschitz = 0;
+
+    // Kernel of the squared distance divided by the squared radius.
+    static inline Real kernel(Real x)
+    {
+        if (x >= 1) return 0;
+        Real y = 1 - x;
+        return y * y * y;
+    }
+
+    // The kernel falls the fastest at r = R / sqrt(5), where its slope is
+    // 96 / (25 sqrt(5) R).
+    static inline Real ballLipschitz(const Ball& ball)
+    {
+        return std::abs(ball.weight) * Real(1.7173) / ball.radius;
+    }
+
+    static AABB ballBounds(const Ball& ball)
+    {
+        Vector3 r(ball.radius, ball.radius, ball.radius);
+        return AABB(ball.center - r, ball.center + r);
+    }
+
+    inline size_t cellIndex(int x, int y, int z) const
+    {
+        return (static_cast<size_t>(z) * m_cellCounts[1] + y) * m_cellCounts[0] + x;
+    }
+
+    inline int cellCoordinate(Real value, int axis) const
+    {
+        int c = static_cast<int>(std::floor((value - m_bounds.getMin()[axis]) / m_cellSize));
+        return std::clamp(c, 0, m_cellCounts[axis] - 1);
+    }
+
+    bool cellOf(const Point3& p, int cell[3]) const
+    {
+        if (m_cellStarts.empty()) return false;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (p[axis] < m_bounds.getMin()[axis] || p[axis] > m_bounds.getMax()[axis]) return false;
+            cell[axis] = cellCoordinate(p[axis], axis);
+        }
+        return true;
+    }
+
+    // Calls function once for every ball listed in the cells overlapped by box.
+    template<typename Function>
+    void forEachBall(const AABB& box, Function&& function) const
+    {
+        int lo[3], hi[3];
+        if (m_cellStarts.empty() || !cellRange(box, lo, hi)) return;
+
+        for (int z = lo[2]; z <= hi[2]; z++)
+        {
+            for (int y = lo[1]; y <= hi[1]; y++)
+            {
+                for (int x = lo[0]; x <= hi[0]; x++)
+                {
+                    size_t index = cellIndex(x, y, z);
+                    for (uint32_t k = m_cellStarts[index]; k < m_cellStarts[index + 1]; k++)
+                    {
+                        // A ball is listed in all the cells it overlaps, it is visited in the
+                        // first of them within the box only.
+                        const Ball& ball = m_balls[m_cellBalls[k]];
+                        if (x == std::max(lo[0], ball.cellMin[0]) && y == std::max(lo[1], ball.cellMin[1]) && z == std::max(lo[2], ball.cellMin[2]))
+                            function(ball);
+                    }
+                }
+            }
+        }
+    }
+
+    // Cells overlapped by box, false if it misses the grid.
+    bool cellRange(const AABB& box, int lo[3], int hi[3]) const
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (box.getMax()[axis] < m_bounds.getMin()[axis] || box.getMin()[axis] > m_bounds.getMax()[axis]) return false;
+            lo[axis] = cellCoordinate(box.getMin()[axis], axis);
+            hi[axis] = cellCoordinate(box.getMax()[axis], axis);
+        }
+        return true;
+    }
+};
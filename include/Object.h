@@ -2,24 +2,9 @@
 
 #include "Vector.h"
 #include "Ray.h"
-
-class TextureMaterial;
-
-struct hit_record
-{
-    Point3 p;
-    Vector3 normal;
-    double t;
-    bool front_face;
-
-    inline void set_face_normal(const Ray& ray, const Vector3& outward_normal)
-    {
-        front_face = Dot(ray.direction(), outward_normal) < 0;
-        normal = front_face ? outward_normal : -outward_normal;
-    }
-
-    std::shared_ptr<TextureMaterial> textureMaterial;
-};
+#include "AABB.h"
+#include "HitRecord.h"
+#include "RayPacket.h"
 
 class Object
 {
@@ -28,44 +13,182 @@ public:
 
     virtual ~Object() = default;
 
-    virtual bool intersects(const Ray& ray, double t_min, double t_max, hit_record& record) const = 0;
+    // Closest hit within [t_min, t_max]: sets t (and u, v) and the primitive hit in
+    // record.object, leaving the rest of record to record.object->completeHit. record is
+    // only written when the ray hits.
+    virtual bool intersects(const Ray& ray, Real t_min, Real t_max, hit_record& record) const = 0;
+
+    // Any-hit query: returns true if something lies on the ray within [t_min, t_max],
+    // without looking for the closest hit nor filling a hit_record.
+    virtual bool occluded(const Ray& ray, Real t_min, Real t_max) const = 0;
 
     virtual Vector3 normalAt(const Point3& point, const Ray& ray, hit_record& record) const = 0;
+
+    virtual AABB boundingBox() const = 0;
+
+    // Prepares internal acceleration structures, called by Scene::build before rendering.
+    virtual void build() {}
+
+    // Fills p, normal and material of a hit whose t (and u, v) were found by this object.
+    // Called once per ray, on the closest hit only, see Scene::intersects.
+    virtual void completeHit(const Ray& /* ray */, hit_record& /* record */) const {}
+
+    // Packet version of intersects: for every lane set in active, records a hit in hit when
+    // the object is hit closer than hit.t. The default runs the scalar query lane by lane.
+    virtual void intersectsPacket(const RayPacket& packet, SimdReal active, Real t_min, PacketHit& hit) const
+    {
+        Real t_max[PacketWidth];
+        hit.t.store(t_max);
+
+        int bits = active.bits();
+        for (int lane = 0; lane < PacketWidth; lane++)
+        {
+            if (!(bits & (1 << lane))) continue;
+
+            hit_record record;
+            if (intersects(packet.getRay(lane), t_min, t_max[lane], record))
+            {
+                t_max[lane] = record.t;
+                hit.u[lane] = record.u;
+                hit.v[lane] = record.v;
+                hit.object[lane] = record.object;
+                hit.primitive[lane] = record.primitive;
+                hit.hit[lane] = true;
+            }
+        }
+
+        hit.t = SimdReal::load(t_max);
+    }
+
+    // Packet version of occluded, returns the mask of the active lanes that are occluded.
+    virtual SimdReal occludedPacket(const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max) const
+    {
+        int bits = active.bits();
+        int occludedBits = 0;
+        for (int lane = 0; lane < PacketWidth; lane++)
+        {
+            if ((bits & (1 << lane)) && occluded(packet.getRay(lane), t_min, Lane(t_max, lane)))
+                occludedBits |= 1 << lane;
+        }
+        return MaskFromBits<SimdReal>(occludedBits);
+    }
 };
 
 class Sphere : public Object
 {
 public:
-    Sphere(const Point3& center, double radius, std::shared_ptr<TextureMaterial> material)
+    Sphere(const Point3& center, Real radius, std::shared_ptr<TextureMaterial> material)
         : m_center(center)
         , m_radius(radius)
         , m_textureMaterial(material)
     {}
 
-    virtual bool intersects(const Ray& ray, double t_min, double t_max, hit_record& record) const override
+    virtual bool intersects(const Ray& ray, Real t_min, Real t_max, hit_record& record) const override
     {
-        Vector3 oc = ray.origin() - m_center;
-        double a = ray.direction().LengthSquared();
-        double half_b = Dot(oc, ray.direction());
-        double c = oc.LengthSquared() - m_radius * m_radius;
-        double discriminant = half_b * half_b - a * c;
-        if (discriminant < 0)
+        Real t;
+        if (!intersectsDistance(m_center, m_radius, ray, t_min, t_max, t))
+            return false;
+
+        record.t = t;
+        record.object = this;
+
+        return true;
+    }
+
+    virtual void completeHit(const Ray& ray, hit_record& record) const override
+    {
+        record.p = ray.at(record.t);
+        record.normal = normalAt(record.p, ray, record);
+        record.textureMaterial = m_textureMaterial.get();
+    }
+
+    // Same computation as intersectsDistance on every lane. Returns the mask of the lanes
+    // hitting the sphere within [t_min, t_max] and their distance in t.
+    static inline SimdReal intersectsPacketDistance(const Point3& center, Real radius, const RayPacket& packet, SimdReal active, SimdReal t_min, SimdReal t_max, SimdReal& t)
+    {
+        SimdReal ocx = packet.ox - SimdReal(center.getX());
+        SimdReal ocy = packet.oy - SimdReal(center.getY());
+        SimdReal ocz = packet.oz - SimdReal(center.getZ());
+        SimdReal a = packet.dx * packet.dx + packet.dy * packet.dy + packet.dz * packet.dz;
+        SimdReal half_b = ocx * packet.dx + ocy * packet.dy + ocz * packet.dz;
+        SimdReal k = half_b / a;
+        SimdReal lx = ocx - packet.dx * k;
+        SimdReal ly = ocy - packet.dy * k;
+        SimdReal lz = ocz - packet.dz * k;
+        SimdReal discriminant = a * (SimdReal(radius * radius) - (lx * lx + ly * ly + lz * lz));
+        SimdReal mask = active & (discriminant >= SimdReal(0.0));
+        if (!Any(mask)) return mask;
+
+        SimdReal sqrtd = Sqrt(Max(discriminant, SimdReal(0.0)));
+        SimdReal near = (-half_b - sqrtd) / a;
+        SimdReal far = (-half_b + sqrtd) / a;
+        SimdReal nearValid = (near >= t_min) & (near <= t_max);
+        SimdReal farValid = (far >= t_min) & (far <= t_max);
+
+        t = Select(nearValid, near, far);
+        return mask & (nearValid | farValid);
+    }
+
+    virtual void intersectsPacket(const RayPacket& packet, SimdReal active, Real t_min, PacketHit& hit) const override
+    {
+        SimdReal t;
+        SimdReal mask = intersectsPacketDistance(m_center, m_radius, packet, active, SimdReal(t_min), hit.t, t);
+        if (Any(mask)) hit.update(mask, t, SimdReal(0.0), SimdReal(0.0), this);
+    }
+
+    virtual SimdReal occludedPacket(const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max) const override
+    {
+        SimdReal t;
+        return intersectsPacketDistance(m_center, m_radius, packet, active, SimdReal(t_min), t_max, t);
+    }
+
+    virtual bool occluded(const Ray& ray, Real t_min, Real t_max) const override
+    {
+        Real t;
+        return intersectsDistance(m_center, m_radius, ray, t_min, t_max, t);
+    }
+
+    // Sphere kernels, shared with the sphere arrays of Scene.
+
+    // Distance in t of the first intersection of the ray with the sphere within
+    // [t_min, t_max]. Returns false when there is none.
+    static inline bool intersectsDistance(const Point3& center, Real radius, const Ray& ray, Real t_min, Real t_max, Real& t)
+    {
+        Real near, far;
+        if (!intersectsDistances(center, radius, ray, near, far))
             return false;
 
-        double sqrtd = sqrt(discriminant);
-        double root = (-half_b - sqrtd) / a;
-        if (root < t_min || t_max < root)
+        t = near;
+        if (t < t_min || t_max < t)
         {
-            root = (-half_b + sqrtd) / a;
-            if (root < t_min || t_max < root)
+            t = far;
+            if (t < t_min || t_max < t)
                 return false;
         }
+        return true;
+    }
 
-        record.t = root;
-        record.p = ray.at(record.t);
-        record.normal = normalAt(record.p, ray, record);
-        record.textureMaterial = m_textureMaterial;
+    // Distances along the ray of its two intersections with the sphere, near <= far.
+    // Returns false when the ray misses the sphere.
+    static inline bool intersectsDistances(const Point3& center, Real radius, const Ray& ray, Real& near, Real& far)
+    {
+        Vector3 oc = ray.origin() - center;
+        Vector3 d = ray.direction();
+        Real a = d.LengthSquared();
+        Real half_b = Dot(oc, d);
+
+        // half_b^2 - a * c cancels catastrophically when the sphere is large compared to its
+        // distance to the ray, which float cannot afford. a * (r^2 - |l|^2), l being the
+        // point of the ray closest to the center, is the same value without the cancellation.
+        // Haines et al., "Precision Improvements for Ray/Sphere Intersection", Ray Tracing Gems.
+        Vector3 l = oc - d * (half_b / a);
+        Real discriminant = a * (radius * radius - l.LengthSquared());
+        if (discriminant < 0)
+            return false;
 
+        Real sqrtd = std::sqrt(discriminant);
+        near = (-half_b - sqrtd) / a;
+        far = (-half_b + sqrtd) / a;
         return true;
     }
 
@@ -76,9 +199,24 @@ public:
         return record.normal;
     }
 
+    virtual AABB boundingBox() const override
+    {
+        return bounds(m_center, m_radius);
+    }
+
+    static inline AABB bounds(const Point3& center, Real radius)
+    {
+        Real r = std::fabs(radius);
+        return AABB(center - Vector3(r, r, r), center + Vector3(r, r, r));
+    }
+
+    inline const Point3& getCenter() const { return m_center; }
+    inline Real getRadius() const { return m_radius; }
+    inline const std::shared_ptr<TextureMaterial>& getMaterial() const { return m_textureMaterial; }
+
 private:
     Point3 m_center;
-    double m_radius;
+    Real m_radius;
     std::shared_ptr<TextureMaterial> m_textureMaterial;
 };
 
@@ -89,86 +227,161 @@ public:
         : m_p0(p0), m_p1(p1), m_p2(p2)
         {
             m_textureMaterial = material;
+            precompute();
         }
-    
-    // See: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/ray-triangle-intersection-geometric-solution.html
-    virtual bool intersects(const Ray& ray, double t_min, double t_max, hit_record& record) const override
-    {
-        // Plane equation: Ax + By + Cz + D = 0
-        // N = (A, B, C)
-        // D = -Dot(N, P0) // P0 is a point on the plane
-        // t = -(Dot(N, P0) + D) / Dot(N, RD)
-        // P = O + t * RD
-
-        Vector3 u = m_p1 - m_p0;
-        Vector3 v = m_p2 - m_p0;
-        Vector3 N = Cross(u, v);
-        double NsRD = Dot(N, ray.direction());
-        if (NsRD == 0) return false; // ray is parallel to triangle
-
-        double D = -Dot(N, m_p0);
-
-        /*
-        P = O + t * RD
-        Ax + By + Cz + D = 0
-        A*Px + B*Py + C*Pz + D = 0
-        A*(Ox + t * RDx) + B*(Oy + t * RDy) + C*(Oz + t * RDz) + D = 0
-        A*Ox + A*t * RDx + B*Oy + B*t * RDy + C*Oz + C*t * RDz + D = 0
-        A*Ox + B*Oy + C*Oz + D + A*t * RDx + B*t * RDy + C*t * RDz = 0
-        t*(A*RDx + B*RDy + C*RDz) = -(A*Ox + B*Oy + C*Oz + D)
-        t = -(A*Ox + B*Oy + C*Oz + D) / (A*RDx + B*RDy + C*RDz)
-        t = -(Dot(N, O) + D) / Dot(N, RD)
-        */
-        double t = -(Dot(N, ray.origin()) + D) / NsRD;
-
-        if (t < t_min || t > t_max) return false;
-
-        Point3 P = ray.at(t);
-        Vector3 C;
-
-        Vector3 edge0 = m_p1 - m_p0;
-        Vector3 vp0 = P - m_p0;
-        C = Cross(edge0, vp0);
-        if (Dot(N, C) < 0) return false;
-
-        Vector3 edge1 = m_p2 - m_p1;
-        Vector3 vp1 = P - m_p1;
-        C = Cross(edge1, vp1);
-        if (Dot(N, C) < 0) return false;
-
-        Vector3 edge2 = m_p0 - m_p2;
-        Vector3 vp2 = P - m_p2;
-        C = Cross(edge2, vp2);
-        if (Dot(N, C) < 0) return false;
+
+    // Moller-Trumbore intersection on the precomputed edges, Real-sided.
+    // See: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection.html
+    virtual bool intersects(const Ray& ray, Real t_min, Real t_max, hit_record& record) const override
+    {
+        Real t, u, v;
+        if (!intersectsBarycentric(ray, t_min, t_max, t, u, v)) return false;
 
         record.t = t;
-        record.p = P;
-        record.normal = normalAt(P, ray, record);
-        record.textureMaterial = m_textureMaterial;
+        record.u = u;
+        record.v = v;
+        record.object = this;
 
         return true;
     }
 
-    virtual Vector3 normalAt(const Point3& point, const Ray& ray, hit_record& record) const override
+    virtual void completeHit(const Ray& ray, hit_record& record) const override
     {
-        Vector3 u = m_p1 - m_p0;
-        Vector3 v = m_p2 - m_p0;
-        Vector3 outward_normal = Cross(u, v);
-        record.set_face_normal(ray, outward_normal);
-        return outward_normal;
+        record.p = ray.at(record.t);
+        record.normal = normalAt(record.p, ray, record);
+        record.textureMaterial = m_textureMaterial.get();
+    }
+
+    virtual bool occluded(const Ray& ray, Real t_min, Real t_max) const override
+    {
+        Real t, u, v;
+        return intersectsBarycentric(ray, t_min, t_max, t, u, v);
+    }
+
+    inline bool intersectsBarycentric(const Ray& ray, Real t_min, Real t_max, Real& t, Real& u, Real& v) const
+    {
+        return intersectsBarycentric(m_p0, m_e1, m_e2, ray, t_min, t_max, t, u, v);
+    }
+
+    // Triangle kernels on the first vertex and the two edges from it, shared with Mesh.
+
+    // Solves O + t * D = (1 - u - v) * P0 + u * P1 + v * P2 for (t, u, v) by Cramer's rule.
+    static inline bool intersectsBarycentric(const Point3& p0, const Vector3& e1, const Vector3& e2, const Ray& ray, Real t_min, Real t_max, Real& t, Real& u, Real& v)
+    {
+        Vector3 direction = ray.direction();
+        Vector3 pvec = Cross(direction, e2);
+        Real det = Dot(e1, pvec);
+        if (det == 0) return false; // ray is parallel to triangle
+
+        Real invDet = 1 / det;
+        Vector3 tvec = ray.origin() - p0;
+        u = Dot(tvec, pvec) * invDet;
+        if (u < 0 || u > 1) return false;
+
+        Vector3 qvec = Cross(tvec, e1);
+        v = Dot(direction, qvec) * invDet;
+        if (v < 0 || u + v > 1) return false;
+
+        t = Dot(e2, qvec) * invDet;
+        return t >= t_min && t <= t_max;
+    }
+
+    // Same computation as intersectsBarycentric on every lane. Returns the mask of the lanes
+    // hitting the triangle within [t_min, t_max].
+    static inline SimdReal intersectsPacketBarycentric(const Point3& p0, const Vector3& e1, const Vector3& e2, const RayPacket& packet, SimdReal active, SimdReal t_min, SimdReal t_max, SimdReal& t, SimdReal& u, SimdReal& v)
+    {
+        SimdReal e1x(e1.getX()), e1y(e1.getY()), e1z(e1.getZ());
+        SimdReal e2x(e2.getX()), e2y(e2.getY()), e2z(e2.getZ());
+
+        SimdReal px = packet.dy * e2z - packet.dz * e2y;
+        SimdReal py = packet.dz * e2x - packet.dx * e2z;
+        SimdReal pz = packet.dx * e2y - packet.dy * e2x;
+        SimdReal det = e1x * px + e1y * py + e1z * pz;
+        SimdReal mask = active & (det != SimdReal(0.0));
+        if (!Any(mask)) return mask;
+
+        SimdReal invDet = SimdReal(1.0) / det;
+        SimdReal tx = packet.ox - SimdReal(p0.getX());
+        SimdReal ty = packet.oy - SimdReal(p0.getY());
+        SimdReal tz = packet.oz - SimdReal(p0.getZ());
+        u = (tx * px + ty * py + tz * pz) * invDet;
+        mask = mask & (u >= SimdReal(0.0)) & (u <= SimdReal(1.0));
+        if (!Any(mask)) return mask;
+
+        SimdReal qx = ty * e1z - tz * e1y;
+        SimdReal qy = tz * e1x - tx * e1z;
+        SimdReal qz = tx * e1y - ty * e1x;
+        v = (packet.dx * qx + packet.dy * qy + packet.dz * qz) * invDet;
+        mask = mask & (v >= SimdReal(0.0)) & (u + v <= SimdReal(1.0));
+        if (!Any(mask)) return mask;
+
+        t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+        return mask & (t >= t_min) & (t <= t_max);
+    }
+
+    virtual void intersectsPacket(const RayPacket& packet, SimdReal active, Real t_min, PacketHit& hit) const override
+    {
+        SimdReal t, u, v;
+        SimdReal mask = intersectsPacketBarycentric(m_p0, m_e1, m_e2, packet, active, SimdReal(t_min), hit.t, t, u, v);
+        if (Any(mask)) hit.update(mask, t, u, v, this);
+    }
+
+    virtual SimdReal occludedPacket(const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max) const override
+    {
+        SimdReal t, u, v;
+        return intersectsPacketBarycentric(m_p0, m_e1, m_e2, packet, active, SimdReal(t_min), t_max, t, u, v);
+    }
+
+    virtual Vector3 normalAt(const Point3& /* point */, const Ray& ray, hit_record& record) const override
+    {
+        record.set_face_normal(ray, m_normal);
+        return record.normal;
+    }
+
+    // Unit normal of the triangle with edges e1 and e2, zero for degenerate triangles.
+    static inline Vector3 faceNormal(const Vector3& e1, const Vector3& e2)
+    {
+        Vector3 n = Cross(e1, e2);
+        Real length = n.Length();
+        return length > 0 ? n / length : n;
+    }
+
+    virtual AABB boundingBox() const override
+    {
+        AABB box(m_p0, m_p0);
+        box.grow(m_p1);
+        box.grow(m_p2);
+        return box;
     }
 
     inline Point3 getP0() const { return m_p0; }
     inline Point3 getP1() const { return m_p1; }
     inline Point3 getP2() const { return m_p2; }
 
-    inline void setP0(Point3 p0) { m_p0 = p0; }
-    inline void setP1(Point3 p1) { m_p1 = p1; }
-    inline void setP2(Point3 p2) { m_p2 = p2; }
+    inline const Vector3& getEdge1() const { return m_e1; }
+    inline const Vector3& getEdge2() const { return m_e2; }
+    inline const Vector3& getNormal() const { return m_normal; }
+    inline const std::shared_ptr<TextureMaterial>& getMaterial() const { return m_textureMaterial; }
+
+    inline void setP0(Point3 p0) { m_p0 = p0; precompute(); }
+    inline void setP1(Point3 p1) { m_p1 = p1; precompute(); }
+    inline void setP2(Point3 p2) { m_p2 = p2; precompute(); }
 
 private:
     Point3 m_p0;
     Point3 m_p1;
     Point3 m_p2;
     std::shared_ptr<TextureMaterial> m_textureMaterial;
+
+    // Derived from the vertices, refreshed by precompute() whenever one of them changes.
+    Vector3 m_e1;
+    Vector3 m_e2;
+    Vector3 m_normal;
+
+    void precompute()
+    {
+        m_e1 = m_p1 - m_p0;
+        m_e2 = m_p2 - m_p0;
+        m_normal = faceNormal(m_e1, m_e2);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Scene.h"
+#include "TextureMaterial.h"
+#include "Sampler.h"
+
+// Sky gradient returned for the rays leaving the scene.
+inline Color3 background(const Ray& r)
+{
+    Vector3 unit_direction = Normalize(r.direction());
+    auto t = 0.5 * (unit_direction.getY() + 1.0);
+    return (1.0 - t) * Color3(1.0, 1.0, 1.0) + t * Color3(0.5, 0.7, 1.0);
+}
+
+// Adds the diffuse and specular contribution of a light that is visible from a hit.
+inline void addLightContribution(const hit_record& record, const Vector3& light_direction, const Color3& light_color, Real diffuse, Real specular, Color3& color)
+{
+    auto light_intensity = Dot(record.normal, light_direction);
+
+    if (light_intensity > 0)
+    {
+        color += light_color * diffuse * light_intensity;
+    }
+
+    auto reflected = reflect(-light_direction, record.normal);
+    auto specular_intensity = Dot(reflected, light_direction);
+
+    if (specular_intensity > 0)
+    {
+        color += light_color * specular * pow(specular_intensity, 8);
+    }
+}
+
+// Adds the contribution of the unoccluded scene lights to the color of a hit.
+inline void addDirectLight(const hit_record& record, const Scene& world, Real diffuse, Real specular, Color3& color)
+{
+    for (const auto& light : world.getLights())
+    {
+        auto light_direction = light->getDirection(record.p);
+        auto light_distance = light->getDistance(record.p);
+
+        Ray shadow_ray = record.spawn_ray(light_direction);
+
+        if (world.occluded(shadow_ray, RayEpsilon, light_distance))
+        {
+            continue;
+        }
+
+        addLightContribution(record, light_direction, light->getColor(), diffuse, specular, color);
+    }
+}
+
+// Computes the color of a hit, lit by the scene lights, and the ray scattered from it.
+// Returns false when the material absorbs the ray.
+inline bool shade(const Ray& r, const hit_record& record, const Scene& world, Sampler& sampler, Color3& color, Ray& ray_out)
+{
+    Real diffuse = 0.0;
+    Real specular = 0.0;
+    if (!record.textureMaterial->getTextureAt(r, record, color, ray_out, diffuse, specular, sampler))
+        return false;
+
+    addDirectLight(record, world, diffuse, specular, color);
+    return true;
+}
+
+// Bounces at which Russian roulette starts to terminate low-contribution paths.
+const int RussianRouletteDepth = 3;
+
+// Randomly terminates the path after RussianRouletteDepth bounces, with a survival
+// probability following its throughput. Returns false if the path is killed, otherwise
+// reweights the throughput of the surviving path.
+inline bool russianRoulette(int depth, Color3& throughput, Sampler& sampler)
+{
+    if (depth < RussianRouletteDepth) return true;
+
+    Real survival = std::min(std::max(throughput.getX(), std::max(throughput.getY(), throughput.getZ())), Real(0.95));
+    if (RandomDouble(sampler) >= survival)
+        return false;
+
+    throughput /= survival;
+    return true;
+}
+
+// Traces a path of at most limit bounces. The color of every bounce multiplies a running
+// throughput, and the path ends on the background, on an absorbing material, or when
+// Russian roulette kills it. Surviving paths are reweighted so the estimate stays unbiased.
+inline Color3 ray_cast(const Ray& r, const Scene& world, int limit, Sampler& sampler)
+{
+    Color3 throughput(1, 1, 1);
+    Ray ray = r;
+
+    for (int depth = 0; depth < limit; depth++)
+    {
+        hit_record record;
+        if (!world.intersects(ray, RayEpsilon, infinity, record))
+            return throughput * background(ray);
+
+        Color3 color;
+        Ray ray_out;
+        if (!shade(ray, record, world, sampler, color, ray_out))
+            return Color3(0, 0, 0);
+
+        throughput = throughput * color;
+
+        if (!russianRoulette(depth, throughput, sampler))
+            return Color3(0, 0, 0);
+
+        ray = ray_out;
+    }
+
+    return Color3(0, 0, 0);
+}
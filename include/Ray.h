@@ -2,20 +2,23 @@
 
 #include "Vector.h"
 
-class Ray
+template<typename T>
+class RayT
 {
     public:
-        Ray() {}
-        Ray(const Point3& origin, const Vector3& direction)
+        RayT() {}
+        RayT(const Vector3T<T>& origin, const Vector3T<T>& direction)
             : orig(origin), dir(direction)
         {}
 
-        Point3 origin() const  { return orig; }
-        Vector3 direction() const { return dir; }
+        Vector3T<T> origin() const  { return orig; }
+        Vector3T<T> direction() const { return dir; }
 
-        Point3 at(double t) const { return orig + t * dir; }
+        Vector3T<T> at(T t) const { return orig + t * dir; }
 
     private:
-        Point3 orig;
-        Vector3 dir;
-};
\ No newline at end of file
+        Vector3T<T> orig;
+        Vector3T<T> dir;
+};
+
+using Ray = RayT<Real>;
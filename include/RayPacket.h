@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Simd.h"
+#include "Ray.h"
+#include "AABB.h"
+#include "HitRecord.h"
+
+class Object;
+
+const int PacketWidth = SimdReal::Width;
+
+// Up to PacketWidth rays in structure-of-arrays layout, one ray per SIMD lane.
+// Unused lanes replicate the first ray and are left out of the active mask.
+struct RayPacket
+{
+    SimdReal ox, oy, oz;
+    SimdReal dx, dy, dz;
+    SimdReal invDx, invDy, invDz;
+    SimdReal valid;
+    int count;
+
+    RayPacket(const Ray* rays, int rayCount)
+        : count(rayCount)
+    {
+        Real values[9][PacketWidth];
+        for (int lane = 0; lane < PacketWidth; lane++)
+        {
+            const Ray& ray = rays[lane < rayCount ? lane : 0];
+            Point3 o = ray.origin();
+            Vector3 d = ray.direction();
+            values[0][lane] = o.getX(); values[1][lane] = o.getY(); values[2][lane] = o.getZ();
+            values[3][lane] = d.getX(); values[4][lane] = d.getY(); values[5][lane] = d.getZ();
+            values[6][lane] = 1 / d.getX(); values[7][lane] = 1 / d.getY(); values[8][lane] = 1 / d.getZ();
+        }
+
+        ox = SimdReal::load(values[0]); oy = SimdReal::load(values[1]); oz = SimdReal::load(values[2]);
+        dx = SimdReal::load(values[3]); dy = SimdReal::load(values[4]); dz = SimdReal::load(values[5]);
+        invDx = SimdReal::load(values[6]); invDy = SimdReal::load(values[7]); invDz = SimdReal::load(values[8]);
+        valid = MaskFromBits<SimdReal>((1 << rayCount) - 1);
+    }
+
+    inline Ray getRay(int lane) const
+    {
+        return Ray(Point3(Lane(ox, lane), Lane(oy, lane), Lane(oz, lane)), Vector3(Lane(dx, lane), Lane(dy, lane), Lane(dz, lane)));
+    }
+};
+
+// Closest hits found so far for each lane of a packet: the distance, barycentrics and
+// primitive, like a hit_record before completeHit.
+struct PacketHit
+{
+    SimdReal t;
+    Real u[PacketWidth];
+    Real v[PacketWidth];
+    const Object* object[PacketWidth];
+    uint32_t primitive[PacketWidth];
+    bool hit[PacketWidth];
+
+    explicit PacketHit(Real t_max) : t(t_max)
+    {
+        for (int lane = 0; lane < PacketWidth; lane++)
+        {
+            u[lane] = 0.0;
+            v[lane] = 0.0;
+            object[lane] = nullptr;
+            primitive[lane] = 0;
+            hit[lane] = false;
+        }
+    }
+
+    // Records a hit for the lanes set in mask, at distances t_hit.
+    inline void update(SimdReal mask, SimdReal t_hit, SimdReal u_hit, SimdReal v_hit, const Object* hitObject, uint32_t hitPrimitive = 0)
+    {
+        t = Select(mask, t_hit, t);
+        int bits = mask.bits();
+        for (int lane = 0; lane < PacketWidth; lane++)
+        {
+            if (!(bits & (1 << lane))) continue;
+            u[lane] = Lane(u_hit, lane);
+            v[lane] = Lane(v_hit, lane);
+            object[lane] = hitObject;
+            primitive[lane] = hitPrimitive;
+            hit[lane] = true;
+        }
+    }
+};
+
+// Slab test of a box against every lane of a packet. Returns the mask of the lanes
+// entering the box within [t_min, t_max] and their entry distance in t_enter.
+inline SimdReal intersectsPacket(const AABB& box, const RayPacket& packet, SimdReal t_min, SimdReal t_max, SimdReal& t_enter)
+{
+    const Point3& lo = box.getMin();
+    const Point3& hi = box.getMax();
+
+    SimdReal t0 = (SimdReal(lo.getX()) - packet.ox) * packet.invDx;
+    SimdReal t1 = (SimdReal(hi.getX()) - packet.ox) * packet.invDx;
+    t_min = Max(Min(t0, t1), t_min);
+    t_max = Min(Max(t0, t1), t_max);
+
+    t0 = (SimdReal(lo.getY()) - packet.oy) * packet.invDy;
+    t1 = (SimdReal(hi.getY()) - packet.oy) * packet.invDy;
+    t_min = Max(Min(t0, t1), t_min);
+    t_max = Min(Max(t0, t1), t_max);
+
+    t0 = (SimdReal(lo.getZ()) - packet.oz) * packet.invDz;
+    t1 = (SimdReal(hi.getZ()) - packet.oz) * packet.invDz;
+    t_min = Max(Min(t0, t1), t_min);
+    t_max = Min(Max(t0, t1), t_max);
+
+    t_enter = t_min;
+    return t_min <= t_max;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Scalar type of the renderer. The math core (Vector3T, RayT) is templated on it and the
+// rest of the code uses Real, so the whole render is built in double by default or in
+// float with -DUSE_FLOAT=ON, which sets RAYTRACER_USE_FLOAT.
+#if RAYTRACER_USE_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
+// Tolerances that depend on the precision of the intersection code.
+template<typename T>
+struct Epsilon;
+
+template<>
+struct Epsilon<double>
+{
+    // Minimum distance of secondary rays. The value is the float literal the renderer
+    // always used, so double images do not change.
+    static constexpr double RayMin = 0.001f;
+    // Below this every component of a vector counts as zero.
+    static constexpr double NearZero = 1e-8;
+    // Offset of secondary ray origins off the surface, see OffsetRayOrigin: absolute
+    // below Origin, otherwise IntScale units in the last place of the coordinate.
+    static constexpr double Origin = 1.0 / 32.0;
+    static constexpr double FloatScale = 1.0 / 35184372088832.0; // 2^-45
+    static constexpr long long IntScale = 256;
+};
+
+template<>
+struct Epsilon<float>
+{
+    static constexpr float RayMin = 0.001f;
+    static constexpr float NearZero = 1e-6f;
+    static constexpr float Origin = 1.0f / 32.0f;
+    static constexpr float FloatScale = 1.0f / 65536.0f;
+    static constexpr int IntScale = 256;
+};
+
+// Minimum distance of secondary rays, which keeps them from hitting the surface they
+// start on.
+const Real RayEpsilon = Epsilon<Real>::RayMin;
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "Scene.h"
+#include "Image.h"
+#include "ImageWriter.h"
+#include "PathTracer.h"
+#include "Wavefront.h"
+#include "Sampler.h"
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <execution>
+#include <vector>
+
+enum class RenderMode
+{
+    DepthFirst, // Each sample is traced to the end by ray_cast before the next one.
+    Wavefront   // The samples of a tile are traced together, see WavefrontIntegrator.
+};
+
+inline bool parseRenderMode(const std::string& name, RenderMode& mode)
+{
+    if (name == "depth-first") mode = RenderMode::DepthFirst;
+    else if (name == "wavefront") mode = RenderMode::Wavefront;
+    else return false;
+    return true;
+}
+
+struct RenderSettings
+{
+    int samples_per_pixel = 100;
+    int max_pass_samples = 16; // Largest pass of renderProgressive.
+    // Adaptive sampling in renderProgressive, when noise_threshold is positive: a pixel
+    // stops once it has min_samples_per_pixel samples and its error after tone mapping
+    // (see Image::getError) is below noise_threshold. The samples saved go to the noisier
+    // pixels, up to max_samples_per_pixel each (0 for 4 * samples_per_pixel).
+    Real noise_threshold = 0;
+    int min_samples_per_pixel = 16;
+    int max_samples_per_pixel = 0;
+    int max_depth = 50;
+    uint64_t seed = 0;
+    int tile_size = 16;
+    RenderMode mode = RenderMode::DepthFirst;
+};
+
+class Renderer
+{
+public:
+    Renderer(const Scene& world, const RenderSettings& settings)
+        : m_world(world), m_settings(settings)
+        , m_wavefront(world, settings.max_depth, settings.seed)
+    {}
+
+    inline const RenderSettings& getSettings() const { return m_settings; }
+
+    // Sum of the radiance of samples new samples of pixel (i, j), numbered from the count
+    // it already has, and sum of their squared luminance in squares. The samples are traced
+    // and added in sample order, so the result does not depend on the scheduling.
+    Color3 samplePixel(const Image& image, int i, int j, int samples, Real& squares) const
+    {
+        Color3 pixel_color(0, 0, 0);
+        squares = 0;
+        int first = static_cast<int>(image.getSampleCount(i, j));
+        for (int s = first; s < first + samples; s++)
+        {
+            Sampler sampler = Sampler::forPixelSample(m_settings.seed, j * image.getWidth() + i, s);
+            Real u = Real(i + RandomDouble(sampler)) / image.getWidth();
+            Real v = Real(j + RandomDouble(sampler)) / image.getHeight();
+            Ray ray = m_world.getCamera().getRay(u, v);
+            Color3 radiance = ray_cast(ray, m_world, m_settings.max_depth, sampler);
+            pixel_color += radiance;
+            Real luminance = Luminance(radiance);
+            squares += luminance * luminance;
+        }
+        return pixel_color;
+    }
+
+    // Traces samplesOf(i, j) new samples of every pixel (i, j) of the tile into buffers local
+    // to the calling task, then adds them to the pixels of the tile, which no other task
+    // writes, and resolves them.
+    template<typename SampleCount>
+    void renderTile(const Tile& tile, Image& image, SampleCount&& samplesOf) const
+    {
+        size_t pixelCount = static_cast<size_t>(tile.getWidth()) * tile.getHeight();
+        std::vector<int> samples(pixelCount);
+        for (int j = tile.y0; j < tile.y1; j++)
+        {
+            for (int i = tile.x0; i < tile.x1; i++)
+                samples[(j - tile.y0) * tile.getWidth() + (i - tile.x0)] = samplesOf(i, j);
+        }
+
+        std::vector<Color3> sums(pixelCount, Color3(0, 0, 0));
+        std::vector<Real> squares(pixelCount, 0);
+        if (m_settings.mode == RenderMode::Wavefront)
+        {
+            m_wavefront.traceTile(tile, image, samples, sums, squares);
+        }
+        else
+        {
+            for (int j = tile.y0; j < tile.y1; j++)
+            {
+                for (int i = tile.x0; i < tile.x1; i++)
+                {
+                    size_t pixel = (j - tile.y0) * tile.getWidth() + (i - tile.x0);
+                    if (samples[pixel] > 0) sums[pixel] = samplePixel(image, i, j, samples[pixel], squares[pixel]);
+                }
+            }
+        }
+
+        for (int j = tile.y0; j < tile.y1; j++)
+        {
+            for (int i = tile.x0; i < tile.x1; i++)
+            {
+                size_t pixel = (j - tile.y0) * tile.getWidth() + (i - tile.x0);
+                if (samples[pixel] > 0) image.addSamples(i, j, sums[pixel], squares[pixel], samples[pixel]);
+            }
+        }
+        image.resolve(tile.x0, tile.y0, tile.x1, tile.y1);
+    }
+
+    // Adds samples_per_pixel samples to the whole image, one tile per task. Any execution
+    // policy gives the same image for the same seed. The finished tiles are reported to
+    // stream, if any, which writes the rows as they complete.
+    template<typename ExecutionPolicy>
+    void render(ExecutionPolicy&& policy, Image& image, ImageStream* stream = nullptr) const
+    {
+        std::vector<Tile> tiles = makeTiles(image.getWidth(), image.getHeight(), m_settings.tile_size);
+        std::for_each(policy, tiles.begin(), tiles.end(), [&](const Tile& tile)
+        {
+            renderTile(tile, image, [&](int, int) { return m_settings.samples_per_pixel; });
+            if (stream) stream->tileDone(tile);
+        });
+    }
+
+    // Same as above, with the tiles ordered and run by a work-stealing TBB scheduler.
+    void render(TileScheduler& scheduler, Image& image, ImageStream* stream = nullptr) const
+    {
+        std::vector<Tile> tiles = makeTiles(image.getWidth(), image.getHeight(), m_settings.tile_size, scheduler.getSettings().order);
+        scheduler.run(tiles, [&](const Tile& tile)
+        {
+            renderTile(tile, image, [&](int, int) { return m_settings.samples_per_pixel; });
+            if (stream) stream->tileDone(tile);
+        });
+    }
+
+    // Most samples a pixel gets from renderProgressive.
+    inline int getSampleCap() const
+    {
+        if (m_settings.noise_threshold <= 0) return m_settings.samples_per_pixel;
+        return m_settings.max_samples_per_pixel > 0 ? m_settings.max_samples_per_pixel : 4 * m_settings.samples_per_pixel;
+    }
+
+    // Samples of pixel (i, j) in the next pass of renderProgressive: as many as it has, so
+    // that its count doubles, at most max_pass_samples, and none once it reached the cap
+    // or, with adaptive sampling, once its error is below the threshold.
+    int getPassSamples(const Image& image, int i, int j) const
+    {
+        int count = static_cast<int>(image.getSampleCount(i, j));
+        int cap = getSampleCap();
+        if (count >= cap) return 0;
+        if (m_settings.noise_threshold > 0 && count >= m_settings.min_samples_per_pixel && image.getError(i, j) <= m_settings.noise_threshold)
+            return 0;
+        return std::min({ std::max(count, 1), m_settings.max_pass_samples, cap - count });
+    }
+
+    // Renders in passes within a budget of samples_per_pixel samples per pixel on average,
+    // continuing from the samples the image already has. Every pass adds getPassSamples
+    // samples to every pixel, so the counts double with every pass, 1, 2, 4..., the passes
+    // adding at most max_pass_samples, so that a preempted render loses little. Without
+    // adaptive sampling, every pixel ends with samples_per_pixel samples. With it, the
+    // pixels stop once converged and the passes go on for the others until the budget is
+    // spent, the last pass possibly exceeding it.
+    // After every pass the image is resolved and afterPass(mean samples per pixel, last)
+    // is called, e.g. to write a checkpoint. A tile whose pixels all get no more samples
+    // is done: it leaves the passes and goes to stream, as do the tiles of the pass
+    // expected to be the last.
+    template<typename Callback>
+    void renderProgressive(TileScheduler& scheduler, Image& image, Callback&& afterPass, ImageStream* stream = nullptr) const
+    {
+        std::vector<Tile> tiles = makeTiles(image.getWidth(), image.getHeight(), m_settings.tile_size, scheduler.getSettings().order);
+        uint64_t pixelCount = static_cast<uint64_t>(image.getWidth()) * image.getHeight();
+        uint64_t budget = pixelCount * m_settings.samples_per_pixel;
+        uint64_t spent = image.getTotalSampleCount();
+
+        uint64_t planned = spent < budget ? getPlannedSamples(image) : 0;
+        while (planned > 0)
+        {
+            bool last = spent + planned >= budget;
+            scheduler.run(tiles, [&](const Tile& tile)
+            {
+                renderTile(tile, image, [&](int i, int j) { return getPassSamples(image, i, j); });
+                if (last && stream) stream->tileDone(tile);
+            });
+
+            // A pixel that gets no samples keeps its count and error, so a done tile stays
+            // done. When adaptive sampling stops the passes early, every tile is done here.
+            if (!last)
+            {
+                std::vector<Tile> remaining;
+                for (const Tile& tile : tiles)
+                {
+                    if (!isTileDone(image, tile)) remaining.push_back(tile);
+                    else if (stream) stream->tileDone(tile);
+                }
+                tiles = std::move(remaining);
+            }
+
+            spent += planned;
+            planned = spent < budget ? getPlannedSamples(image) : 0;
+            afterPass(static_cast<double>(spent) / pixelCount, planned == 0);
+        }
+    }
+
+private:
+    const Scene& m_world;
+    RenderSettings m_settings;
+    WavefrontIntegrator m_wavefront;
+
+    bool isTileDone(const Image& image, const Tile& tile) const
+    {
+        for (int j = tile.y0; j < tile.y1; j++)
+        {
+            for (int i = tile.x0; i < tile.x1; i++)
+            {
+                if (getPassSamples(image, i, j) > 0) return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t getPlannedSamples(const Image& image) const
+    {
+        uint64_t total = 0;
+        for (int j = 0; j < image.getHeight(); j++)
+        {
+            for (int i = 0; i < image.getWidth(); i++)
+                total += getPassSamples(image, i, j);
+        }
+        return total;
+    }
+};
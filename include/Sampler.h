@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+// Small, fast and statistically good random generator (PCG32, XSH-RR variant).
+// See: https://www.pcg-random.org/
+// A Sampler is cheap to create and holds no shared state: the renderer creates one per
+// sample from (seed, stream), so every pixel sample draws the same numbers whatever the
+// number of threads and the order in which samples are processed.
+class Sampler
+{
+public:
+    explicit Sampler(uint64_t seed = 0, uint64_t stream = 0)
+        : m_state(0), m_increment((stream << 1u) | 1u)
+    {
+        next();
+        m_state += mix(seed);
+        next();
+    }
+
+    // Returns a uniformly distributed 32 bits integer.
+    inline uint32_t next()
+    {
+        uint64_t old = m_state;
+        m_state = old * 6364136223846793005ULL + m_increment;
+        uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = static_cast<uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31u));
+    }
+
+    // Returns a random real in [0,1).
+    inline double nextDouble()
+    {
+        return next() * (1.0 / 4294967296.0);
+    }
+
+    // SplitMix64 finalizer, used to spread nearby seeds and stream indices apart.
+    static inline uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // Sampler dedicated to one sample of one pixel of a render seeded with seed.
+    static inline Sampler forPixelSample(uint64_t seed, uint64_t pixelIndex, uint64_t sampleIndex)
+    {
+        return Sampler(mix(seed ^ mix(sampleIndex)), pixelIndex);
+    }
+
+private:
+    uint64_t m_state;
+    uint64_t m_increment;
+};
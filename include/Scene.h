@@ -1,10 +1,15 @@
+#pragma once
+
 #include <vector>
 #include "Object.h"
+#include "Instance.h"
+#include "BVH.h"
 #include "Light.h"
 #include "Camera.h"
 #include "Utils.h"
 
 #include <memory>
+#include <unordered_map>
 
 class Scene : public Object
 {
@@ -12,45 +17,352 @@ public:
     Scene(const std::vector<std::shared_ptr<Object>>& objects, const std::vector<std::shared_ptr<Light>>& lights)
         : m_objects(objects), m_lights(lights)
     {
-        m_camera = Camera(Point3(-1, 1, 1), Point3(0, 0, 0), Vector3(0, 1, 0), 90, 16.0 / 9.0);
+        m_camera = Camera(Point3(-1, 1, 1), Point3(0, 0, 0), Vector3(0, 1, 0), 90, 1.0);
     }
 
-    void addObject(const std::shared_ptr<Object>& object) { m_objects.emplace_back(object); }
+    void addObject(const std::shared_ptr<Object>& object) { m_objects.emplace_back(object); m_built = false; }
+    // Spheres are copied into the sphere arrays, see addSphere.
+    void addObject(const std::shared_ptr<Sphere>& sphere) { addSphere(sphere->getCenter(), sphere->getRadius(), sphere->getMaterial()); }
+    // Places mesh in the scene by toWorld, sharing it with its other instances, see Instance.
+    void addInstance(const std::shared_ptr<Mesh>& mesh, const Transform& toWorld) { addObject(std::make_shared<Instance>(mesh, toWorld)); }
     void addLight(const std::shared_ptr<Light>& light) { m_lights.emplace_back(light); }
-    void clearObjects() { m_objects.clear(); }
     void clearLights() { m_lights.clear(); }
 
+    void clearObjects()
+    {
+        m_objects.clear();
+        m_spheres = SphereArrays();
+        m_built = false;
+    }
+
+    // Spheres are stored by value in structure-of-arrays form with their own BVH and are
+    // intersected inline, without virtual calls nor a pointer per sphere.
+    void addSphere(const Point3& center, Real radius, const std::shared_ptr<TextureMaterial>& material)
+    {
+        addSphere(center, radius, addMaterial(material));
+    }
+
+    // Same as above, with the index of the material in the scene material table.
+    void addSphere(const Point3& center, Real radius, uint32_t material)
+    {
+        m_spheres.x.push_back(center.getX());
+        m_spheres.y.push_back(center.getY());
+        m_spheres.z.push_back(center.getZ());
+        m_spheres.radius.push_back(radius);
+        m_spheres.material.push_back(material);
+        m_built = false;
+    }
+
+    // Returns the index of material in the scene material table, adding it if needed.
+    uint32_t addMaterial(const std::shared_ptr<TextureMaterial>& material)
+    {
+        auto found = m_materialIndices.find(material.get());
+        if (found != m_materialIndices.end()) return found->second;
+
+        uint32_t index = static_cast<uint32_t>(m_materials.size());
+        m_materials.push_back(material);
+        m_materialIndices.emplace(material.get(), index);
+        return index;
+    }
+
     inline const std::vector<std::shared_ptr<Object>>& getObjects() const { return m_objects; }
     inline const std::vector<std::shared_ptr<Light>>& getLights() const { return m_lights; }
     inline const Camera& getCamera() const { return m_camera; }
+    void setCamera(const Camera& camera) { m_camera = camera; }
+    inline size_t getSphereCount() const { return m_spheres.size(); }
+
+    // Builds the acceleration structures over the current spheres and objects. Must be
+    // called once the scene is complete and before rendering; until then intersects falls
+    // back to a linear scan. The objects and the spheres are built concurrently.
+    void build()
+    {
+        tbb::parallel_invoke([&]
+        {
+            std::vector<AABB> bounds;
+            bounds.reserve(m_objects.size());
+            for (const auto& object : m_objects)
+            {
+                object->build();
+                bounds.push_back(object->boundingBox());
+            }
+            m_bvh.build(bounds);
+        },
+        [&]
+        {
+            std::vector<AABB> bounds;
+            bounds.reserve(m_spheres.size());
+            for (uint32_t i = 0; i < m_spheres.size(); i++)
+                bounds.push_back(Sphere::bounds(m_spheres.center(i), m_spheres.radius[i]));
+            m_sphereBVH.build(bounds);
+            m_spheres.reorder(m_sphereBVH.linearize());
+        });
+
+        m_built = true;
+    }
+
+    virtual bool intersects(const Ray& ray, Real t_min, Real t_max, hit_record& record) const override
+    {
+        if (!m_built)
+            return intersectsLinear(ray, t_min, t_max, record);
+
+        Real closest_so_far = t_max;
+        bool hitSphere = m_sphereBVH.traverse(ray, t_min, closest_so_far, [&](uint32_t index, Real t_near, Real& closest)
+        {
+            if (!intersectsSphere(index, ray, t_near, closest, record)) return false;
+
+            closest = record.t;
+            return true;
+        });
+
+        bool hitObject = m_bvh.traverse(ray, t_min, closest_so_far, [&](uint32_t index, Real t_near, Real& closest)
+        {
+            if (!m_objects[index]->intersects(ray, t_near, closest, record)) return false;
+
+            closest = record.t;
+            return true;
+        });
+
+        bool hit = hitSphere || hitObject;
+        if (hit) record.object->completeHit(ray, record);
+        return hit;
+    }
+
+    // Completes the hits on the sphere arrays, the other objects complete their own.
+    virtual void completeHit(const Ray& ray, hit_record& record) const override
+    {
+        record.p = ray.at(record.t);
+        record.set_face_normal(ray, Normalize(record.p - m_spheres.center(record.primitive)));
+        record.textureMaterial = m_materials[m_spheres.material[record.primitive]].get();
+    }
+
+    virtual bool occluded(const Ray& ray, Real t_min, Real t_max) const override
+    {
+        if (!m_built)
+        {
+            for (uint32_t i = 0; i < m_spheres.size(); i++)
+            {
+                Real t;
+                if (Sphere::intersectsDistance(m_spheres.center(i), m_spheres.radius[i], ray, t_min, t_max, t)) return true;
+            }
+            for (const auto& object : m_objects)
+            {
+                if (object->occluded(ray, t_min, t_max)) return true;
+            }
+            return false;
+        }
+
+        bool occludedBySphere = m_sphereBVH.traverseAny(ray, t_min, t_max, [&](uint32_t index, Real t_near, Real t_far)
+        {
+            Real t;
+            return Sphere::intersectsDistance(m_spheres.center(index), m_spheres.radius[index], ray, t_near, t_far, t);
+        });
+        if (occludedBySphere) return true;
+
+        return m_bvh.traverseAny(ray, t_min, t_max, [&](uint32_t index, Real t_near, Real t_far)
+        {
+            return m_objects[index]->occluded(ray, t_near, t_far);
+        });
+    }
+
+    virtual void intersectsPacket(const RayPacket& packet, SimdReal active, Real t_min, PacketHit& hit) const override
+    {
+        if (!m_built)
+        {
+            for (uint32_t i = 0; i < m_spheres.size(); i++)
+                intersectsSpherePacket(i, packet, active, t_min, hit);
+            for (const auto& object : m_objects)
+                object->intersectsPacket(packet, active, t_min, hit);
+            return;
+        }
+
+        m_sphereBVH.traversePacket(packet, active, t_min, hit.t, [&](uint32_t index, SimdReal lanes)
+        {
+            intersectsSpherePacket(index, packet, lanes, t_min, hit);
+        });
+
+        m_bvh.traversePacket(packet, active, t_min, hit.t, [&](uint32_t index, SimdReal lanes)
+        {
+            m_objects[index]->intersectsPacket(packet, lanes, t_min, hit);
+        });
+    }
+
+    virtual SimdReal occludedPacket(const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max) const override
+    {
+        if (!m_built)
+        {
+            SimdReal occluded;
+            for (uint32_t i = 0; i < m_spheres.size(); i++)
+                occluded = occluded | occludedSpherePacket(i, packet, AndNot(occluded, active), t_min, t_max);
+            for (const auto& object : m_objects)
+                occluded = occluded | object->occludedPacket(packet, AndNot(occluded, active), t_min, t_max);
+            return occluded;
+        }
+
+        SimdReal occluded = m_sphereBVH.traverseAnyPacket(packet, active, t_min, t_max, [&](uint32_t index, SimdReal lanes)
+        {
+            return occludedSpherePacket(index, packet, lanes, t_min, t_max);
+        });
+
+        active = AndNot(occluded, active);
+        if (!Any(active)) return occluded;
+
+        return occluded | m_bvh.traverseAnyPacket(packet, active, t_min, t_max, [&](uint32_t index, SimdReal lanes)
+        {
+            return m_objects[index]->occludedPacket(packet, lanes, t_min, t_max);
+        });
+    }
+
+    // Closest hits of a batch of rays, traced PacketWidth rays at a time. Coherent rays,
+    // such as the camera rays of neighbouring samples, share most of their traversal.
+    void intersectsRays(const Ray* rays, size_t count, Real t_min, Real t_max, hit_record* records, bool* hits) const
+    {
+        for (size_t first = 0; first < count; first += PacketWidth)
+        {
+            int size = static_cast<int>(std::min<size_t>(PacketWidth, count - first));
+            RayPacket packet(rays + first, size);
+            PacketHit hit(t_max);
+            intersectsPacket(packet, packet.valid, t_min, hit);
+
+            for (int lane = 0; lane < size; lane++)
+            {
+                hits[first + lane] = hit.hit[lane];
+                if (!hit.hit[lane]) continue;
+
+                hit_record& record = records[first + lane];
+                record.t = Lane(hit.t, lane);
+                record.u = hit.u[lane];
+                record.v = hit.v[lane];
+                record.object = hit.object[lane];
+                record.primitive = hit.primitive[lane];
+                hit.object[lane]->completeHit(rays[first + lane], record);
+            }
+        }
+    }
+
+    // Occlusion of a batch of rays, each with its own maximum distance, traced PacketWidth
+    // rays at a time. Shadow rays cast towards the same light are a typical use.
+    void occludedRays(const Ray* rays, const Real* t_max, size_t count, Real t_min, bool* occluded) const
+    {
+        for (size_t first = 0; first < count; first += PacketWidth)
+        {
+            int size = static_cast<int>(std::min<size_t>(PacketWidth, count - first));
+            RayPacket packet(rays + first, size);
+
+            Real distances[PacketWidth];
+            for (int lane = 0; lane < PacketWidth; lane++)
+                distances[lane] = t_max[first + (lane < size ? lane : 0)];
+
+            int bits = occludedPacket(packet, packet.valid, t_min, SimdReal::load(distances)).bits();
+            for (int lane = 0; lane < size; lane++)
+                occluded[first + lane] = (bits & (1 << lane)) != 0;
+        }
+    }
 
-    virtual bool intersects(const Ray& ray, double t_min, double t_max, hit_record& record) const override
+    bool intersectsLinear(const Ray& ray, Real t_min, Real t_max, hit_record& record) const
     {
-        hit_record tmp_record;
         bool hit = false;
-        double closest_so_far = t_max;
+        Real closest_so_far = t_max;
+
+        for (uint32_t i = 0; i < m_spheres.size(); i++)
+        {
+            if (intersectsSphere(i, ray, t_min, closest_so_far, record))
+            {
+                hit = true;
+                closest_so_far = record.t;
+            }
+        }
 
         for (const auto& object : m_objects)
         {
-            if (object->intersects(ray, t_min, closest_so_far, tmp_record))
+            if (object->intersects(ray, t_min, closest_so_far, record))
             {
                 hit = true;
-                closest_so_far = tmp_record.t;
-                record = tmp_record;
+                closest_so_far = record.t;
             }
         }
 
+        if (hit) record.object->completeHit(ray, record);
         return hit;
     }
 
     // Useless but need to override
-    virtual Vector3 normalAt(const Point3& point, const Ray& ray, hit_record& record) const override
+    virtual Vector3 normalAt(const Point3& /* point */, const Ray& /* ray */, hit_record& /* record */) const override
     {
         return Vector3(0, 0, 0);
     }
 
+    virtual AABB boundingBox() const override
+    {
+        if (m_built) return Union(m_sphereBVH.getBounds(), m_bvh.getBounds());
+
+        AABB box;
+        for (uint32_t i = 0; i < m_spheres.size(); i++)
+            box.grow(Sphere::bounds(m_spheres.center(i), m_spheres.radius[i]));
+        for (const auto& object : m_objects)
+            box.grow(object->boundingBox());
+        return box;
+    }
+
 private:
+    struct SphereArrays
+    {
+        std::vector<Real> x;
+        std::vector<Real> y;
+        std::vector<Real> z;
+        std::vector<Real> radius;
+        std::vector<uint32_t> material; // Index in the scene material table.
+
+        inline uint32_t size() const { return static_cast<uint32_t>(radius.size()); }
+        inline Point3 center(uint32_t i) const { return Point3(x[i], y[i], z[i]); }
+
+        // Reorders the spheres so that sphere i becomes the old sphere order[i].
+        void reorder(const std::vector<uint32_t>& order)
+        {
+            auto permute = [&](auto& values)
+            {
+                auto old = values;
+                for (size_t i = 0; i < order.size(); i++)
+                    values[i] = old[order[i]];
+            };
+            permute(x);
+            permute(y);
+            permute(z);
+            permute(radius);
+            permute(material);
+        }
+    };
+
     std::vector<std::shared_ptr<Object>> m_objects;
     std::vector<std::shared_ptr<Light>> m_lights;
+    std::vector<std::shared_ptr<TextureMaterial>> m_materials;
+    std::unordered_map<const TextureMaterial*, uint32_t> m_materialIndices;
+    SphereArrays m_spheres;
     Camera m_camera;
-};
\ No newline at end of file
+    BVH m_bvh;       // Over m_objects, the top level over the BVHs of meshes and instances.
+    BVH m_sphereBVH; // Over m_spheres.
+    bool m_built = false;
+
+    inline bool intersectsSphere(uint32_t index, const Ray& ray, Real t_min, Real t_max, hit_record& record) const
+    {
+        Real t;
+        if (!Sphere::intersectsDistance(m_spheres.center(index), m_spheres.radius[index], ray, t_min, t_max, t)) return false;
+
+        record.t = t;
+        record.object = this;
+        record.primitive = index;
+        return true;
+    }
+
+    inline void intersectsSpherePacket(uint32_t index, const RayPacket& packet, SimdReal active, Real t_min, PacketHit& hit) const
+    {
+        SimdReal t;
+        SimdReal mask = Sphere::intersectsPacketDistance(m_spheres.center(index), m_spheres.radius[index], packet, active, SimdReal(t_min), hit.t, t);
+        if (Any(mask)) hit.update(mask, t, SimdReal(0.0), SimdReal(0.0), this, index);
+    }
+
+    inline SimdReal occludedSpherePacket(uint32_t index, const RayPacket& packet, SimdReal active, Real t_min, SimdReal t_max) const
+    {
+        SimdReal t;
+        return Sphere::intersectsPacketDistance(m_spheres.center(index), m_spheres.radius[index], packet, active, SimdReal(t_min), t_max, t);
+    }
+};
@@ -0,0 +1,495 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "MappedFile.h"
+#include "Scene.h"
+#include "Mesh.h"
+#include "Instance.h"
+#include "MeshCache.h"
+#include "Metaballs.h"
+#include "ImplicitBlob.h"
+#include "TextureMaterial.h"
+
+// Render settings given by a scene file.
+struct SceneSettings
+{
+    int width = 512;
+    int height = 512;
+    int samples_per_pixel = 0; // 0 when the file does not give it.
+    int max_depth = 50;
+    uint64_t content_hash = 0; // Of the scene file, 0 for the built-in scene.
+};
+
+// Loads scene files: one statement per line, blank lines and # comments ignored.
+//
+//   image <width> <height>
+//   samples <samples per pixel>
+//   depth <max depth>
+//   camera <from x y z> <at x y z> <up x y z> <vertical fov in degrees>
+//   material <name> uniform <r g b> <diffuse> <specular>
+//   material <name> metal <r g b> <fuzz>
+//   material <name> mirror <r g b>
+//   light <x y z> <r g b> <intensity>
+//   sphere <x y z> <radius> <material>
+//   vertex <x y z>
+//   face <i j k> <material>           vertex indices from 0, into a mesh of all the faces
+//   mesh <file> <material>            OBJ or binary PLY file, relative to the scene file
+//   instance <file> <material> [translate <x y z>] [rotate <axis x y z> <degrees>] [scale <s> | <x y z>]...
+//                                     mesh file placed by the transforms, applied in order;
+//                                     the instances of a file and material share one mesh
+//   ball <x y z> <radius> [weight]
+//   blob <threshold> <material>       surface of the balls given since the previous blob
+//
+// Materials are defined before use. The file is mapped and parsed in place, without a copy
+// nor a string per token, and spheres go straight into the sphere arrays of the scene.
+class SceneLoader
+{
+public:
+    // Adds the content of the file to scene and builds it, then sets settings from it.
+    bool load(const std::string& path, Scene& scene, SceneSettings& settings)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+
+        MappedFile file(path);
+        if (!file.isOpen())
+        {
+            std::cerr << "Error: Could not open file " << path << std::endl;
+            return false;
+        }
+
+        m_path = path;
+        settings.content_hash = contentHash(file.data(), file.size());
+        m_statistics = Statistics();
+        m_statistics.bytes = file.size();
+        m_materials.clear();
+        m_mesh.reset();
+        m_field.reset();
+        m_instanced.clear();
+        // The camera of Scene, unless the file gives one.
+        m_cameraFrom = Point3(-1, 1, 1);
+        m_cameraAt = Point3(0, 0, 0);
+        m_cameraUp = Vector3(0, 1, 0);
+        m_cameraFov = 90;
+
+        const char* cursor = file.data();
+        const char* end = cursor + file.size();
+        m_line = 0;
+        while (cursor < end)
+        {
+            m_line++;
+            const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+            if (!lineEnd) lineEnd = end;
+            if (!tokenize(cursor, lineEnd) || !parseStatement(scene, settings)) return false;
+            cursor = lineEnd + 1;
+        }
+
+        if (m_field && m_field->size() > 0) return fail("balls without a blob");
+        // Vertices without faces would make a mesh with empty bounds, which the BVH cannot bin.
+        if (m_mesh && m_mesh->getTriangleCount() > 0)
+        {
+            scene.addObject(m_mesh);
+            m_statistics.triangles += m_mesh->getTriangleCount();
+        }
+        // Rebuilt even without a camera statement, for the aspect ratio of the image.
+        Real aspectRatio = static_cast<Real>(settings.width) / settings.height;
+        scene.setCamera(Camera(m_cameraFrom, m_cameraAt, m_cameraUp, m_cameraFov, aspectRatio));
+        m_statistics.materials = m_materials.size();
+        m_materials.clear();
+        m_mesh.reset();
+        m_instanced.clear();
+
+        auto parsed = Clock::now();
+        scene.build();
+        auto built = Clock::now();
+
+        m_statistics.parse_seconds = std::chrono::duration<double>(parsed - start).count();
+        m_statistics.build_seconds = std::chrono::duration<double>(built - parsed).count();
+        return true;
+    }
+
+    // Loads the mesh files through cache from now on, nullptr for none.
+    void setMeshCache(MeshCache* cache) { m_meshCache = cache; }
+
+    // Prints what the last load read and the time it took.
+    void report(std::ostream& out) const
+    {
+        out << "Loaded " << m_path << ": " << m_statistics.spheres << " spheres, " << m_statistics.triangles << " triangles, "
+            << m_statistics.instances << " instances, " << m_statistics.blobs << " blobs, " << m_statistics.lights << " lights, " << m_statistics.materials << " materials" << std::endl
+            << "  parse " << m_statistics.parse_seconds * 1000 << " ms ("
+            << m_statistics.bytes / double(1 << 20) / std::max(m_statistics.parse_seconds, 1e-9) << " MB/s), build "
+            << m_statistics.build_seconds * 1000 << " ms" << std::endl;
+    }
+
+    struct Statistics
+    {
+        size_t bytes = 0;
+        size_t spheres = 0;
+        size_t triangles = 0; // Counted once for all the instances of a mesh.
+        size_t instances = 0;
+        size_t blobs = 0;
+        size_t lights = 0;
+        size_t materials = 0;
+        double parse_seconds = 0;
+        double build_seconds = 0;
+    };
+
+    inline const Statistics& getStatistics() const { return m_statistics; }
+
+private:
+    static const int MaxTokens = 32;
+    static const uint32_t NoIndex = UINT32_MAX;
+
+    struct NamedMaterial
+    {
+        std::shared_ptr<TextureMaterial> material;
+        uint32_t sceneIndex;
+        uint32_t meshIndex = NoIndex; // Added to the mesh table on its first face.
+    };
+
+    std::string m_path;
+    Statistics m_statistics;
+    MeshCache* m_meshCache = nullptr;
+    int m_line = 0;
+
+    // Tokens of the current line, viewing the mapped file.
+    std::string_view m_tokens[MaxTokens];
+    int m_tokenCount = 0;
+
+    // Keys view the mapped file, so the table only lives during load.
+    std::unordered_map<std::string_view, NamedMaterial> m_materials;
+    std::shared_ptr<Mesh> m_mesh;
+    std::shared_ptr<MetaballField> m_field;
+    // Meshes loaded by instance statements, by file and material.
+    std::map<std::pair<std::string, const TextureMaterial*>, std::shared_ptr<Mesh>> m_instanced;
+
+    Point3 m_cameraFrom;
+    Point3 m_cameraAt;
+    Vector3 m_cameraUp;
+    Real m_cameraFov = 90;
+
+    bool fail(const std::string& message) const
+    {
+        std::cerr << "Error: " << m_path << ":" << m_line << ": " << message << std::endl;
+        return false;
+    }
+
+    void warn(const std::string& message) const
+    {
+        std::cerr << "Warning: " << m_path << ":" << m_line << ": " << message << std::endl;
+    }
+
+    bool tokenize(const char* begin, const char* end)
+    {
+        m_tokenCount = 0;
+        const char* cursor = begin;
+        while (true)
+        {
+            while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) cursor++;
+            if (cursor == end || *cursor == '#') return true;
+
+            const char* start = cursor;
+            while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '#') cursor++;
+            if (m_tokenCount == MaxTokens) return fail("too many values");
+            m_tokens[m_tokenCount++] = std::string_view(start, cursor - start);
+        }
+    }
+
+    bool expect(int count, const char* usage) const
+    {
+        if (m_tokenCount == count) return true;
+        return fail(std::string("expected ") + usage);
+    }
+
+    template<typename T>
+    bool number(int token, T& value) const
+    {
+        std::string_view text = m_tokens[token];
+        // from_chars does not accept a leading +.
+        if (!text.empty() && text[0] == '+') text.remove_prefix(1);
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (result.ec != std::errc() || result.ptr != text.data() + text.size())
+            return fail("invalid number '" + std::string(m_tokens[token]) + "'");
+        return true;
+    }
+
+    bool vector(int token, Vector3& value) const
+    {
+        Real x, y, z;
+        if (!number(token, x) || !number(token + 1, y) || !number(token + 2, z)) return false;
+        value = Vector3(x, y, z);
+        return true;
+    }
+
+    bool positive(int token, Real& value) const
+    {
+        if (!number(token, value)) return false;
+        if (!(value > 0)) return fail("expected a positive value, not '" + std::string(m_tokens[token]) + "'");
+        return true;
+    }
+
+    // Path of the file named by token, relative to the scene file unless absolute.
+    std::string file(int token) const
+    {
+        std::string path(m_tokens[token]);
+        size_t slash = m_path.rfind('/');
+        if (path[0] != '/' && slash != std::string::npos) path = m_path.substr(0, slash + 1) + path;
+        return path;
+    }
+
+    std::shared_ptr<Mesh> loadMeshFile(const std::string& path, const std::shared_ptr<TextureMaterial>& material)
+    {
+        auto mesh = std::make_shared<Mesh>();
+        bool loaded = m_meshCache ? m_meshCache->load(path, *mesh, material) : loadMesh(path, *mesh, material);
+        if (!loaded)
+        {
+            fail("could not load the mesh " + path);
+            return nullptr;
+        }
+        // Skipped by the callers: its bounds would be empty, which the BVH cannot bin.
+        if (mesh->getTriangleCount() == 0) warn("the mesh " + path + " has no triangles, skipped");
+        m_statistics.triangles += mesh->getTriangleCount();
+        return mesh;
+    }
+
+    // Parses the transforms from token on, the first given being applied first.
+    bool transform(int token, Transform& toWorld) const
+    {
+        const char* usage = "instance <file> <material> [translate <x y z>] [rotate <axis x y z> <degrees>] [scale <s> | <x y z>]...";
+        while (token < m_tokenCount)
+        {
+            std::string_view operation = m_tokens[token];
+            if (operation == "translate")
+            {
+                Vector3 offset;
+                if (token + 4 > m_tokenCount) return fail(std::string("expected ") + usage);
+                if (!vector(token + 1, offset)) return false;
+                toWorld = Transform::translation(offset) * toWorld;
+                token += 4;
+            }
+            else if (operation == "rotate")
+            {
+                Vector3 axis;
+                Real degrees;
+                if (token + 5 > m_tokenCount) return fail(std::string("expected ") + usage);
+                if (!vector(token + 1, axis) || !number(token + 4, degrees)) return false;
+                if (!(axis.Length() > 0)) return fail("the rotation axis must not be zero");
+                toWorld = Transform::rotation(axis, degrees) * toWorld;
+                token += 5;
+            }
+            else if (operation == "scale")
+            {
+                // One factor, or three when the three tokens after scale are numbers.
+                Vector3 factors;
+                bool three = token + 4 <= m_tokenCount && isNumber(token + 1) && isNumber(token + 2) && isNumber(token + 3);
+                if (three)
+                {
+                    if (!vector(token + 1, factors)) return false;
+                }
+                else
+                {
+                    Real factor;
+                    if (token + 2 > m_tokenCount) return fail(std::string("expected ") + usage);
+                    if (!number(token + 1, factor)) return false;
+                    factors = Vector3(factor, factor, factor);
+                }
+                if (factors.getX() == 0 || factors.getY() == 0 || factors.getZ() == 0) return fail("the scale factors must not be zero");
+                toWorld = Transform::scaling(factors) * toWorld;
+                token += three ? 4 : 2;
+            }
+            else
+            {
+                return fail("unknown transform '" + std::string(operation) + "'");
+            }
+        }
+        return true;
+    }
+
+    bool isNumber(int token) const
+    {
+        std::string_view text = m_tokens[token];
+        if (!text.empty() && text[0] == '+') text.remove_prefix(1);
+        Real value;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    NamedMaterial* material(int token)
+    {
+        auto found = m_materials.find(m_tokens[token]);
+        if (found == m_materials.end())
+        {
+            fail("unknown material '" + std::string(m_tokens[token]) + "'");
+            return nullptr;
+        }
+        return &found->second;
+    }
+
+    bool parseStatement(Scene& scene, SceneSettings& settings)
+    {
+        if (m_tokenCount == 0) return true;
+
+        std::string_view keyword = m_tokens[0];
+        if (keyword == "sphere")
+        {
+            Vector3 center;
+            Real radius;
+            if (!expect(6, "sphere <x y z> <radius> <material>") || !vector(1, center) || !positive(4, radius)) return false;
+            NamedMaterial* named = material(5);
+            if (!named) return false;
+
+            scene.addSphere(center, radius, named->sceneIndex);
+            m_statistics.spheres++;
+        }
+        else if (keyword == "vertex")
+        {
+            Vector3 position;
+            if (!expect(4, "vertex <x y z>") || !vector(1, position)) return false;
+
+            if (!m_mesh) m_mesh = std::make_shared<Mesh>();
+            m_mesh->addVertex(position);
+        }
+        else if (keyword == "face")
+        {
+            uint32_t indices[3];
+            if (!expect(5, "face <i j k> <material>")) return false;
+            for (int k = 0; k < 3; k++)
+            {
+                if (!number(k + 1, indices[k])) return false;
+                if (!m_mesh || indices[k] >= m_mesh->getVertexCount())
+                    return fail("vertex " + std::string(m_tokens[k + 1]) + " is not defined");
+            }
+            NamedMaterial* named = material(4);
+            if (!named) return false;
+
+            if (named->meshIndex == NoIndex) named->meshIndex = m_mesh->addMaterial(named->material);
+            m_mesh->addFace(indices[0], indices[1], indices[2], named->meshIndex);
+        }
+        else if (keyword == "mesh")
+        {
+            if (!expect(3, "mesh <file> <material>")) return false;
+            NamedMaterial* named = material(2);
+            if (!named) return false;
+
+            auto mesh = loadMeshFile(file(1), named->material);
+            if (!mesh) return false;
+            if (mesh->getTriangleCount() > 0) scene.addObject(mesh);
+        }
+        else if (keyword == "instance")
+        {
+            if (m_tokenCount < 3) return fail("expected instance <file> <material> [transforms]");
+            NamedMaterial* named = material(2);
+            Transform toWorld;
+            if (!named || !transform(3, toWorld)) return false;
+
+            std::string path = file(1);
+            std::shared_ptr<Mesh>& mesh = m_instanced[{ path, named->material.get() }];
+            if (!mesh) mesh = loadMeshFile(path, named->material);
+            if (!mesh) return false;
+            if (mesh->getTriangleCount() == 0) return true;
+            scene.addInstance(mesh, toWorld);
+            m_statistics.instances++;
+        }
+        else if (keyword == "ball")
+        {
+            Vector3 center;
+            Real radius, weight = 1;
+            if (m_tokenCount != 6 && !expect(5, "ball <x y z> <radius> [weight]")) return false;
+            if (!vector(1, center) || !positive(4, radius) || (m_tokenCount == 6 && !number(5, weight))) return false;
+
+            if (!m_field) m_field = std::make_shared<MetaballField>();
+            m_field->addBall(center, radius, weight);
+        }
+        else if (keyword == "blob")
+        {
+            Real threshold;
+            if (!expect(3, "blob <threshold> <material>") || !positive(1, threshold)) return false;
+            NamedMaterial* named = material(2);
+            if (!named) return false;
+            if (!m_field || m_field->size() == 0) return fail("blob without balls");
+
+            m_field->build();
+            scene.addObject(std::make_shared<ImplicitBlob>(m_field, threshold, named->material));
+            m_field.reset();
+            m_statistics.blobs++;
+        }
+        else if (keyword == "material")
+        {
+            if (m_tokenCount < 3) return fail("expected material <name> <type> ...");
+            std::string_view type = m_tokens[2];
+
+            Vector3 color;
+            std::shared_ptr<TextureMaterial> created;
+            if (type == "uniform")
+            {
+                Real diffuse, specular;
+                if (!expect(8, "material <name> uniform <r g b> <diffuse> <specular>") || !vector(3, color) || !number(6, diffuse) || !number(7, specular)) return false;
+                created = std::make_shared<UniformTexture>(color, diffuse, specular);
+            }
+            else if (type == "metal")
+            {
+                Real fuzz;
+                if (!expect(7, "material <name> metal <r g b> <fuzz>") || !vector(3, color) || !number(6, fuzz)) return false;
+                created = std::make_shared<MetalTexture>(color, fuzz);
+            }
+            else if (type == "mirror")
+            {
+                if (!expect(6, "material <name> mirror <r g b>") || !vector(3, color)) return false;
+                created = std::make_shared<MirrorTexture>(color);
+            }
+            else
+            {
+                return fail("unknown material type '" + std::string(type) + "'");
+            }
+
+            NamedMaterial named{ created, scene.addMaterial(created) };
+            if (!m_materials.emplace(m_tokens[1], named).second) return fail("material '" + std::string(m_tokens[1]) + "' is already defined");
+        }
+        else if (keyword == "light")
+        {
+            Vector3 position, color;
+            Real intensity;
+            if (!expect(8, "light <x y z> <r g b> <intensity>") || !vector(1, position) || !vector(4, color) || !number(7, intensity)) return false;
+
+            scene.addLight(std::make_shared<PointLight>(position, color, intensity));
+            m_statistics.lights++;
+        }
+        else if (keyword == "camera")
+        {
+            if (!expect(11, "camera <from x y z> <at x y z> <up x y z> <vfov>") || !vector(1, m_cameraFrom) || !vector(4, m_cameraAt)
+                || !vector(7, m_cameraUp) || !positive(10, m_cameraFov))
+                return false;
+        }
+        else if (keyword == "image")
+        {
+            if (!expect(3, "image <width> <height>") || !number(1, settings.width) || !number(2, settings.height)) return false;
+            if (settings.width <= 0 || settings.height <= 0) return fail("the image size must be positive");
+        }
+        else if (keyword == "samples")
+        {
+            if (!expect(2, "samples <samples per pixel>") || !number(1, settings.samples_per_pixel)) return false;
+            if (settings.samples_per_pixel <= 0) return fail("the samples per pixel must be positive");
+        }
+        else if (keyword == "depth")
+        {
+            if (!expect(2, "depth <max depth>") || !number(1, settings.max_depth)) return false;
+            if (settings.max_depth <= 0) return fail("the depth must be positive");
+        }
+        else
+        {
+            return fail("unknown statement '" + std::string(keyword) + "'");
+        }
+        return true;
+    }
+};
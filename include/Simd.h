@@ -0,0 +1,352 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "Real.h"
+
+// Minimal wrappers over SIMD registers of doubles (SimdDouble) and floats (SimdFloat),
+// used by the ray packet kernels through SimdReal, which matches Real.
+// The width is chosen at compile time: 4 doubles or 8 floats with AVX (configure with
+// -DENABLE_AVX2=ON), 2 doubles or 4 floats with SSE2 (always available on x86-64), and a
+// portable 4 lanes fallback otherwise.
+// Comparisons return a vector whose lanes are all-ones or all-zeros bit masks.
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+struct SimdDouble
+{
+    using Scalar = double;
+    static const int Width = 4;
+
+    __m256d v;
+
+    SimdDouble() : v(_mm256_setzero_pd()) {}
+    SimdDouble(__m256d value) : v(value) {}
+    explicit SimdDouble(double value) : v(_mm256_set1_pd(value)) {}
+
+    static inline SimdDouble load(const double* values) { return SimdDouble(_mm256_loadu_pd(values)); }
+    inline void store(double* values) const { _mm256_storeu_pd(values, v); }
+
+    // Bit i is set when lane i of the mask is set.
+    inline int bits() const { return _mm256_movemask_pd(v); }
+};
+
+inline SimdDouble operator+(SimdDouble a, SimdDouble b) { return _mm256_add_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a, SimdDouble b) { return _mm256_sub_pd(a.v, b.v); }
+inline SimdDouble operator*(SimdDouble a, SimdDouble b) { return _mm256_mul_pd(a.v, b.v); }
+inline SimdDouble operator/(SimdDouble a, SimdDouble b) { return _mm256_div_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+inline SimdDouble operator&(SimdDouble a, SimdDouble b) { return _mm256_and_pd(a.v, b.v); }
+inline SimdDouble operator|(SimdDouble a, SimdDouble b) { return _mm256_or_pd(a.v, b.v); }
+inline SimdDouble AndNot(SimdDouble mask, SimdDouble b) { return _mm256_andnot_pd(mask.v, b.v); }
+inline SimdDouble operator<(SimdDouble a, SimdDouble b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+inline SimdDouble operator<=(SimdDouble a, SimdDouble b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ); }
+inline SimdDouble operator>(SimdDouble a, SimdDouble b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+inline SimdDouble operator>=(SimdDouble a, SimdDouble b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ); }
+inline SimdDouble operator!=(SimdDouble a, SimdDouble b) { return _mm256_cmp_pd(a.v, b.v, _CMP_NEQ_UQ); }
+// Returns b where a or b is NaN, like the SSE/AVX instructions.
+inline SimdDouble Min(SimdDouble a, SimdDouble b) { return _mm256_min_pd(a.v, b.v); }
+inline SimdDouble Max(SimdDouble a, SimdDouble b) { return _mm256_max_pd(a.v, b.v); }
+inline SimdDouble Sqrt(SimdDouble a) { return _mm256_sqrt_pd(a.v); }
+// Picks a where mask is set, b elsewhere.
+inline SimdDouble Select(SimdDouble mask, SimdDouble a, SimdDouble b) { return _mm256_blendv_pd(b.v, a.v, mask.v); }
+inline SimdDouble MaskFromBits(SimdDouble, int bits)
+{
+    return _mm256_castsi256_pd(_mm256_set_epi64x(bits & 8 ? -1 : 0, bits & 4 ? -1 : 0, bits & 2 ? -1 : 0, bits & 1 ? -1 : 0));
+}
+
+struct SimdFloat
+{
+    using Scalar = float;
+    static const int Width = 8;
+
+    __m256 v;
+
+    SimdFloat() : v(_mm256_setzero_ps()) {}
+    SimdFloat(__m256 value) : v(value) {}
+    explicit SimdFloat(float value) : v(_mm256_set1_ps(value)) {}
+
+    static inline SimdFloat load(const float* values) { return SimdFloat(_mm256_loadu_ps(values)); }
+    inline void store(float* values) const { _mm256_storeu_ps(values, v); }
+
+    // Conversions from and to 32-bit integers, truncating towards zero.
+    static inline SimdFloat loadInts(const int32_t* values) { return SimdFloat(_mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)))); }
+    inline void storeInts(int32_t* values) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(values), _mm256_cvttps_epi32(v)); }
+
+    // Bit i is set when lane i of the mask is set.
+    inline int bits() const { return _mm256_movemask_ps(v); }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline SimdFloat operator&(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a.v, b.v); }
+inline SimdFloat operator|(SimdFloat a, SimdFloat b) { return _mm256_or_ps(a.v, b.v); }
+inline SimdFloat AndNot(SimdFloat mask, SimdFloat b) { return _mm256_andnot_ps(mask.v, b.v); }
+inline SimdFloat operator<(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline SimdFloat operator<=(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline SimdFloat operator>(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline SimdFloat operator>=(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline SimdFloat operator!=(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ); }
+inline SimdFloat Min(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a.v, b.v); }
+inline SimdFloat Max(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a.v, b.v); }
+inline SimdFloat Sqrt(SimdFloat a) { return _mm256_sqrt_ps(a.v); }
+inline SimdFloat Select(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+inline SimdFloat MaskFromBits(SimdFloat, int bits)
+{
+    return _mm256_castsi256_ps(_mm256_set_epi32(
+        bits & 128 ? -1 : 0, bits & 64 ? -1 : 0, bits & 32 ? -1 : 0, bits & 16 ? -1 : 0,
+        bits & 8 ? -1 : 0, bits & 4 ? -1 : 0, bits & 2 ? -1 : 0, bits & 1 ? -1 : 0));
+}
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+struct SimdDouble
+{
+    using Scalar = double;
+    static const int Width = 2;
+
+    __m128d v;
+
+    SimdDouble() : v(_mm_setzero_pd()) {}
+    SimdDouble(__m128d value) : v(value) {}
+    explicit SimdDouble(double value) : v(_mm_set1_pd(value)) {}
+
+    static inline SimdDouble load(const double* values) { return SimdDouble(_mm_loadu_pd(values)); }
+    inline void store(double* values) const { _mm_storeu_pd(values, v); }
+
+    // Bit i is set when lane i of the mask is set.
+    inline int bits() const { return _mm_movemask_pd(v); }
+};
+
+inline SimdDouble operator+(SimdDouble a, SimdDouble b) { return _mm_add_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a, SimdDouble b) { return _mm_sub_pd(a.v, b.v); }
+inline SimdDouble operator*(SimdDouble a, SimdDouble b) { return _mm_mul_pd(a.v, b.v); }
+inline SimdDouble operator/(SimdDouble a, SimdDouble b) { return _mm_div_pd(a.v, b.v); }
+inline SimdDouble operator-(SimdDouble a) { return _mm_xor_pd(a.v, _mm_set1_pd(-0.0)); }
+inline SimdDouble operator&(SimdDouble a, SimdDouble b) { return _mm_and_pd(a.v, b.v); }
+inline SimdDouble operator|(SimdDouble a, SimdDouble b) { return _mm_or_pd(a.v, b.v); }
+inline SimdDouble AndNot(SimdDouble mask, SimdDouble b) { return _mm_andnot_pd(mask.v, b.v); }
+inline SimdDouble operator<(SimdDouble a, SimdDouble b) { return _mm_cmplt_pd(a.v, b.v); }
+inline SimdDouble operator<=(SimdDouble a, SimdDouble b) { return _mm_cmple_pd(a.v, b.v); }
+inline SimdDouble operator>(SimdDouble a, SimdDouble b) { return _mm_cmpgt_pd(a.v, b.v); }
+inline SimdDouble operator>=(SimdDouble a, SimdDouble b) { return _mm_cmpge_pd(a.v, b.v); }
+inline SimdDouble operator!=(SimdDouble a, SimdDouble b) { return _mm_cmpneq_pd(a.v, b.v); }
+// Returns b where a or b is NaN, like the SSE/AVX instructions.
+inline SimdDouble Min(SimdDouble a, SimdDouble b) { return _mm_min_pd(a.v, b.v); }
+inline SimdDouble Max(SimdDouble a, SimdDouble b) { return _mm_max_pd(a.v, b.v); }
+inline SimdDouble Sqrt(SimdDouble a) { return _mm_sqrt_pd(a.v); }
+// Picks a where mask is set, b elsewhere.
+inline SimdDouble Select(SimdDouble mask, SimdDouble a, SimdDouble b) { return _mm_or_pd(_mm_and_pd(mask.v, a.v), _mm_andnot_pd(mask.v, b.v)); }
+inline SimdDouble MaskFromBits(SimdDouble, int bits)
+{
+    return _mm_castsi128_pd(_mm_set_epi64x(bits & 2 ? -1 : 0, bits & 1 ? -1 : 0));
+}
+
+struct SimdFloat
+{
+    using Scalar = float;
+    static const int Width = 4;
+
+    __m128 v;
+
+    SimdFloat() : v(_mm_setzero_ps()) {}
+    SimdFloat(__m128 value) : v(value) {}
+    explicit SimdFloat(float value) : v(_mm_set1_ps(value)) {}
+
+    static inline SimdFloat load(const float* values) { return SimdFloat(_mm_loadu_ps(values)); }
+    inline void store(float* values) const { _mm_storeu_ps(values, v); }
+
+    // Conversions from and to 32-bit integers, truncating towards zero.
+    static inline SimdFloat loadInts(const int32_t* values) { return SimdFloat(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)))); }
+    inline void storeInts(int32_t* values) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(values), _mm_cvttps_epi32(v)); }
+
+    // Bit i is set when lane i of the mask is set.
+    inline int bits() const { return _mm_movemask_ps(v); }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return _mm_div_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline SimdFloat operator&(SimdFloat a, SimdFloat b) { return _mm_and_ps(a.v, b.v); }
+inline SimdFloat operator|(SimdFloat a, SimdFloat b) { return _mm_or_ps(a.v, b.v); }
+inline SimdFloat AndNot(SimdFloat mask, SimdFloat b) { return _mm_andnot_ps(mask.v, b.v); }
+inline SimdFloat operator<(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline SimdFloat operator<=(SimdFloat a, SimdFloat b) { return _mm_cmple_ps(a.v, b.v); }
+inline SimdFloat operator>(SimdFloat a, SimdFloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline SimdFloat operator>=(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline SimdFloat operator!=(SimdFloat a, SimdFloat b) { return _mm_cmpneq_ps(a.v, b.v); }
+inline SimdFloat Min(SimdFloat a, SimdFloat b) { return _mm_min_ps(a.v, b.v); }
+inline SimdFloat Max(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+inline SimdFloat Sqrt(SimdFloat a) { return _mm_sqrt_ps(a.v); }
+inline SimdFloat Select(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+inline SimdFloat MaskFromBits(SimdFloat, int bits)
+{
+    return _mm_castsi128_ps(_mm_set_epi32(bits & 8 ? -1 : 0, bits & 4 ? -1 : 0, bits & 2 ? -1 : 0, bits & 1 ? -1 : 0));
+}
+
+#else
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+template<typename T>
+struct SimdArray
+{
+    using Scalar = T;
+    static const int Width = 4;
+
+    T v[Width];
+
+    SimdArray() : v{ 0, 0, 0, 0 } {}
+    explicit SimdArray(T value) : v{ value, value, value, value } {}
+
+    static inline SimdArray load(const T* values)
+    {
+        SimdArray result;
+        for (int i = 0; i < Width; i++) result.v[i] = values[i];
+        return result;
+    }
+
+    inline void store(T* values) const
+    {
+        for (int i = 0; i < Width; i++) values[i] = v[i];
+    }
+
+    // Conversions from and to 32-bit integers, truncating towards zero.
+    static inline SimdArray loadInts(const int32_t* values)
+    {
+        SimdArray result;
+        for (int i = 0; i < Width; i++) result.v[i] = static_cast<T>(values[i]);
+        return result;
+    }
+
+    inline void storeInts(int32_t* values) const
+    {
+        for (int i = 0; i < Width; i++) values[i] = static_cast<int32_t>(v[i]);
+    }
+
+    // Bit i is set when lane i of the mask is set.
+    inline int bits() const
+    {
+        int result = 0;
+        for (int i = 0; i < Width; i++) result |= std::signbit(v[i]) ? (1 << i) : 0;
+        return result;
+    }
+};
+
+using SimdDouble = SimdArray<double>;
+using SimdFloat = SimdArray<float>;
+
+namespace SimdDetail
+{
+    template<typename T>
+    using Bits = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+
+    template<typename T>
+    inline T fromBits(Bits<T> bits) { T value; std::memcpy(&value, &bits, sizeof(value)); return value; }
+    template<typename T>
+    inline Bits<T> toBits(T value) { Bits<T> bits; std::memcpy(&bits, &value, sizeof(bits)); return bits; }
+    template<typename T>
+    inline T mask(bool set) { return fromBits<T>(set ? ~Bits<T>(0) : Bits<T>(0)); }
+
+    template<typename T, typename Op>
+    inline SimdArray<T> map(SimdArray<T> a, SimdArray<T> b, Op op)
+    {
+        SimdArray<T> result;
+        for (int i = 0; i < SimdArray<T>::Width; i++) result.v[i] = op(a.v[i], b.v[i]);
+        return result;
+    }
+}
+
+template<typename T> inline SimdArray<T> operator+(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return x + y; }); }
+template<typename T> inline SimdArray<T> operator-(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return x - y; }); }
+template<typename T> inline SimdArray<T> operator*(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return x * y; }); }
+template<typename T> inline SimdArray<T> operator/(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return x / y; }); }
+template<typename T> inline SimdArray<T> operator-(SimdArray<T> a) { return SimdDetail::map(a, a, [](T x, T) { return -x; }); }
+template<typename T>
+inline SimdArray<T> operator&(SimdArray<T> a, SimdArray<T> b)
+{
+    return SimdDetail::map(a, b, [](T x, T y) { return SimdDetail::fromBits<T>(SimdDetail::toBits(x) & SimdDetail::toBits(y)); });
+}
+template<typename T>
+inline SimdArray<T> operator|(SimdArray<T> a, SimdArray<T> b)
+{
+    return SimdDetail::map(a, b, [](T x, T y) { return SimdDetail::fromBits<T>(SimdDetail::toBits(x) | SimdDetail::toBits(y)); });
+}
+template<typename T>
+inline SimdArray<T> AndNot(SimdArray<T> mask, SimdArray<T> b)
+{
+    return SimdDetail::map(mask, b, [](T x, T y) { return SimdDetail::fromBits<T>(~SimdDetail::toBits(x) & SimdDetail::toBits(y)); });
+}
+template<typename T> inline SimdArray<T> operator<(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return SimdDetail::mask<T>(x < y); }); }
+template<typename T> inline SimdArray<T> operator<=(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return SimdDetail::mask<T>(x <= y); }); }
+template<typename T> inline SimdArray<T> operator>(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return SimdDetail::mask<T>(x > y); }); }
+template<typename T> inline SimdArray<T> operator>=(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return SimdDetail::mask<T>(x >= y); }); }
+template<typename T> inline SimdArray<T> operator!=(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return SimdDetail::mask<T>(!(x == y)); }); }
+// Returns b where a or b is NaN, like the SSE/AVX instructions.
+template<typename T> inline SimdArray<T> Min(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return x < y ? x : y; }); }
+template<typename T> inline SimdArray<T> Max(SimdArray<T> a, SimdArray<T> b) { return SimdDetail::map(a, b, [](T x, T y) { return x > y ? x : y; }); }
+template<typename T> inline SimdArray<T> Sqrt(SimdArray<T> a) { return SimdDetail::map(a, a, [](T x, T) { return std::sqrt(x); }); }
+// Picks a where mask is set, b elsewhere.
+template<typename T> inline SimdArray<T> Select(SimdArray<T> mask, SimdArray<T> a, SimdArray<T> b) { return (mask & a) | AndNot(mask, b); }
+template<typename T>
+inline SimdArray<T> MaskFromBits(SimdArray<T>, int bits)
+{
+    SimdArray<T> result;
+    for (int i = 0; i < SimdArray<T>::Width; i++) result.v[i] = SimdDetail::mask<T>(bits & (1 << i));
+    return result;
+}
+
+#endif
+
+#if RAYTRACER_USE_FLOAT
+using SimdReal = SimdFloat;
+#else
+using SimdReal = SimdDouble;
+#endif
+
+// Mask of the lanes set in bits, as a vector of type Simd.
+template<typename Simd>
+inline Simd MaskFromBits(int bits) { return MaskFromBits(Simd(), bits); }
+
+template<typename Simd>
+inline bool Any(Simd mask) { return mask.bits() != 0; }
+
+template<typename Simd>
+inline typename Simd::Scalar Lane(Simd value, int lane)
+{
+    typename Simd::Scalar values[Simd::Width];
+    value.store(values);
+    return values[lane];
+}
+
+template<typename Simd>
+inline typename Simd::Scalar HorizontalMin(Simd value)
+{
+    typename Simd::Scalar values[Simd::Width];
+    value.store(values);
+    typename Simd::Scalar result = values[0];
+    for (int i = 1; i < Simd::Width; i++) result = values[i] < result ? values[i] : result;
+    return result;
+}
+
+template<typename Simd>
+inline typename Simd::Scalar HorizontalMax(Simd value)
+{
+    typename Simd::Scalar values[Simd::Width];
+    value.store(values);
+    typename Simd::Scalar result = values[0];
+    for (int i = 1; i < Simd::Width; i++) result = values[i] > result ? values[i] : result;
+    return result;
+}
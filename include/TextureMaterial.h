@@ -1,29 +1,65 @@
 #pragma once
 
+#include <cstddef>
+
 #include "Vector.h"
+#include "Ray.h"
+#include "Object.h"
 
-struct hit_record;
+// One ray of a batched texture lookup, see TextureMaterial::getTexturesAt.
+struct TextureQuery
+{
+    const Ray* ray_in = nullptr;
+    const hit_record* record = nullptr;
+    Sampler* sampler = nullptr;
+    Color3 color = Color3(0, 0, 0);
+    Ray ray_out = Ray();
+    Real diffuse = 0.0;
+    Real specular = 0.0;
+    bool scattered = false;
+};
 
 class TextureMaterial
 {
 public:
     virtual ~TextureMaterial() = default;
 
-    virtual bool getTextureAt(const Ray& ray_in, const hit_record& record, Color3& color, Ray& ray_out, double& diffuse, double& specular) const = 0;
+    virtual bool getTextureAt(const Ray& ray_in, const hit_record& record, Color3& color, Ray& ray_out, Real& diffuse, Real& specular, Sampler& sampler) const = 0;
+
+    // Runs getTextureAt for a batch of rays that all hit this material, paying a single
+    // virtual call for the whole batch.
+    virtual void getTexturesAt(TextureQuery* queries, size_t count) const = 0;
+};
+
+// Implements getTexturesAt with statically dispatched (and inlinable) calls to
+// Derived::getTextureAt.
+template<typename Derived>
+class BatchedTextureMaterial : public TextureMaterial
+{
+public:
+    virtual void getTexturesAt(TextureQuery* queries, size_t count) const override
+    {
+        const Derived& self = static_cast<const Derived&>(*this);
+        for (size_t i = 0; i < count; i++)
+        {
+            TextureQuery& query = queries[i];
+            query.scattered = self.Derived::getTextureAt(*query.ray_in, *query.record, query.color, query.ray_out, query.diffuse, query.specular, *query.sampler);
+        }
+    }
 };
 
-class UniformTexture : public TextureMaterial
+class UniformTexture : public BatchedTextureMaterial<UniformTexture>
 {
 public:
-    UniformTexture(const Color3& color, double diffuse, double specular)
+    UniformTexture(const Color3& color, Real diffuse, Real specular)
         : m_color(color), m_diffuse(diffuse), m_specular(specular) 
         {}
 
-    virtual bool getTextureAt(const Ray& ray_in, const hit_record& record, Color3& color, Ray& ray_out, double& diffuse, double& specular) const override
+    virtual bool getTextureAt(const Ray& /* ray_in */, const hit_record& record, Color3& color, Ray& ray_out, Real& diffuse, Real& specular, Sampler& sampler) const override
     {
-        auto dispersed_direction = record.normal + RandomInUnitSphereVector();
+        auto dispersed_direction = record.normal + RandomInUnitSphereVector(sampler);
         if (dispersed_direction.nearZero()) dispersed_direction = record.normal;
-        ray_out = Ray(record.p, dispersed_direction);
+        ray_out = record.spawn_ray(dispersed_direction);
         color = m_color;
         diffuse = m_diffuse;
         specular = m_specular;
@@ -31,26 +67,26 @@ public:
     }
 
     inline const Color3& getColor() const { return m_color; }
-    inline double getDiffuse() const { return m_diffuse; }
-    inline double getSpecular() const { return m_specular; }
+    inline Real getDiffuse() const { return m_diffuse; }
+    inline Real getSpecular() const { return m_specular; }
 
 private:
     Color3 m_color;
-    double m_diffuse;
-    double m_specular;
+    Real m_diffuse;
+    Real m_specular;
 };
 
-class MirrorTexture : public TextureMaterial
+class MirrorTexture : public BatchedTextureMaterial<MirrorTexture>
 {
 public:
     MirrorTexture(const Color3& color)
         : m_color(color) 
         {}
 
-    virtual bool getTextureAt(const Ray& ray_in, const hit_record& record, Color3& color, Ray& ray_out, double& diffuse, double& specular) const override
+    virtual bool getTextureAt(const Ray& ray_in, const hit_record& record, Color3& color, Ray& ray_out, Real& /* diffuse */, Real& /* specular */, Sampler& /* sampler */) const override
     {
         Vector3 reflected = reflect(Normalize(ray_in.direction()), record.normal);
-        ray_out = Ray(record.p, reflected);
+        ray_out = record.spawn_ray(reflected);
         color = m_color;
         return true;
     }
@@ -59,22 +95,22 @@ private:
 };
 
 
-class MetalTexture : public TextureMaterial
+class MetalTexture : public BatchedTextureMaterial<MetalTexture>
 {
 public:
-    MetalTexture(const Color3& color, double fuzz)
+    MetalTexture(const Color3& color, Real fuzz)
         : m_color(color), m_fuzz(fuzz < 1 ? fuzz : 1) 
         {}
     
-    virtual bool getTextureAt(const Ray& ray_in, const hit_record& record, Color3& color, Ray& ray_out, double& diffuse, double& specular) const override
+    virtual bool getTextureAt(const Ray& ray_in, const hit_record& record, Color3& color, Ray& ray_out, Real& /* diffuse */, Real& /* specular */, Sampler& sampler) const override
     {
         Vector3 reflected = reflect(Normalize(ray_in.direction()), record.normal);
-        ray_out = Ray(record.p, reflected + m_fuzz * RandomInUnitSphereVector());
+        ray_out = record.spawn_ray(reflected + m_fuzz * RandomInUnitSphereVector(sampler));
         color = m_color;
         return (Dot(ray_out.direction(), record.normal) > 0);
     }
 
 private:
     Color3 m_color;
-    double m_fuzz;
+    Real m_fuzz;
 };
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+// Rectangle of pixels [x0, x1) x [y0, y1), the unit of work of the renderer.
+struct Tile
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+
+    inline int getWidth() const { return x1 - x0; }
+    inline int getHeight() const { return y1 - y0; }
+};
+
+enum class TileOrder
+{
+    Scanline, // Row by row from the top, as image files are stored.
+    Morton,   // Z-order curve, neighbouring tiles are processed close in time.
+    Spiral    // From the center outwards, the interesting part of the frame comes first.
+};
+
+inline bool parseTileOrder(const std::string& name, TileOrder& order)
+{
+    if (name == "scanline") order = TileOrder::Scanline;
+    else if (name == "morton") order = TileOrder::Morton;
+    else if (name == "spiral") order = TileOrder::Spiral;
+    else return false;
+    return true;
+}
+
+// Interleaves the bits of x and y.
+inline uint64_t mortonCode(uint32_t x, uint32_t y)
+{
+    auto spread = [](uint64_t v)
+    {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        v = (v | (v << 2)) & 0x3333333333333333ULL;
+        v = (v | (v << 1)) & 0x5555555555555555ULL;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+inline std::vector<Tile> makeTiles(int width, int height, int tile_size, TileOrder order = TileOrder::Scanline)
+{
+    struct Entry { Tile tile; double key; double angle; };
+    std::vector<Entry> entries;
+
+    int tilesX = (width + tile_size - 1) / tile_size;
+    int tilesY = (height + tile_size - 1) / tile_size;
+    for (int ty = 0; ty < tilesY; ty++)
+    {
+        for (int tx = 0; tx < tilesX; tx++)
+        {
+            // Rows of tiles from the top of the image, where image files start, so that
+            // the rows can be written out while the rest renders (see ImageStream).
+            int y1 = height - ty * tile_size;
+            Tile tile{ tx * tile_size, std::max(0, y1 - tile_size), std::min((tx + 1) * tile_size, width), y1 };
+            double dx = tx - (tilesX - 1) / 2.0;
+            double dy = ty - (tilesY - 1) / 2.0;
+
+            double key = 0.0;
+            if (order == TileOrder::Morton) key = static_cast<double>(mortonCode(tx, ty));
+            else if (order == TileOrder::Spiral) key = std::max(std::fabs(dx), std::fabs(dy));
+
+            entries.push_back(Entry{ tile, key, std::atan2(dy, dx) });
+        }
+    }
+
+    if (order != TileOrder::Scanline)
+    {
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+        {
+            return a.key != b.key ? a.key < b.key : a.angle < b.angle;
+        });
+    }
+
+    std::vector<Tile> tiles;
+    tiles.reserve(entries.size());
+    for (const auto& entry : entries)
+        tiles.push_back(entry.tile);
+    return tiles;
+}
+
+struct SchedulerSettings
+{
+    int threads = 0;      // 0 lets TBB use every available core.
+    int grain_size = 1;   // Number of consecutive tiles below which TBB stops splitting.
+    TileOrder order = TileOrder::Morton;
+};
+
+// Runs tiles on a dedicated TBB task arena. TBB work stealing balances the load between
+// threads, and the time spent on every tile is recorded for later reporting. The times add
+// up over the runs of the same tile layout, e.g. the passes of a progressive render, which
+// run every tile or some of them; a run with a tile of another layout starts over.
+class TileScheduler
+{
+public:
+    explicit TileScheduler(const SchedulerSettings& settings)
+        : m_settings(settings)
+        , m_arena(settings.threads > 0 ? settings.threads : tbb::task_arena::automatic)
+    {}
+
+    inline const SchedulerSettings& getSettings() const { return m_settings; }
+
+    int getThreadCount()
+    {
+        int count = 0;
+        m_arena.execute([&]() { count = tbb::this_task_arena::max_concurrency(); });
+        return count;
+    }
+
+    // Calls tileFunction(tile) for every tile, in parallel.
+    template<typename TileFunction>
+    void run(const std::vector<Tile>& tiles, TileFunction&& tileFunction)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::vector<size_t> entries = findEntries(tiles);
+
+        auto start = Clock::now();
+        m_arena.execute([&]()
+        {
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, tiles.size(), std::max(1, m_settings.grain_size)),
+                [&](const tbb::blocked_range<size_t>& range)
+            {
+                for (size_t t = range.begin(); t != range.end(); t++)
+                {
+                    auto tileStart = Clock::now();
+                    tileFunction(tiles[t]);
+                    TileTiming& timing = m_timings[entries[t]];
+                    timing.seconds += std::chrono::duration<double>(Clock::now() - tileStart).count();
+                    timing.thread = tbb::this_task_arena::current_thread_index();
+                }
+            });
+        });
+        m_totalSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+        m_runs++;
+    }
+
+    // Prints one line per tile, with the time it took over the runs of its layout and the
+    // thread of its last run, followed by a summary.
+    void report(std::ostream& out)
+    {
+        if (m_timings.empty()) return;
+
+        std::ios_base::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(3);
+        out << "tile x y width height thread ms" << std::endl;
+        for (size_t t = 0; t < m_tiles.size(); t++)
+        {
+            const Tile& tile = m_tiles[t];
+            out << t << " " << tile.x0 << " " << tile.y0 << " " << tile.getWidth() << " " << tile.getHeight()
+                << " " << m_timings[t].thread << " " << m_timings[t].seconds * 1e3 << std::endl;
+        }
+
+        double sum = 0.0;
+        double minimum = m_timings[0].seconds;
+        double maximum = m_timings[0].seconds;
+        for (const auto& timing : m_timings)
+        {
+            sum += timing.seconds;
+            minimum = std::min(minimum, timing.seconds);
+            maximum = std::max(maximum, timing.seconds);
+        }
+
+        int threads = getThreadCount();
+        out << m_tiles.size() << " tiles on " << threads << " threads in " << m_totalSeconds * 1e3 << " ms over " << m_runs << " runs, per tile min "
+            << minimum * 1e3 << " / mean " << sum / m_timings.size() * 1e3 << " / max " << maximum * 1e3 << " ms, parallel efficiency "
+            << std::setprecision(1) << 100.0 * sum / (m_totalSeconds * threads) << "%" << std::endl;
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    struct TileTiming
+    {
+        double seconds = 0.0;
+        int thread = -1;
+    };
+
+    SchedulerSettings m_settings;
+    tbb::task_arena m_arena;
+    std::vector<Tile> m_tiles;
+    std::vector<TileTiming> m_timings;
+    std::map<std::pair<int, int>, size_t> m_tileEntries; // Entry of the tile at (x0, y0).
+    double m_totalSeconds = 0.0;
+    int m_runs = 0;
+
+    // Returns the entry of every tile in m_timings, starting over with tiles as the layout if
+    // one of them is not in the current layout.
+    std::vector<size_t> findEntries(const std::vector<Tile>& tiles)
+    {
+        std::vector<size_t> entries;
+        entries.reserve(tiles.size());
+        for (const Tile& tile : tiles)
+        {
+            auto found = m_tileEntries.find({ tile.x0, tile.y0 });
+            if (found == m_tileEntries.end() || m_tiles[found->second].x1 != tile.x1 || m_tiles[found->second].y1 != tile.y1) break;
+            entries.push_back(found->second);
+        }
+        if (entries.size() == tiles.size()) return entries;
+
+        m_tiles = tiles;
+        m_timings.assign(tiles.size(), TileTiming{});
+        m_tileEntries.clear();
+        entries.clear();
+        for (size_t t = 0; t < tiles.size(); t++)
+        {
+            m_tileEntries[{ tiles[t].x0, tiles[t].y0 }] = t;
+            entries.push_back(t);
+        }
+        m_totalSeconds = 0.0;
+        m_runs = 0;
+        return entries;
+    }
+};
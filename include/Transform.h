@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmath>
+
+#include "AABB.h"
+#include "Ray.h"
+#include "Vector.h"
+
+// Affine transform p -> M p + t, stored as a 3x4 matrix [M | t] along with its inverse so
+// that both directions cost the same.
+class Transform
+{
+public:
+    Transform()
+    {
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                m_matrix[row][column] = row == column ? 1 : 0;
+                m_inverse[row][column] = row == column ? 1 : 0;
+            }
+        }
+    }
+
+    static Transform translation(const Vector3& offset)
+    {
+        Transform transform;
+        for (int row = 0; row < 3; row++)
+        {
+            transform.m_matrix[row][3] = offset[row];
+            transform.m_inverse[row][3] = -offset[row];
+        }
+        return transform;
+    }
+
+    // Factors must not be 0.
+    static Transform scaling(const Vector3& factors)
+    {
+        Transform transform;
+        for (int row = 0; row < 3; row++)
+        {
+            transform.m_matrix[row][row] = factors[row];
+            transform.m_inverse[row][row] = 1 / factors[row];
+        }
+        return transform;
+    }
+
+    // Rotation of angle degrees around axis, counterclockwise looking down the axis.
+    static Transform rotation(const Vector3& axis, Real degrees)
+    {
+        Vector3 a = Normalize(axis);
+        Real radians = degrees * Real(M_PI) / 180;
+        Real c = std::cos(radians), s = std::sin(radians);
+        Real x = a.getX(), y = a.getY(), z = a.getZ();
+        Real rotation[3][3] = {
+            { c + x * x * (1 - c), x * y * (1 - c) - z * s, x * z * (1 - c) + y * s },
+            { y * x * (1 - c) + z * s, c + y * y * (1 - c), y * z * (1 - c) - x * s },
+            { z * x * (1 - c) - y * s, z * y * (1 - c) + x * s, c + z * z * (1 - c) } };
+
+        // The inverse of a rotation is its transpose.
+        Transform transform;
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 3; column++)
+            {
+                transform.m_matrix[row][column] = rotation[row][column];
+                transform.m_inverse[row][column] = rotation[column][row];
+            }
+        }
+        return transform;
+    }
+
+    // Applies other, then this transform.
+    Transform operator*(const Transform& other) const
+    {
+        Transform product;
+        multiply(m_matrix, other.m_matrix, product.m_matrix);
+        multiply(other.m_inverse, m_inverse, product.m_inverse);
+        return product;
+    }
+
+    Transform inverse() const
+    {
+        Transform transform;
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                transform.m_matrix[row][column] = m_inverse[row][column];
+                transform.m_inverse[row][column] = m_matrix[row][column];
+            }
+        }
+        return transform;
+    }
+
+    inline Point3 applyPoint(const Point3& p) const { return applyVector(p) + Vector3(m_matrix[0][3], m_matrix[1][3], m_matrix[2][3]); }
+
+    inline Vector3 applyVector(const Vector3& v) const
+    {
+        return Vector3(m_matrix[0][0] * v.getX() + m_matrix[0][1] * v.getY() + m_matrix[0][2] * v.getZ(),
+            m_matrix[1][0] * v.getX() + m_matrix[1][1] * v.getY() + m_matrix[1][2] * v.getZ(),
+            m_matrix[2][0] * v.getX() + m_matrix[2][1] * v.getY() + m_matrix[2][2] * v.getZ());
+    }
+
+    // Normals transform by the inverse transpose, to stay perpendicular to the surface. The
+    // result is not normalized.
+    inline Vector3 applyNormal(const Vector3& n) const
+    {
+        return Vector3(m_inverse[0][0] * n.getX() + m_inverse[1][0] * n.getY() + m_inverse[2][0] * n.getZ(),
+            m_inverse[0][1] * n.getX() + m_inverse[1][1] * n.getY() + m_inverse[2][1] * n.getZ(),
+            m_inverse[0][2] * n.getX() + m_inverse[1][2] * n.getY() + m_inverse[2][2] * n.getZ());
+    }
+
+    // The direction is transformed without normalization, so distances along the ray are
+    // the same in both spaces.
+    inline Ray applyRay(const Ray& ray) const { return Ray(applyPoint(ray.origin()), applyVector(ray.direction())); }
+
+    // Bounds of the transformed corners of box.
+    AABB applyBox(const AABB& box) const
+    {
+        AABB bounds;
+        if (box.isEmpty()) return bounds;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            Point3 p((corner & 1 ? box.getMax() : box.getMin()).getX(), (corner & 2 ? box.getMax() : box.getMin()).getY(),
+                (corner & 4 ? box.getMax() : box.getMin()).getZ());
+            bounds.grow(applyPoint(p));
+        }
+        return bounds;
+    }
+
+    // Element of [M | t].
+    inline Real get(int row, int column) const { return m_matrix[row][column]; }
+
+private:
+    Real m_matrix[3][4];
+    Real m_inverse[3][4];
+
+    // c = a b, the fourth row of the matrices being implicitly (0, 0, 0, 1).
+    static void multiply(const Real a[3][4], const Real b[3][4], Real c[3][4])
+    {
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                Real sum = column == 3 ? a[row][3] : 0;
+                for (int k = 0; k < 3; k++)
+                    sum += a[row][k] * b[k][column];
+                c[row][column] = sum;
+            }
+        }
+    }
+};
@@ -1,26 +1,34 @@
 #pragma once
 
+#include <bit>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <type_traits>
 
+#include "Real.h"
 #include "Utils.h"
 
-class Vector3
+// Three component vector of scalar type T (see Real.h), also used for points and colors.
+template<typename T>
+class Vector3T
 {
 public:
-    Vector3() : m_x(0.0f), m_y(0.0f), m_z(0.0f) {}
-    Vector3(double x, double y, double z) : m_x(x), m_y(y), m_z(z) {}
-    Vector3(const Vector3& other) : m_x(other.m_x), m_y(other.m_y), m_z(other.m_z) {}
+    Vector3T() : m_x(0), m_y(0), m_z(0) {}
+    Vector3T(T x, T y, T z) : m_x(x), m_y(y), m_z(z) {}
+    Vector3T(const Vector3T& other) = default;
 
-    inline double getX() const { return m_x; }
-    inline double getY() const { return m_y; }
-    inline double getZ() const { return m_z; }
+    inline T getX() const { return m_x; }
+    inline T getY() const { return m_y; }
+    inline T getZ() const { return m_z; }
 
-    Vector3& operator=(const Vector3& other) { m_x = other.m_x; m_y = other.m_y; m_z = other.m_z; return *this; }
+    inline T operator[](int axis) const { return axis == 0 ? m_x : (axis == 1 ? m_y : m_z); }
 
-    Vector3 operator-() const { return Vector3(-m_x, -m_y, -m_z); }
+    Vector3T& operator=(const Vector3T& other) = default;
 
-    Vector3& operator+=(const Vector3& other)
+    Vector3T operator-() const { return Vector3T(-m_x, -m_y, -m_z); }
+
+    Vector3T& operator+=(const Vector3T& other)
     {
         m_x += other.m_x;
         m_y += other.m_y;
@@ -28,7 +36,7 @@ public:
         return *this;
     }
 
-    Vector3& operator*=(double scalar)
+    Vector3T& operator*=(T scalar)
     {
         m_x *= scalar;
         m_y *= scalar;
@@ -36,108 +44,156 @@ public:
         return *this;
     }
 
-    Vector3& operator/=(double scalar)
+    Vector3T& operator/=(T scalar)
     {
-        return *this *= (1.0f / scalar);
+        return *this *= (T(1) / scalar);
     }
 
-    double LengthSquared() const
+    T LengthSquared() const
     {
         return m_x * m_x + m_y * m_y + m_z * m_z;
     }
 
-    double Length() const
+    T Length() const
     {
         return std::sqrt(LengthSquared());
     }
 
-    inline static Vector3 random() { return Vector3(RandomDouble(), RandomDouble(), RandomDouble()); }
+    inline static Vector3T random(Sampler& sampler) { return Vector3T(RandomDouble(sampler), RandomDouble(sampler), RandomDouble(sampler)); }
 
-    inline static Vector3 random(double min, double max)
+    inline static Vector3T random(Sampler& sampler, T min, T max)
     { 
-        return Vector3(RandomDouble(min, max), RandomDouble(min, max), RandomDouble(min, max));
+        return Vector3T(RandomDouble(sampler, min, max), RandomDouble(sampler, min, max), RandomDouble(sampler, min, max));
     }
 
     inline bool nearZero() const
     {
-        const double s = 1e-8;
+        const T s = Epsilon<T>::NearZero;
         return (std::fabs(m_x) < s) && (std::fabs(m_y) < s) && (std::fabs(m_z) < s);
     }
 
     private:
-        double m_x;
-        double m_y;
-        double m_z;
+        T m_x;
+        T m_y;
+        T m_z;
 };
 
-inline Vector3 operator+(const Vector3& left, const Vector3& right)
+template<typename T>
+inline Vector3T<T> operator+(const Vector3T<T>& left, const Vector3T<T>& right)
 {
-    return Vector3(left.getX() + right.getX(), left.getY() + right.getY(), left.getZ() + right.getZ());
+    return Vector3T<T>(left.getX() + right.getX(), left.getY() + right.getY(), left.getZ() + right.getZ());
 }
 
-inline Vector3 operator-(const Vector3& left, const Vector3& right)
+template<typename T>
+inline Vector3T<T> operator-(const Vector3T<T>& left, const Vector3T<T>& right)
 {
-    return Vector3(left.getX() - right.getX(), left.getY() - right.getY(), left.getZ() - right.getZ());
-}    
+    return Vector3T<T>(left.getX() - right.getX(), left.getY() - right.getY(), left.getZ() - right.getZ());
+}
 
-inline Vector3 operator*(const Vector3& left, const Vector3& right)
+template<typename T>
+inline Vector3T<T> operator*(const Vector3T<T>& left, const Vector3T<T>& right)
 {
-    return Vector3(left.getX() * right.getX(), left.getY() * right.getY(), left.getZ() * right.getZ());
+    return Vector3T<T>(left.getX() * right.getX(), left.getY() * right.getY(), left.getZ() * right.getZ());
 }
 
-inline Vector3 operator*(const Vector3& left, double scalar)
+// The scalar is not deduced, so that double literals work with float vectors.
+template<typename T>
+inline Vector3T<T> operator*(const Vector3T<T>& left, std::type_identity_t<T> scalar)
 {
-    return Vector3(left.getX() * scalar, left.getY() * scalar, left.getZ() * scalar);
+    return Vector3T<T>(left.getX() * scalar, left.getY() * scalar, left.getZ() * scalar);
 }
 
-inline Vector3 operator*(double scalar, const Vector3& right)
+template<typename T>
+inline Vector3T<T> operator*(std::type_identity_t<T> scalar, const Vector3T<T>& right)
 {
     return right * scalar;
 }
 
-inline Vector3 operator/(const Vector3& left, double scalar)
+template<typename T>
+inline Vector3T<T> operator/(const Vector3T<T>& left, std::type_identity_t<T> scalar)
 {
-    return left * (1.0f / scalar);
+    return left * (T(1) / scalar);
 }
 
-inline bool operator==(const Vector3& left, const Vector3& right)
+template<typename T>
+inline bool operator==(const Vector3T<T>& left, const Vector3T<T>& right)
 {
     return left.getX() == right.getX() && left.getY() == right.getY() && left.getZ() == right.getZ();
 }
 
-inline double Dot(const Vector3& left, const Vector3& right)
+template<typename T>
+inline T Dot(const Vector3T<T>& left, const Vector3T<T>& right)
 {
     return left.getX() * right.getX() + left.getY() * right.getY() + left.getZ() * right.getZ();
 }
 
-inline Vector3 Cross(const Vector3& left, const Vector3& right)
+template<typename T>
+inline Vector3T<T> Cross(const Vector3T<T>& left, const Vector3T<T>& right)
 {
-    return Vector3(
+    return Vector3T<T>(
         left.getY() * right.getZ() - left.getZ() * right.getY(),
         left.getZ() * right.getX() - left.getX() * right.getZ(),
         left.getX() * right.getY() - left.getY() * right.getX()
     );
 }
 
-inline Vector3 Normalize(const Vector3& vector)
+// Componentwise minimum and maximum. A NaN component of right is ignored, as by std::fmin,
+// but without its library call: these are inlined as single min/max instructions.
+template<typename T>
+inline Vector3T<T> Min(const Vector3T<T>& left, const Vector3T<T>& right)
 {
-    return vector / vector.Length();
+    auto min = [](T a, T b) { return b < a ? b : a; };
+    return Vector3T<T>(min(left.getX(), right.getX()), min(left.getY(), right.getY()), min(left.getZ(), right.getZ()));
 }
 
-Vector3 RandomInUnitSphereVector()
+template<typename T>
+inline Vector3T<T> Max(const Vector3T<T>& left, const Vector3T<T>& right)
 {
-    while (true)
-    {
-        auto p = Vector3::random(-1,1);
-        if (p.LengthSquared() >= 1) continue;
-        return Normalize(p);
-    }
+    auto max = [](T a, T b) { return b > a ? b : a; };
+    return Vector3T<T>(max(left.getX(), right.getX()), max(left.getY(), right.getY()), max(left.getZ(), right.getZ()));
+}
+
+template<typename T>
+inline Vector3T<T> Normalize(const Vector3T<T>& vector)
+{
+    return vector / vector.Length();
 }
 
-inline Vector3 reflect(const Vector3& v, const Vector3& n)
+template<typename T>
+inline Vector3T<T> reflect(const Vector3T<T>& v, const Vector3T<T>& n)
 {
     return v - 2 * Dot(v, n) * n;
 }
 
+// Moves a point off a surface along its normal n, by an amount that grows with the
+// magnitude of its coordinates so that the offset always exceeds their rounding error.
+// Wachter and Binder, "A Fast and Robust Method for Avoiding Self-Intersection",
+// Ray Tracing Gems, chapter 6.
+template<typename T>
+inline Vector3T<T> OffsetRayOrigin(const Vector3T<T>& p, const Vector3T<T>& n)
+{
+    using Bits = std::conditional_t<sizeof(T) == 4, int32_t, int64_t>;
+
+    auto offset = [](T coordinate, T normal)
+    {
+        Bits ulps = static_cast<Bits>(Epsilon<T>::IntScale * normal);
+        T moved = std::bit_cast<T>(std::bit_cast<Bits>(coordinate) + (coordinate < 0 ? -ulps : ulps));
+        return std::fabs(coordinate) < Epsilon<T>::Origin ? coordinate + Epsilon<T>::FloatScale * normal : moved;
+    };
+
+    return Vector3T<T>(offset(p.getX(), n.getX()), offset(p.getY(), n.getY()), offset(p.getZ(), n.getZ()));
+}
+
+using Vector3 = Vector3T<Real>;
 using Point3 = Vector3;
-using Color3 = Vector3;
\ No newline at end of file
+using Color3 = Vector3;
+
+inline Vector3 RandomInUnitSphereVector(Sampler& sampler)
+{
+    while (true)
+    {
+        auto p = Vector3::random(sampler, -1, 1);
+        if (p.LengthSquared() >= 1) continue;
+        return Normalize(p);
+    }
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "PathTracer.h"
+#include "Image.h"
+#include "TileScheduler.h"
+
+// Breadth-first alternative to ray_cast. All the paths of a tile are traced together:
+// a wave of camera rays is intersected as a whole, the hits are grouped by material and
+// shaded in bulk, and the rays that keep bouncing are compacted into the next wave.
+// The camera rays of a wave and the shadow rays towards each light are traced as SIMD ray
+// packets (see Scene::intersectsRays). Every path consumes its sampler exactly like
+// ray_cast does and the samples of a pixel are summed in sample order, so both modes
+// produce the same image.
+class WavefrontIntegrator
+{
+public:
+    // Upper bound on the number of paths in flight, which bounds the working set.
+    static const size_t MaxWaveSize = 4096;
+
+    WavefrontIntegrator(const Scene& world, int max_depth, uint64_t seed)
+        : m_world(world), m_max_depth(max_depth), m_seed(seed)
+    {}
+
+    // Traces samples[p] new samples of every pixel p of the tile, row-major, numbered from
+    // the count the pixel already has in image. Fills sums with the sum of their radiance
+    // and squares with the sum of their squared luminance, per pixel.
+    void traceTile(const Tile& tile, const Image& image, const std::vector<int>& samples, std::vector<Color3>& sums, std::vector<Real>& squares) const
+    {
+        size_t pixelCount = samples.size();
+        std::vector<size_t> firstPath(pixelCount + 1, 0);
+        for (size_t pixel = 0; pixel < pixelCount; pixel++)
+            firstPath[pixel + 1] = firstPath[pixel] + samples[pixel];
+        size_t pathCount = firstPath[pixelCount];
+
+        std::vector<Color3> radiance(pathCount);
+        Wave wave;
+        wave.reserve(std::min(pathCount, MaxWaveSize));
+
+        for (size_t begin = 0; begin < pathCount; begin += MaxWaveSize)
+        {
+            size_t end = std::min(pathCount, begin + MaxWaveSize);
+            generate(tile, image, firstPath, begin, end, wave);
+
+            for (int depth = 0; depth < m_max_depth && !wave.paths.empty(); depth++)
+            {
+                intersect(wave, radiance, depth == 0);
+                shade(wave);
+                compact(wave, depth);
+            }
+
+            // Paths still alive after max_depth bounces contribute nothing, like in ray_cast.
+        }
+
+        sums.assign(pixelCount, Color3(0, 0, 0));
+        squares.assign(pixelCount, 0);
+        for (size_t pixel = 0; pixel < pixelCount; pixel++)
+        {
+            for (size_t id = firstPath[pixel]; id < firstPath[pixel + 1]; id++)
+            {
+                sums[pixel] += radiance[id];
+                Real luminance = Luminance(radiance[id]);
+                squares[pixel] += luminance * luminance;
+            }
+        }
+    }
+
+private:
+    const Scene& m_world;
+    int m_max_depth;
+    uint64_t m_seed;
+
+    struct PathState
+    {
+        Ray ray;
+        Color3 throughput;
+        Sampler sampler;
+        uint32_t id; // Index of the path in the tile, see generate.
+        bool alive;
+    };
+
+    struct Wave
+    {
+        std::vector<PathState> paths;
+        std::vector<hit_record> hits;
+        std::vector<uint32_t> order;
+        std::vector<TextureQuery> queries;
+
+        // Batches of rays traced as packets, and their results.
+        std::vector<Ray> rays;
+        std::vector<Real> distances;
+        std::vector<Vector3> directions;
+        std::vector<uint32_t> lit;
+        std::unique_ptr<bool[]> flags;
+
+        void reserve(size_t size)
+        {
+            paths.reserve(size);
+            hits.reserve(size);
+            order.reserve(size);
+            queries.reserve(size);
+            rays.reserve(size);
+            distances.reserve(size);
+            directions.reserve(size);
+            lit.reserve(size);
+            flags = std::make_unique<bool[]>(size);
+        }
+    };
+
+    // Paths of pixel p are [firstPath[p], firstPath[p + 1]).
+    void generate(const Tile& tile, const Image& image, const std::vector<size_t>& firstPath, size_t begin, size_t end, Wave& wave) const
+    {
+        wave.paths.clear();
+        size_t pixel = std::upper_bound(firstPath.begin(), firstPath.end(), begin) - firstPath.begin() - 1;
+        for (size_t id = begin; id < end; id++)
+        {
+            while (id >= firstPath[pixel + 1]) pixel++;
+            int s = static_cast<int>(id - firstPath[pixel]);
+            int i = tile.x0 + static_cast<int>(pixel % tile.getWidth());
+            int j = tile.y0 + static_cast<int>(pixel / tile.getWidth());
+
+            Sampler sampler = Sampler::forPixelSample(m_seed, j * image.getWidth() + i, image.getSampleCount(i, j) + s);
+            Real u = Real(i + RandomDouble(sampler)) / image.getWidth();
+            Real v = Real(j + RandomDouble(sampler)) / image.getHeight();
+            Ray ray = m_world.getCamera().getRay(u, v);
+
+            wave.paths.push_back(PathState{ ray, Color3(1, 1, 1), sampler, static_cast<uint32_t>(id), true });
+        }
+    }
+
+    // Intersects the whole wave, as ray packets when the rays are coherent. Paths leaving
+    // the scene are finished with the background and the others are listed in order,
+    // sorted by material.
+    void intersect(Wave& wave, std::vector<Color3>& radiance, bool coherent) const
+    {
+        size_t count = wave.paths.size();
+        wave.hits.resize(count);
+        wave.order.clear();
+
+        bool* found = wave.flags.get();
+        if (coherent)
+        {
+            wave.rays.clear();
+            for (const auto& path : wave.paths)
+                wave.rays.push_back(path.ray);
+            m_world.intersectsRays(wave.rays.data(), count, RayEpsilon, infinity, wave.hits.data(), found);
+        }
+        else
+        {
+            for (size_t p = 0; p < count; p++)
+                found[p] = m_world.intersects(wave.paths[p].ray, RayEpsilon, infinity, wave.hits[p]);
+        }
+
+        for (size_t p = 0; p < count; p++)
+        {
+            PathState& path = wave.paths[p];
+            if (found[p])
+            {
+                wave.order.push_back(static_cast<uint32_t>(p));
+            }
+            else
+            {
+                radiance[path.id] = path.throughput * background(path.ray);
+                path.alive = false;
+            }
+        }
+
+        std::sort(wave.order.begin(), wave.order.end(), [&](uint32_t a, uint32_t b)
+        {
+            const TextureMaterial* left = wave.hits[a].textureMaterial;
+            const TextureMaterial* right = wave.hits[b].textureMaterial;
+            return left != right ? left < right : a < b;
+        });
+    }
+
+    // Scatters the hits one material group at a time, then lights them with one batch of
+    // shadow ray packets per light.
+    void shade(Wave& wave) const
+    {
+        wave.queries.resize(wave.order.size());
+        for (size_t k = 0; k < wave.order.size(); k++)
+        {
+            PathState& path = wave.paths[wave.order[k]];
+            wave.queries[k] = TextureQuery{ &path.ray, &wave.hits[wave.order[k]], &path.sampler };
+        }
+
+        for (size_t first = 0; first < wave.order.size();)
+        {
+            const TextureMaterial* material = wave.hits[wave.order[first]].textureMaterial;
+            size_t last = first + 1;
+            while (last < wave.order.size() && wave.hits[wave.order[last]].textureMaterial == material)
+                last++;
+
+            material->getTexturesAt(wave.queries.data() + first, last - first);
+            first = last;
+        }
+
+        wave.lit.clear();
+        for (size_t k = 0; k < wave.order.size(); k++)
+        {
+            if (wave.queries[k].scattered)
+                wave.lit.push_back(static_cast<uint32_t>(k));
+            else
+                wave.paths[wave.order[k]].alive = false;
+        }
+
+        bool* occluded = wave.flags.get();
+        for (const auto& light : m_world.getLights())
+        {
+            wave.rays.clear();
+            wave.distances.clear();
+            wave.directions.clear();
+            for (uint32_t k : wave.lit)
+            {
+                const Point3& p = wave.queries[k].record->p;
+                wave.directions.push_back(light->getDirection(p));
+                wave.distances.push_back(light->getDistance(p));
+                wave.rays.push_back(wave.queries[k].record->spawn_ray(wave.directions.back()));
+            }
+
+            m_world.occludedRays(wave.rays.data(), wave.distances.data(), wave.rays.size(), RayEpsilon, occluded);
+
+            Color3 light_color = light->getColor();
+            for (size_t m = 0; m < wave.lit.size(); m++)
+            {
+                if (occluded[m]) continue;
+
+                TextureQuery& query = wave.queries[wave.lit[m]];
+                addLightContribution(*query.record, wave.directions[m], light_color, query.diffuse, query.specular, query.color);
+            }
+        }
+
+        for (uint32_t k : wave.lit)
+        {
+            PathState& path = wave.paths[wave.order[k]];
+            path.throughput = path.throughput * wave.queries[k].color;
+        }
+    }
+
+    // Applies Russian roulette and moves the surviving paths, with their bounce ray, to
+    // the front of the wave.
+    void compact(Wave& wave, int depth) const
+    {
+        for (size_t k = 0; k < wave.order.size(); k++)
+        {
+            PathState& path = wave.paths[wave.order[k]];
+            if (!path.alive) continue;
+
+            if (russianRoulette(depth, path.throughput, path.sampler))
+                path.ray = wave.queries[k].ray_out;
+            else
+                path.alive = false;
+        }
+
+        auto last = std::remove_if(wave.paths.begin(), wave.paths.end(), [](const PathState& path) { return !path.alive; });
+        wave.paths.erase(last, wave.paths.end());
+    }
+};
@@ -2,190 +2,233 @@
 #include "Image.h"
 #include "TextureMaterial.h"
 #include "Mesh.h"
-#include "Blob.h"
+#include "Renderer.h"
+#include "Checkpoint.h"
+#include "SceneLoader.h"
 
+#include <charconv>
 #include <chrono>
 #include <iostream>
 
-Color3 ray_cast(const Ray& r, const Scene& world, int limit)
+struct Options
 {
-    if (limit <= 0) return Color3(0, 0, 0);
+    std::string output;
+    uint64_t seed = 0;
+    int tile_size = 16;
+    RenderMode mode = RenderMode::DepthFirst;
+    SchedulerSettings scheduler;
+    bool tile_report = false;
+    ImageFormat format = ImageFormat::PPM;
+    bool stream = false;
+    int samples_per_pixel = 0; // 0 for the value of the scene, else 100.
+    std::string scene;
+    std::string mesh_cache;
+    std::string checkpoint;
+    double checkpoint_interval = 60;
+    std::string resume;
+    double noise = 0;
+    int max_samples_per_pixel = 0;
+    std::string spp_image;
+};
+
+static void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " <output file.ppm|.png|.pfm> [options]" << std::endl
+              << "  --seed <n>          seed of the random sampling (default 0)" << std::endl
+              << "  --mode <m>          depth-first or wavefront (default depth-first)" << std::endl
+              << "  --threads <n>       number of render threads, 0 for all cores (default 0)" << std::endl
+              << "  --tile-size <n>     tile edge in pixels (default 16)" << std::endl
+              << "  --grain <n>         tiles per scheduling grain (default 1)" << std::endl
+              << "  --tile-order <o>    scanline, morton or spiral (default morton)" << std::endl
+              << "  --tile-report       print the time spent on every tile" << std::endl
+              << "  --stream            write the rows to the output as soon as they are rendered" << std::endl
+              << "  --scene <f>         load the scene and its render settings from f (default: built-in scene)" << std::endl
+              << "  --mesh-cache <d>    keep the meshes of the scene file, built, in directory d for the next renders" << std::endl
+              << "  --spp <n>           samples per pixel (default: the scene's, else 100)" << std::endl
+              << "  --checkpoint <f>    save the render state to f between passes and at the end" << std::endl
+              << "  --checkpoint-interval <s>" << std::endl
+              << "                      seconds between checkpoints, 0 for every pass (default 60)" << std::endl
+              << "  --resume <f>        continue the render saved in f, checkpointing to f by default" << std::endl
+              << "  --noise <t>         adaptive sampling: stop sampling the pixels whose error is below t," << std::endl
+              << "                      in output units, e.g. 0.002 (default 0, off); --spp is then the average" << std::endl
+              << "  --max-spp <n>       most samples of a pixel with adaptive sampling (default 4 * spp)" << std::endl
+              << "  --spp-image <f>     write an image of the samples spent on every pixel to f" << std::endl;
+}
 
-    hit_record record;
+// Reads the whole of text as a number, false if it is not one.
+template<typename T>
+static bool parseNumber(const std::string& text, T& value)
+{
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
 
-    if (world.intersects(r, 0.001f, infinity, record))
+static bool parseArguments(int argc, char** argv, Options& options)
+{
+    if (argc < 2) return false;
+    options.output = argv[1];
+    if (!parseImageFormat(options.output, options.format)) return false;
+
+    for (int a = 2; a < argc; a++)
     {
-        Ray ray_out;
-        Color3 color;
-        double diffuse;
-        double specular;
-        if (record.textureMaterial->getTextureAt(r, record, color, ray_out, diffuse, specular))
+        std::string option = argv[a];
+        if (option == "--tile-report")
         {
-            for (auto light : world.getLights())
-            {
-                auto light_direction = light->getDirection(record.p);
-                auto light_distance = light->getDistance(record.p);
-                auto light_color = light->getColor();
-
-                Ray shadow_ray(record.p, light_direction);
-                hit_record shadow_record;
-
-                if (world.intersects(shadow_ray, 0.001f, light_distance, shadow_record))
-                {
-                    continue;
-                }
-
-                auto light_intensity = Dot(record.normal, light_direction);
-
-                if (light_intensity > 0)
-                {
-                    color += light_color * diffuse * light_intensity;
-                }
-
-                auto reflected = reflect(-light_direction, record.normal);
-                auto specular_intensity = Dot(reflected, light_direction);
+            options.tile_report = true;
+            continue;
+        }
+        if (option == "--stream")
+        {
+            options.stream = true;
+            continue;
+        }
 
-                if (specular_intensity > 0)
-                {
-                    color += light_color * specular * pow(specular_intensity, 8);
-                }
-            }
+        if (a + 1 >= argc) return false;
+        std::string value = argv[++a];
 
-            return color * ray_cast(ray_out, world, limit - 1);
+        bool valid = true;
+        if (option == "--seed") valid = parseNumber(value, options.seed);
+        else if (option == "--threads") valid = parseNumber(value, options.scheduler.threads);
+        else if (option == "--tile-size")
+        {
+            valid = parseNumber(value, options.tile_size);
+            options.tile_size = std::max(1, options.tile_size);
         }
-        else
+        else if (option == "--spp")
         {
-            return Color3(0, 0, 0);
+            valid = parseNumber(value, options.samples_per_pixel);
+            options.samples_per_pixel = std::max(1, options.samples_per_pixel);
         }
+        else if (option == "--scene") options.scene = value;
+        else if (option == "--mesh-cache") options.mesh_cache = value;
+        else if (option == "--checkpoint") options.checkpoint = value;
+        else if (option == "--checkpoint-interval") valid = parseNumber(value, options.checkpoint_interval);
+        else if (option == "--resume") options.resume = value;
+        else if (option == "--noise") valid = parseNumber(value, options.noise);
+        else if (option == "--max-spp") valid = parseNumber(value, options.max_samples_per_pixel);
+        else if (option == "--spp-image") options.spp_image = value;
+        else if (option == "--grain") valid = parseNumber(value, options.scheduler.grain_size);
+        else if (option == "--tile-order") valid = parseTileOrder(value, options.scheduler.order);
+        else if (option == "--mode") valid = parseRenderMode(value, options.mode);
+        else valid = false;
+
+        if (!valid) return false;
     }
 
-    Vector3 unit_direction = Normalize(r.direction());
-    auto t = 0.5 * (unit_direction.getY() + 1.0);
-    return (1.0 - t) * Color3(1.0, 1.0, 1.0) + t * Color3(0.5, 0.7, 1.0);
+    if (options.checkpoint.empty()) options.checkpoint = options.resume;
+    return true;
 }
 
-Pixel processImageColor(Color3& pixel_color, int samples_per_pixel)
+// Scene rendered without --scene, as in scenes/default.scene.
+static void buildDefaultScene(Scene& world)
 {
-    auto r = pixel_color.getX();
-    auto g = pixel_color.getY();
-    auto b = pixel_color.getZ();
-
-    auto scale = 1.0f / samples_per_pixel;
+    auto material_ground = std::make_shared<UniformTexture>(Color3(0.0, 0.0, 0.0), 0.5, 0.5);
+    auto material_red = std::make_shared<UniformTexture>(Color3(1.0, 0.0, 0.0), 0.5, 0.5);
 
-    r = sqrt(r * scale);
-    g = sqrt(g * scale);
-    b = sqrt(b * scale);
+    world.addSphere(Point3(0, 0, -1), 0.5, material_red);
+    world.addSphere(Point3(0, -100.5, -1), 100, material_ground);
 
-    int ir = static_cast<int>(256 * Clamp(r, 0.0, 0.999));
-    int ig = static_cast<int>(256 * Clamp(g, 0.0, 0.999));
-    int ib = static_cast<int>(256 * Clamp(b, 0.0, 0.999));
+    world.addLight(std::make_shared<PointLight>(Point3(1, 4, 10), Color3(1, 1, 1), 1.2));
 
-    Pixel pixel(ir, ig, ib);
-    return pixel;
+    world.build();
 }
 
 int main(int argc, char** argv)
 {
     auto start = std::chrono::high_resolution_clock::now();
 
-    if (argc != 2)
+    Options options;
+    if (!parseArguments(argc, argv, options))
     {
-        std::cerr << "Usage: " << argv[0] << " <output file.ppm>" << std::endl;
+        printUsage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    std::vector<std::shared_ptr<Object>> objects;
-    std::vector<std::shared_ptr<Light>> lights;
-    Scene world(objects, lights);
-
-    auto material_ground = std::make_shared<UniformTexture>(Color3(0.0, 0.0, 0.0), 0.5f, 0.5f);
-    auto material_red = std::make_shared<UniformTexture>(Color3(1.0, 0.0, 0.0), 0.5f, 0.5f);
-
-    double m_e = 10;
-    double m_d = 0.25;
+    Scene world({}, {});
 
-    /*std::shared_ptr<Sphere> sphere1 = std::make_shared<Sphere>(Point3(0, 0, 0), 0.10, material_blue);
-    std::shared_ptr<Sphere> sphere2 = std::make_shared<Sphere>(Point3(m_e, 0, 0), 0.10, material_blue);
-    std::shared_ptr<Sphere> sphere3 = std::make_shared<Sphere>(Point3(0, m_e, 0), 0.10, material_blue);
-    std::shared_ptr<Sphere> sphere4 = std::make_shared<Sphere>(Point3(0, 0, m_e), 0.10, material_blue);
-    std::shared_ptr<Sphere> sphere5 = std::make_shared<Sphere>(Point3(m_e, m_e, 0), 0.10, material_blue);
-    std::shared_ptr<Sphere> sphere6 = std::make_shared<Sphere>(Point3(m_e, 0, m_e), 0.10, material_blue);
-    std::shared_ptr<Sphere> sphere7 = std::make_shared<Sphere>(Point3(0, m_e, m_e), 0.10, material_blue);
-    std::shared_ptr<Sphere> sphere8 = std::make_shared<Sphere>(Point3(m_e, m_e, m_e), 0.10, material_blue);
-
-    world.addObject(sphere1);
-    world.addObject(sphere2);
-    world.addObject(sphere3);
-    world.addObject(sphere4);
-    world.addObject(sphere5);
-    world.addObject(sphere6);
-    world.addObject(sphere7);
-    world.addObject(sphere8);*/
+    SceneSettings sceneSettings;
+    if (!options.scene.empty())
+    {
+        SceneLoader loader;
+        std::unique_ptr<MeshCache> cache;
+        if (!options.mesh_cache.empty())
+        {
+            cache = std::make_unique<MeshCache>(options.mesh_cache);
+            loader.setMeshCache(cache.get());
+        }
+        if (!loader.load(options.scene, world, sceneSettings)) return EXIT_FAILURE;
+        loader.report(std::cerr);
+        if (cache) cache->report(std::cerr);
+    }
+    else
+    {
+        buildDefaultScene(world);
+    }
 
-    /*Blob blob(Point3(0, 0, 0), m_e, m_d, 2.0, material_blue);
-    Mesh mesh = blob.marchCubes();
-    world.addObject(std::make_shared<Mesh>(mesh));*/
+    const int samples_per_pixel = options.samples_per_pixel > 0 ? options.samples_per_pixel
+        : sceneSettings.samples_per_pixel > 0 ? sceneSettings.samples_per_pixel : 100;
+    int max_depth = sceneSettings.max_depth;
 
-    Sphere sphere(Point3(0, 0, -1), 0.5, material_red);
-    world.addObject(std::make_shared<Sphere>(sphere));
-    Sphere sphere2(Point3(0, -100.5, -1), 100, material_ground);
-    world.addObject(std::make_shared<Sphere>(sphere2));
+    int width = sceneSettings.width;
+    int height = sceneSettings.height;
+    Image image(width, height);
 
-    world.addLight(std::make_shared<PointLight>(Point3(1, 4, 10), Color3(1, 1, 1), 1.2f));
+    std::cerr << "Rendering a " << width << "x" << height << " image " << std::endl;
 
-    const int samples_per_pixel = 100;
-    int max_depth = 50;
+    RenderSettings settings;
+    settings.samples_per_pixel = samples_per_pixel;
+    settings.max_depth = max_depth;
+    // Every pixel sample draws from its own stream derived from this seed, so the
+    // image is reproducible for a given seed whatever the number of threads.
+    settings.seed = options.seed;
+    settings.tile_size = options.tile_size;
+    settings.mode = options.mode;
+    settings.noise_threshold = options.noise;
+    settings.max_samples_per_pixel = options.max_samples_per_pixel;
+    Renderer renderer(world, settings);
+
+    if (!options.resume.empty())
+    {
+        if (!loadCheckpoint(image, settings, sceneSettings.content_hash, options.resume)) return EXIT_FAILURE;
+        std::cerr << "Resuming from " << image.getMinSampleCount() << " samples per pixel" << std::endl;
+    }
 
-    int width = 512;
-    int height = 512;
-    Image image(width, height, samples_per_pixel);
+    std::unique_ptr<ImageStream> stream;
+    if (options.stream)
+    {
+        stream = std::make_unique<ImageStream>(image, options.output, options.format);
+        if (!stream->isOpen()) return EXIT_FAILURE;
+    }
 
-    std::cerr << "Rendering a " << width << "x" << height << " image " << std::endl;
+    TileScheduler scheduler(options.scheduler);
 
-#define MULTITHREADED 1
-#if MULTITHREADED
-    std::for_each(std::execution::par, image.getVerticalIter().begin(), image.getVerticalIter().end(), [&](int j)
+    // Progressive passes, checkpointed at most every checkpoint_interval seconds, and
+    // after the last one so that the render can be continued to more samples.
+    using Clock = std::chrono::steady_clock;
+    auto passStart = Clock::now();
+    auto lastCheckpoint = passStart;
+    bool saved = true;
+    renderer.renderProgressive(scheduler, image, [&](double samples, bool last)
     {
-        std::for_each(std::execution::par, image.getHorizontalIter().begin(), image.getHorizontalIter().end(), [&](int i)
+        auto now = Clock::now();
+        std::cerr << samples << " spp, pass in " << std::chrono::duration<double>(now - passStart).count() << " s" << std::endl;
+        if (!options.checkpoint.empty() && (last || std::chrono::duration<double>(now - lastCheckpoint).count() >= options.checkpoint_interval))
         {
-            Color3 pixel_color(0, 0, 0);
-            std::for_each(std::execution::par, image.getSampleIter().begin(), image.getSampleIter().end(), [&](int s)
-            {
-                double u = double(i + RandomDouble()) / (image.getWidth() - 1);
-                double v = double(j + RandomDouble()) / (image.getHeight() - 1);
-                Ray ray = world.getCamera().getRay(u, v);
-                pixel_color += ray_cast(ray, world, max_depth); 
-            });
-
-            Pixel pixel = processImageColor(pixel_color, samples_per_pixel);
-            image.setPixel(i, j, pixel);
-        });
-    });
-#else
-    for (int j = image.getHeight() - 1; j >= 0; j--)
-    {
-        std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
-        for (int i = 0; i < image.getWidth(); i++)
-        {
-            Color3 pixel_color(0, 0, 0);
-            for (int s = 0; s < samples_per_pixel; s++)
-            {
-                double u = double(i + RandomDouble()) / (image.getWidth() - 1);
-                double v = double(j + RandomDouble()) / (image.getHeight() - 1);
-                Ray ray = world.getCamera().getRay(u, v);
-                pixel_color += ray_cast(ray, world, max_depth);
-            }
-
-            Pixel pixel = processImageColor(pixel_color, samples_per_pixel);
-            image.setPixel(i, j, pixel);
+            saved = saveCheckpoint(image, settings, sceneSettings.content_hash, options.checkpoint) && saved;
+            lastCheckpoint = Clock::now();
         }
+        passStart = Clock::now();
+    }, stream.get());
+    if (options.tile_report) scheduler.report(std::cerr);
+    if (options.noise > 0)
+    {
+        std::cerr << "Adaptive sampling: " << static_cast<double>(image.getTotalSampleCount()) / (width * height) << " spp on average, "
+                  << image.getMinSampleCount() << " to " << image.getMaxSampleCount() << " per pixel" << std::endl;
     }
-#endif
-
-    objects.clear();
-    lights.clear();
+    if (!options.spp_image.empty() && !writeImage(image.sampleCountImage(), options.spp_image)) return EXIT_FAILURE;
 
-    image.toPPM(argv[1]);
+    bool written = stream ? stream->finish() : writeImage(image, options.output);
+    if (!written || !saved) return EXIT_FAILURE;
 
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::seconds>(end - start);
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Compares two PPM images (P3 or P6, 8 bits per channel) pixel by pixel, e.g. the double
+// and float renders of PrecisionBenchmark, and optionally writes a diff image where every
+// channel is the absolute difference scaled by 16.
+//     ./ImageDiff a.ppm b.ppm [diff.ppm]
+
+struct PPMImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<int> channels; // r, g, b per pixel, rows in file order.
+};
+
+static bool readPPM(const std::string& path, PPMImage& image)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return false;
+    }
+
+    // Skips whitespace and # comments between header fields.
+    auto next = [&](int& value)
+    {
+        file >> std::ws;
+        while (file.peek() == '#')
+        {
+            std::string comment;
+            std::getline(file, comment);
+            file >> std::ws;
+        }
+        return static_cast<bool>(file >> value);
+    };
+
+    std::string magic;
+    int maxValue = 0;
+    file >> magic;
+    if ((magic != "P3" && magic != "P6") || !next(image.width) || !next(image.height) || !next(maxValue) || maxValue != 255)
+    {
+        std::cerr << "Error: " << path << " is not an 8-bit P3 or P6 image" << std::endl;
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(image.width) * image.height * 3;
+    image.channels.resize(count);
+    if (magic == "P6")
+    {
+        file.get(); // Single whitespace after the header.
+        std::vector<unsigned char> bytes(count);
+        file.read(reinterpret_cast<char*>(bytes.data()), count);
+        std::copy(bytes.begin(), bytes.end(), image.channels.begin());
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++) file >> image.channels[i];
+    }
+
+    if (!file)
+    {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <a.ppm> <b.ppm> [diff.ppm]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    PPMImage a, b;
+    if (!readPPM(argv[1], a) || !readPPM(argv[2], b)) return EXIT_FAILURE;
+    if (a.width != b.width || a.height != b.height)
+    {
+        std::cerr << "Error: sizes differ, " << a.width << "x" << a.height << " and " << b.width << "x" << b.height << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Pixels by largest channel difference: 0, 1, 2-4, 5-16, above 16.
+    const int bucketLimits[] = { 0, 1, 4, 16 };
+    const char* bucketNames[] = { "0", "1", "2-4", "5-16", ">16" };
+    size_t buckets[5] = {};
+
+    size_t pixelCount = static_cast<size_t>(a.width) * a.height;
+    size_t differing = 0;
+    int maxDifference = 0;
+    double sumAbsolute = 0.0;
+    double sumSquared = 0.0;
+    std::vector<int> diff(a.channels.size());
+    for (size_t pixel = 0; pixel < pixelCount; pixel++)
+    {
+        int pixelMax = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            size_t i = pixel * 3 + c;
+            int d = std::abs(a.channels[i] - b.channels[i]);
+            diff[i] = std::min(255, d * 16);
+            pixelMax = std::max(pixelMax, d);
+            sumAbsolute += d;
+            sumSquared += static_cast<double>(d) * d;
+        }
+
+        if (pixelMax > 0) differing++;
+        maxDifference = std::max(maxDifference, pixelMax);
+
+        int bucket = 0;
+        while (bucket < 4 && pixelMax > bucketLimits[bucket]) bucket++;
+        buckets[bucket]++;
+    }
+
+    double mse = sumSquared / a.channels.size();
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << a.width << "x" << a.height << ", " << differing << " differing pixels (" << 100.0 * differing / pixelCount << "%)" << std::endl;
+    std::cout << "max channel difference  " << maxDifference << std::endl;
+    std::cout << "mean absolute error     " << sumAbsolute / a.channels.size() << std::endl;
+    std::cout << "RMSE                    " << std::sqrt(mse) << std::endl;
+    if (mse > 0)
+        std::cout << "PSNR                    " << 10.0 * std::log10(255.0 * 255.0 / mse) << " dB" << std::endl;
+    else
+        std::cout << "PSNR                    identical" << std::endl;
+
+    std::cout << "pixels by max channel difference:" << std::endl;
+    for (int bucket = 0; bucket < 5; bucket++)
+        std::cout << std::setw(8) << bucketNames[bucket] << std::setw(10) << buckets[bucket] << std::endl;
+
+    if (argc > 3)
+    {
+        std::ofstream file(argv[3], std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Error: Could not open file " << argv[3] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::vector<unsigned char> bytes(diff.begin(), diff.end());
+        file << "P6\n" << a.width << " " << a.height << "\n255\n";
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    return EXIT_SUCCESS;
+}